@@ -0,0 +1,609 @@
+#include "loss.h"
+#include "batchoptimizer.h"
+
+#include "graph.h"
+#include "nodetypes.h"
+#include "layers.h"
+#include "executors.h"
+#include "executioncontext.h"
+#include "segmentedcontext.h"
+#include "memoryplan.h"
+#include "quantize.h"
+#include "staticnet.h"
+#include "sparseinput.h"
+#include "embedding.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Benchmarks for the library. Every measurement does a warmup run followed
+// by a number of timed runs, and the results are printed as JSON on stdout
+// so that runs against different versions of the library can be diffed.
+//
+// usage: bench [timedRuns] [minSecondsPerRun]
+
+typedef std::chrono::steady_clock benchclock;
+
+static unsigned TIMED_RUNS = 5;
+static double MIN_RUN_SECONDS = 0.05;
+
+double secondsSince(benchclock::time_point start)
+{
+    return std::chrono::duration<double>(benchclock::now() - start).count();
+}
+
+struct Measurement
+{
+    double median;
+    double best;
+    unsigned iterations;
+};
+
+// Calls work(n) for growing n until a single run takes at least
+// MIN_RUN_SECONDS (this doubles as the warmup), then times TIMED_RUNS runs
+// of that size. The reported rate is units of work per second, where one
+// call of work(n) does n*unitsPerIteration units.
+template<typename WorkT>
+Measurement measure(WorkT work, double unitsPerIteration=1)
+{
+    unsigned n = 1;
+    while(true)
+    {
+        auto start = benchclock::now();
+        work(n);
+        if(secondsSince(start) >= MIN_RUN_SECONDS || n >= (1u << 30))
+            break;
+        n *= 2;
+    }
+
+    std::vector<double> rates;
+    for(unsigned r = 0; r < TIMED_RUNS; ++r)
+    {
+        auto start = benchclock::now();
+        work(n);
+        rates.push_back(n * unitsPerIteration / secondsSince(start));
+    }
+
+    std::sort(rates.begin(), rates.end());
+    return { rates.at(rates.size() / 2), rates.back(), n };
+}
+
+std::string toJson(const Measurement& m)
+{
+    std::stringstream ss;
+    ss << "{\"median\": " << m.median << ", \"best\": " << m.best
+       << ", \"iterations\": " << m.iterations << "}";
+    return ss.str();
+}
+
+// A stack of `depth` Layer<SigmoidNode>s of the given width, followed by a
+// single output LinearLayer.
+struct MLP
+{
+    MLP(unsigned width, unsigned depth)
+    : inputs(width)
+    {
+        graph.addInputNodes(inputs.getInputs());
+
+        auto v = inputs.getNodes();
+        for(unsigned d = 0; d < depth; ++d)
+        {
+            hidden.emplace_back(new Layer<SigmoidNode>(v, width));
+            hidden.back()->randomizeWeights();
+            graph.addParamNodes(hidden.back()->getWeightNodes());
+            v = hidden.back()->getOutputNodes();
+        }
+
+        output.reset(new LinearLayer(v, 1));
+        output->randomizeWeights();
+        graph.addParamNodes(output->getWeightNodes());
+        graph.outputNodes = output->getOutputNodes();
+    }
+
+    Graph graph;
+    NodeSet<InputNode> inputs;
+    std::vector<std::unique_ptr<Layer<SigmoidNode>>> hidden;
+    std::unique_ptr<LinearLayer> output;
+};
+
+std::vector<double> randomValues(unsigned n)
+{
+    std::vector<double> v(n);
+    for(auto& x : v)
+        x = static_cast<double>(rand()) / RAND_MAX;
+    return v;
+}
+
+void benchLayers(std::ostream& out, ThreadPool& pool)
+{
+    // {width, depth}; deep and wide together is kept out of the default sweep
+    // since a single backProp of a 32x3 stack already takes seconds.
+    const unsigned shapes[][2] = {
+        {4, 1}, {4, 2}, {4, 3},
+        {16, 1}, {16, 2},
+        {32, 1}, {32, 2}
+    };
+
+    out << "  \"layers\": [\n";
+    bool first = true;
+    for(auto shape : shapes)
+    {
+        unsigned w = shape[0], d = shape[1];
+        auto construction = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                MLP mlp(w, d);
+        });
+
+        MLP mlp(w, d);
+        auto in = randomValues(w);
+        std::vector<double> seed = {1};
+
+        auto forward = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.forwardPass(in.data());
+        });
+
+        ExecutionContext ctx(mlp.graph);
+        auto forwardContext = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.forwardPass(ctx, in.data());
+        });
+
+        InferenceContext planned(mlp.graph);
+        auto forwardPlanned = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.forwardPass(planned, in.data());
+        });
+
+        QuantizedNetwork quantized;
+        for(auto& l : mlp.hidden)
+            quantized.addLayer(*l);
+        quantized.addLayer(*mlp.output);
+        auto calibration = randomValues(w * 64);
+        quantized.calibrate(calibration.data(), 64);
+
+        double y;
+        auto forwardInt8 = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                quantized.predict(in.data(), &y);
+        });
+
+        mlp.graph.forwardPass(in.data());
+        auto backward = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.backProp(seed);
+        });
+
+        WavefrontExecutor wavefront(pool);
+        mlp.graph.setExecutor(&wavefront);
+
+        auto forwardWavefront = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.forwardPass(in.data());
+        });
+
+        auto backwardWavefront = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.backProp(seed);
+        });
+
+        WorkStealingExecutor workStealing(pool);
+        mlp.graph.setExecutor(&workStealing);
+
+        auto forwardWorkStealing = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.forwardPass(in.data());
+        });
+
+        auto backwardWorkStealing = measure([&](unsigned n) {
+            for(unsigned i = 0; i < n; ++i)
+                mlp.graph.backProp(seed);
+        });
+
+        mlp.graph.setExecutor(nullptr);
+
+        out << (first ? "" : ",\n");
+        out << "    {\"width\": " << w << ", \"depth\": " << d
+            << ", \"params\": " << mlp.graph.paramNodes.size()
+            << ", \"graph_bytes\": " << mlp.graph.memoryReport().total()
+            << ", \"context_activation_bytes\": " << ctx.activationBytes()
+            << ", \"planned_activation_bytes\": " << planned.activationBytes()
+            << ",\n     \"forward_samples_per_sec\": " << toJson(forward)
+            << ",\n     \"forward_context_samples_per_sec\": " << toJson(forwardContext)
+            << ",\n     \"forward_planned_samples_per_sec\": " << toJson(forwardPlanned)
+            << ",\n     \"forward_int8_samples_per_sec\": " << toJson(forwardInt8)
+            << ",\n     \"backward_samples_per_sec\": " << toJson(backward)
+            << ",\n     \"forward_wavefront_samples_per_sec\": " << toJson(forwardWavefront)
+            << ",\n     \"backward_wavefront_samples_per_sec\": " << toJson(backwardWavefront)
+            << ",\n     \"forward_workstealing_samples_per_sec\": " << toJson(forwardWorkStealing)
+            << ",\n     \"backward_workstealing_samples_per_sec\": " << toJson(backwardWorkStealing)
+            << ",\n     \"constructions_per_sec\": " << toJson(construction) << "}";
+        first = false;
+    }
+    out << "\n  ]";
+}
+
+// A 1D convolution over a multichannel signal, through the nodes and
+// lowered to im2col and GEMM, alone and trained under a linear head.
+void benchConv(std::ostream& out)
+{
+    const unsigned C = 4, L = 256, F = 8, K = 5, BATCH = 16;
+
+    Graph graph;
+    NodeSet<InputNode> inputs(C*L);
+    graph.addInputNodes(inputs.getInputs());
+
+    Conv1DLayer conv(inputs.getNodes(), C, L, F, K, 1, K/2);
+    conv.randomizeWeights();
+    graph.addParamNodes(conv.getWeightNodes());
+    graph.outputNodes = conv.getOutputNodes();
+
+    auto in = randomValues(BATCH*C*L);
+    std::vector<double> y(BATCH*conv.outputSize());
+    unsigned params = graph.paramNodes.size();
+    std::vector<double> grads(params);
+
+    ExecutionContext ctx(graph);
+    auto nodes = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+            graph.forwardPass(ctx, &in[(i % BATCH)*C*L]);
+    });
+
+    auto lowered = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+            conv.forward(in.data(), BATCH, y.data());
+    }, BATCH);
+
+    auto loweredBackward = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+            conv.backward(in.data(), y.data(), BATCH, grads.data());
+    }, BATCH);
+
+    // the same conv and head trained both ways, epochs of BATCH samples
+    auto targets = randomValues(BATCH);
+    LinearLayer head(conv.getOutputNodes(), 1);
+    head.randomizeWeights();
+    graph.addParamNodes(head.getWeightNodes());
+    graph.outputNodes = head.getOutputNodes();
+    GradientDescent<SquareLoss> nodeOptimizer(&graph);
+    nodeOptimizer.setTrainingSet(in.data(), targets.data(), BATCH);
+    auto nodeEpochs = measure([&](unsigned n) { nodeOptimizer.runEpochs(n); });
+
+    Graph loweredGraph;
+    Conv1DLayer loweredConv(C, L, F, K, 1, K/2);
+    LinearLayer loweredHead(loweredConv.getOutputNodes(), 1);
+    loweredConv.randomizeWeights();
+    loweredHead.randomizeWeights();
+    loweredGraph.addInputNodes(loweredConv.getInputNodes());
+    loweredGraph.addParamNodes(loweredConv.getWeightNodes());
+    loweredGraph.addParamNodes(loweredHead.getWeightNodes());
+    loweredGraph.outputNodes = loweredHead.getOutputNodes();
+    GradientDescent<SquareLoss> loweredOptimizer(&loweredGraph);
+    loweredOptimizer.setTrainingSet(nullptr, targets.data(), BATCH);
+    loweredOptimizer.addConvolution(&loweredConv, in.data());
+    auto loweredEpochs = measure([&](unsigned n) { loweredOptimizer.runEpochs(n); });
+
+    out << "  \"conv1d\": {\"channels\": " << C << ", \"length\": " << L
+        << ", \"filters\": " << F << ", \"kernel\": " << K
+        << ", \"params\": " << params
+        << ", \"dense_params\": " << (C*L + 1) * conv.outputSize()
+        << ",\n    \"forward_context_samples_per_sec\": " << toJson(nodes)
+        << ",\n    \"forward_gemm_samples_per_sec\": " << toJson(lowered)
+        << ",\n    \"backward_gemm_samples_per_sec\": " << toJson(loweredBackward)
+        << ",\n    \"train_nodes_epochs_per_sec\": " << toJson(nodeEpochs)
+        << ",\n    \"train_gemm_epochs_per_sec\": " << toJson(loweredEpochs) << "}";
+}
+
+// Gradient checkpointing on a deep stack: activation memory and
+// forward + backward throughput, with and without.
+void benchSegmented(std::ostream& out)
+{
+    const unsigned WIDTH = 64, DEPTH = 16;
+
+    MLP mlp(WIDTH, DEPTH);
+    std::vector<double> in(WIDTH, 0.5);
+    std::vector<double> seed(1, 1);
+
+    ExecutionContext full(mlp.graph);
+    SegmentedContext segmented(mlp.graph);
+
+    auto plain = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+        {
+            mlp.graph.forwardPass(full, in.data());
+            mlp.graph.backProp(full, seed);
+        }
+    });
+
+    auto recomputed = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+        {
+            mlp.graph.forwardPass(segmented, in.data());
+            mlp.graph.backProp(segmented, seed);
+        }
+    });
+
+    out << "  \"segmented\": {\"width\": " << WIDTH << ", \"depth\": " << DEPTH
+        << ", \"segments\": " << segmented.numSegments()
+        << ", \"activation_bytes\": " << full.activationBytes()
+        << ", \"segmented_activation_bytes\": " << segmented.activationBytes()
+        << ",\n    \"train_steps_per_sec\": " << toJson(plain)
+        << ",\n    \"segmented_train_steps_per_sec\": " << toJson(recomputed) << "}";
+}
+
+// The Jacobian of a multi-output model: one multi-seed backProp, against a
+// backProp per output.
+void benchJacobian(std::ostream& out)
+{
+    const unsigned WIDTH = 32, OUTPUTS = 16;
+
+    Graph graph;
+    NodeSet<InputNode> inputs(WIDTH);
+    Layer<SigmoidNode> first(inputs.getNodes(), WIDTH);
+    Layer<SigmoidNode> second(first.getOutputNodes(), WIDTH);
+    LinearLayer top(second.getOutputNodes(), OUTPUTS);
+    first.randomizeWeights();
+    second.randomizeWeights();
+    top.randomizeWeights();
+    graph.addInputNodes(inputs.getInputs());
+    graph.addParamNodes(first.getWeightNodes());
+    graph.addParamNodes(second.getWeightNodes());
+    graph.addParamNodes(top.getWeightNodes());
+    graph.outputNodes = top.getOutputNodes();
+
+    std::vector<double> in(WIDTH, 0.5);
+    ExecutionContext ctx(graph);
+    Jacobian J;
+
+    auto seeded = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+            graph.jacobian(ctx, in.data(), J);
+    });
+
+    auto byRows = measure([&](unsigned n) {
+        std::vector<double> seed(OUTPUTS, 0);
+        for(unsigned i = 0; i < n; ++i)
+        {
+            graph.forwardPass(ctx, in.data());
+            for(unsigned o = 0; o < OUTPUTS; ++o)
+            {
+                seed[o] = 1;
+                graph.backProp(ctx, seed);
+                seed[o] = 0;
+                for(unsigned k = 0; k < J.numParams; ++k)
+                    J.dParams[o*J.numParams + k] = ctx.getGradient(k);
+            }
+        }
+    });
+
+    out << "  \"jacobian\": {\"inputs\": " << WIDTH << ", \"hidden_layers\": 2, \"outputs\": " << OUTPUTS
+        << ",\n    \"multi_seed_per_sec\": " << toJson(seeded)
+        << ",\n    \"backprop_per_output_per_sec\": " << toJson(byRows) << "}";
+}
+
+// A bag-of-features model over a large vocabulary: an epoch of gradients
+// from sparse rows through a SparseContext, against the same rows stored
+// densely through an ExecutionContext. Both run the same loop, so the
+// difference is what skipping the zeros saves.
+void benchSparse(std::ostream& out)
+{
+    const unsigned VOCAB = 5000, HIDDEN = 16, NNZ = 10, ROWS = 64;
+
+    Graph graph;
+    NodeSet<InputNode> inputs(VOCAB);
+    Layer<SigmoidNode> hidden(inputs.getNodes(), HIDDEN);
+    LinearLayer top(hidden.getOutputNodes(), 1);
+    hidden.randomizeWeights();
+    top.randomizeWeights();
+    graph.addInputNodes(inputs.getInputs());
+    graph.addParamNodes(hidden.getWeightNodes());
+    graph.addParamNodes(top.getWeightNodes());
+    graph.outputNodes = top.getOutputNodes();
+
+    SparseRows rows(VOCAB);
+    std::vector<double> dense(ROWS * VOCAB, 0), targets(ROWS);
+    for(unsigned r = 0; r < ROWS; ++r)
+    {
+        for(unsigned j = 0; j < NNZ; ++j)
+            dense[r*VOCAB + rand() % VOCAB] = 1;
+        rows.addDenseRow(&dense[r*VOCAB]);
+        targets[r] = rand() % 2;
+    }
+
+    std::vector<double> grads(graph.paramNodes.size());
+    double seed[1];
+
+    ExecutionContext denseCtx(graph);
+    auto denseEpochs = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+            for(unsigned r = 0; r < ROWS; ++r)
+            {
+                auto& y = graph.forwardPass(denseCtx, &dense[r*VOCAB]);
+                SquareLoss::derivative(y.data(), &targets[r], 1, seed);
+                graph.backProp(denseCtx, seed, 1);
+                denseCtx.accumulateGradients(grads.data());
+            }
+    });
+
+    SparseContext sparseCtx(graph);
+    auto sparseEpochs = measure([&](unsigned n) {
+        for(unsigned i = 0; i < n; ++i)
+            for(unsigned r = 0; r < ROWS; ++r)
+            {
+                auto& y = graph.forwardPass(sparseCtx, rows.row(r));
+                SquareLoss::derivative(y.data(), &targets[r], 1, seed);
+                graph.backProp(sparseCtx, seed, 1);
+                sparseCtx.accumulateGradients(grads.data());
+            }
+    });
+
+    out << "  \"sparse\": {\"vocabulary\": " << VOCAB << ", \"nonzeros\": " << NNZ
+        << ", \"rows\": " << ROWS
+        << ",\n    \"dense_epochs_per_sec\": " << toJson(denseEpochs)
+        << ",\n    \"sparse_epochs_per_sec\": " << toJson(sparseEpochs) << "}";
+}
+
+// A categorical feature through an EmbeddingLayer into a small model, with
+// tables of a thousand and a million rows: an epoch should cost the same.
+Measurement benchEmbedding(unsigned tableRows)
+{
+    const unsigned DIM = 8, HIDDEN = 8, SAMPLES = 64;
+
+    EmbeddingLayer embedding(tableRows, DIM);
+    embedding.randomizeWeights();
+    Layer<SigmoidNode> hidden(embedding.getOutputNodes(), HIDDEN);
+    LinearLayer top(hidden.getOutputNodes(), 1);
+    hidden.randomizeWeights();
+    top.randomizeWeights();
+
+    Graph graph;
+    graph.addInputNodes(embedding.getInputNodes());
+    graph.addParamNodes(hidden.getWeightNodes());
+    graph.addParamNodes(top.getWeightNodes());
+    graph.outputNodes = top.getOutputNodes();
+
+    std::vector<unsigned> categories(SAMPLES);
+    std::vector<double> targets(SAMPLES);
+    for(unsigned j = 0; j < SAMPLES; ++j)
+    {
+        categories[j] = rand() % tableRows;
+        targets[j] = rand() % 2;
+    }
+
+    GradientDescent<SquareLoss> optimizer(&graph);
+    optimizer.setTrainingSet(nullptr, targets.data(), SAMPLES);
+    optimizer.addEmbedding(&embedding, categories.data());
+
+    return measure([&](unsigned n) { optimizer.runEpochs(n); });
+}
+
+// The XOR network and training set from main.cpp: two sigmoid layers,
+// the second one the output.
+Measurement benchXor()
+{
+    Graph graph;
+    NodeSet<InputNode> inputs(2);
+    Layer<SigmoidNode> first(inputs.getNodes(), 2);
+    Layer<SigmoidNode> second(first.getOutputNodes(), 1);
+    first.randomizeWeights();
+    second.randomizeWeights();
+    graph.addInputNodes(inputs.getInputs());
+    graph.addParamNodes(first.getWeightNodes());
+    graph.addParamNodes(second.getWeightNodes());
+    graph.outputNodes = second.getOutputNodes();
+
+    double inputValues[] = { 0,0, 1,0, 0,1, 1,1 };
+    double expectedOutputs[] = { 0, 1, 1, 0 };
+
+    GradientDescent<SquareLoss> optimizer(&graph);
+    optimizer.setLearningRate(1);
+    optimizer.setLearningRateDecay(0.9);
+    optimizer.setDecayFrequency(5000);
+    optimizer.setTrainingSet(inputValues, expectedOutputs, 4);
+
+    return measure([&](unsigned n) { optimizer.runEpochs(n); });
+}
+
+// benchXor's network as a StaticNet
+Measurement benchStaticXor()
+{
+    StaticNet<StaticLayer<2, 2, SigmoidActivation>, StaticLayer<2, 1, SigmoidActivation>> net;
+    net.randomizeWeights();
+
+    double inputValues[] = { 0,0, 1,0, 0,1, 1,1 };
+    double expectedOutputs[] = { 0, 1, 1, 0 };
+
+    GradientDescent<SquareLoss> optimizer(&net);
+    optimizer.setLearningRate(1);
+    optimizer.setLearningRateDecay(0.9);
+    optimizer.setDecayFrequency(5000);
+    optimizer.setTrainingSet(inputValues, expectedOutputs, 4);
+
+    return measure([&](unsigned n) { optimizer.runEpochs(n); });
+}
+
+// The cubic polynomial fit from polynomial_regression.cpp; optionally
+// checkpointing every epoch, to measure what that costs training.
+Measurement benchRegression(const std::string& checkpointPath = "")
+{
+    const unsigned N_POINTS = 500;
+    const unsigned N_INPUTS = 3;
+
+    Graph graph;
+    NodeSet<InputNode> inputs(N_INPUTS);
+    LinearLayer layer(inputs.getNodes(0, N_INPUTS), 1);
+    layer.randomizeWeights();
+
+    graph.addInputNodes(inputs.getInputs());
+    graph.addParamNodes(layer.getWeightNodes());
+    graph.outputNodes = layer.getOutputNodes();
+
+    std::vector<double> inputValues(N_INPUTS*N_POINTS);
+    std::vector<double> expectedOutputs(N_POINTS);
+    for(unsigned i = 0; i < N_POINTS; ++i)
+    {
+        double x = static_cast<double>(rand()) / RAND_MAX * 200 - 100;
+        inputValues[i*N_INPUTS] = x;
+        inputValues[i*N_INPUTS + 1] = x*x;
+        inputValues[i*N_INPUTS + 2] = x*x*x;
+        expectedOutputs[i] = 1 + 2*x - 3*x*x + 0.5*x*x*x;
+    }
+
+    GradientDescent<SquareLoss> optimizer(&graph);
+    optimizer.setTrainingSet(inputValues.data(), expectedOutputs.data(), N_POINTS);
+    optimizer.setGradientClipping(500);
+    optimizer.setLearningRate(0.0001);
+    if(checkpointPath.size())
+        optimizer.setCheckpoint(checkpointPath, 1);
+
+    auto m = measure([&](unsigned n) { optimizer.runEpochs(n); });
+    if(checkpointPath.size())
+    {
+        optimizer.getCheckpointWriter()->flush();
+        std::remove(checkpointPath.c_str());
+    }
+    return m;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 1) TIMED_RUNS = std::max(1, atoi(argv[1]));
+    if(argc > 2) MIN_RUN_SECONDS = atof(argv[2]);
+
+    srand(0);
+
+    std::cout << "{\n";
+    std::cout << "  \"timed_runs\": " << TIMED_RUNS << ",\n";
+    std::cout << "  \"min_run_seconds\": " << MIN_RUN_SECONDS << ",\n";
+    ThreadPool pool;
+
+    std::cout << "  \"threads\": " << pool.size() << ",\n";
+    benchLayers(std::cout, pool);
+    std::cout << ",\n";
+    benchConv(std::cout);
+    std::cout << ",\n";
+    benchSegmented(std::cout);
+    std::cout << ",\n";
+    benchJacobian(std::cout);
+    std::cout << ",\n";
+    benchSparse(std::cout);
+    std::cout << ",\n  \"embedding_1k_rows_epochs_per_sec\": " << toJson(benchEmbedding(1000));
+    std::cout << ",\n  \"embedding_1m_rows_epochs_per_sec\": " << toJson(benchEmbedding(1000000));
+    std::cout << ",\n  \"xor_epochs_per_sec\": " << toJson(benchXor());
+    std::cout << ",\n  \"static_xor_epochs_per_sec\": " << toJson(benchStaticXor());
+    std::cout << ",\n  \"regression_epochs_per_sec\": " << toJson(benchRegression());
+    std::cout << ",\n  \"regression_checkpointed_epochs_per_sec\": "
+              << toJson(benchRegression("/tmp/toyml_bench_" + std::to_string(getpid()) + ".ck"));
+    std::cout << "\n}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef ALLREDUCE_H
+#define ALLREDUCE_H
+
+#include <string>
+
+// Point to point links between the processes (ranks) of a training job,
+// arranged in a ring. The collectives below only ever send to rank+1 and
+// receive from rank-1, so a network backend just has to provide those.
+struct Transport
+{
+	virtual ~Transport() {}
+
+	virtual unsigned rank() = 0;
+	virtual unsigned size() = 0;
+
+	// blocking; every send must be matched by a recv of the same length
+	virtual void sendNext(const double* data, unsigned n) = 0;
+	virtual void recvPrev(double* data, unsigned n) = 0;
+
+	// most data that can be sent before the receiver starts reading
+	virtual unsigned maxChunk() { return ~0u; }
+};
+
+// Ring channels in a POSIX shared memory segment, for processes on one host.
+// Call create() once (e.g. before forking the workers) and unlink() when
+// done; each rank then attaches with the constructor.
+struct SharedMemoryTransport : public Transport
+{
+	static void create(const std::string& name, unsigned size, unsigned capacity = 1 << 14);
+	static void unlink(const std::string& name);
+
+	SharedMemoryTransport(const std::string& name, unsigned rank);
+	~SharedMemoryTransport();
+
+	SharedMemoryTransport(const SharedMemoryTransport&) = delete;
+	SharedMemoryTransport& operator=(const SharedMemoryTransport&) = delete;
+
+	virtual unsigned rank() { return myRank; }
+	virtual unsigned size();
+
+	virtual void sendNext(const double* data, unsigned n);
+	virtual void recvPrev(double* data, unsigned n);
+
+	virtual unsigned maxChunk();
+
+private:
+	unsigned myRank;
+	void* base = nullptr;
+	unsigned long length = 0;
+};
+
+// Sums data element-wise across all ranks, leaving the same result on every
+// rank. Ring reduce-scatter followed by ring all-gather, with each segment
+// sent in chunks so consecutive steps overlap. Every element is reduced on
+// exactly one rank and copied to the others, so all ranks end up with
+// bit-identical values.
+void ringAllReduce(Transport& t, double* data, unsigned n, unsigned chunk = 1024);
+
+// Copies data from rank root to every other rank.
+void ringBroadcast(Transport& t, double* data, unsigned n, unsigned root = 0, unsigned chunk = 1024);
+
+#endif // ALLREDUCE_H
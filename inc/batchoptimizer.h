@@ -3,8 +3,22 @@
 
 #include "graph.h"
 #include "nodetypes.h"
+#include "profiler.h"
+#include "allreduce.h"
+#include "validator.h"
+#include "checkpoint.h"
+#include "leastsquares.h"
+#include "loss.h"
+#include "sparseinput.h"
+#include "embedding.h"
+#include "layers.h"
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
 
 typedef std::vector<double> floatset;
 
@@ -15,34 +29,434 @@ struct BatchOptimizer
 
 	void setGraph(Graph *g) {
 		graph = g;
-		nParams = graph->paramNodes.size();
-		paramDerivs.resize(nParams);
+		boundVersion = ~0ul;
+		bindParams();
+	}
+
+	// Trains a model that isn't a Graph, e.g. a StaticNet (see
+	// staticnet.h): anything with params and gradients arrays and an
+	// evaluate<LossT>(in, out, n, withGradients) that sums the loss, and
+	// the gradient if asked, over n samples. Validation and
+	// fitLeastSquares need a Graph.
+	template<typename ModelT>
+	void setModel(ModelT *model)
+	{
+		graph = nullptr;
+		paramValues = Span<double>(model->params.data(), model->params.size());
+		paramDerivs = Span<double>(model->gradients.data(), model->gradients.size());
+		nParams = paramValues.size();
+
+		evaluateModel = [model](const double* in, const double* out, unsigned n, bool gradients) {
+			return model->template evaluate<LossT>(in, out, n, gradients);
+		};
 	}
 
 	void setTrainingSet(double* in, double* out, unsigned n)
 	{
 		inputs = in;
+		sparseInputs = nullptr;
 		outputs = out;
 		setSize = n;
 	}
 
+	// Trains on input rows given by their nonzeros, e.g. one-hot or
+	// bag-of-features data, through a SparseContext (see sparseinput.h):
+	// a row costs time in its nonzeros, not in the number of inputs. The
+	// rows have to outlive the optimizer's use of them.
+	void setTrainingSet(const SparseRows* in, double* out)
+	{
+		inputs = nullptr;
+		sparseInputs = in;
+		outputs = out;
+		setSize = in->rows();
+	}
+
+	// Trains an EmbeddingLayer whose nodes are among the graph's inputs:
+	// indices[j] is the category of sample j, and the rows of the training
+	// set leave out the layer's columns, which are filled in from its
+	// table. Only the table rows an epoch touches get a gradient and are
+	// updated (by GradientDescent), so an epoch costs nothing in the size
+	// of the table. The indices have to outlive the optimizer's use of
+	// them. The tables aren't part of validation snapshots or checkpoints,
+	// so this throws with a validation set, a checkpoint, a data parallel
+	// job or sparse input rows, and they throw once there's an embedding.
+	void addEmbedding(EmbeddingLayer* layer, const unsigned* indices)
+	{
+		if(!graph || transport || sparseInputs || validator || checkpoints
+			|| !static_cast<OptimizerT*>(this)->updatesEmbeddings())
+		{
+			std::cout << "BatchOptimizer:\t embeddings need GradientDescent, without validation, checkpoints, "
+				"data parallelism or sparse inputs." << std::endl;
+			throw new std::exception();
+		}
+		if(convolutions.size())
+		{
+			std::cout << "BatchOptimizer:\t embeddings and convolutions can't be trained together." << std::endl;
+			throw new std::exception();
+		}
+
+		embeddings.push_back({ layer, indices });
+	}
+
+	// Trains a lowered Conv2DLayer (see layers.h) whose output nodes are
+	// among the graph's inputs: signals holds layer->inputSize() values per
+	// sample, and the rows of the training set leave out the layer's
+	// columns. Each evaluation runs the layer over the whole training set
+	// by im2col and matrix multiplies, and gets its kernels' gradient from
+	// the gradients reaching its outputs by the transposed multiply. The
+	// kernels are params of the graph (addParamNodes), so every optimizer,
+	// checkpoint and data parallel job covers them. The signals have to
+	// outlive the optimizer's use of them. Validation only sees the graph,
+	// so this throws with a validation set, and with embeddings or sparse
+	// input rows.
+	void addConvolution(Conv2DLayer* layer, const double* signals)
+	{
+		if(!graph || !layer->isLowered() || sparseInputs || validator || embeddings.size())
+		{
+			std::cout << "BatchOptimizer:\t convolutions need a graph and a lowered layer, without validation, "
+				"embeddings or sparse inputs." << std::endl;
+			throw new std::exception();
+		}
+
+		convolutions.push_back({ layer, signals });
+	}
+
+	// Makes this optimizer one replica of a data parallel job. Each rank
+	// trains on its own shard of the training set, and the gradients and
+	// loss are summed over all ranks every epoch, so every replica takes
+	// the same step. Every rank has to call this, since it starts all
+	// replicas from rank 0's params.
+	void setTransport(Transport* t)
+	{
+		if(embeddings.size())
+		{
+			std::cout << "BatchOptimizer:\t embeddings can't be trained data parallel." << std::endl;
+			throw new std::exception();
+		}
+
+		transport = t;
+		bindParams();
+
+		ringBroadcast(*transport, paramValues.data(), paramValues.size());
+	}
+
+	// Evaluates the mean loss on a held-out set every `every` epochs of
+	// runEpochs, on a snapshot of the params, in the background (see
+	// validator.h). The arrays have to outlive the optimizer's use of them.
+	// In a data parallel job, every rank needs the same validation set and
+	// `every` (see validate()).
+	void setValidationSet(double* in, double* out, unsigned n, unsigned every = 10)
+	{
+		if(!graph || embeddings.size() || convolutions.size())
+		{
+			std::cout << "BatchOptimizer:\t validation needs a graph, and doesn't cover embeddings or convolutions." << std::endl;
+			throw new std::exception();
+		}
+
+		if(!validator)
+			validator.reset(new Validator(*graph, &LossT::loss));
+
+		validator->setValidationSet(in, out, n);
+		validator->setMinImprovement(minImprovement);
+		validateEvery = every ? every : 1;
+	}
+
+	// Makes runEpochs stop once `patience` validations in a row haven't
+	// improved the best validation loss by more than minImprovement, and
+	// go back to the params of the best one. Needs a validation set;
+	// a patience of 0 turns it off.
+	void setEarlyStopping(unsigned patience, double minImprovement = 0)
+	{
+		this->patience = patience;
+		this->minImprovement = minImprovement;
+		if(validator)
+			validator->setMinImprovement(minImprovement);
+	}
+
+	bool stoppedEarly() { return stopped; }
+	Validator* getValidator() { return validator.get(); }
+
+	// sets the params to the best validated snapshot, if there is one
+	void restoreBest()
+	{
+		if(!validator)
+			return;
+
+		validator->wait();
+		auto best = validator->getBestParams();
+		bindParams();
+		if(best.size() == paramValues.size())
+			std::copy(best.begin(), best.end(), paramValues.begin());
+	}
+
+	// Makes runEpochs save the training state to path every `every` epochs
+	// (see checkpoint.h). Training only stops for copying the state; the
+	// file is written by a thread of its own.
+	void setCheckpoint(const std::string& path, unsigned every = 100)
+	{
+		if(embeddings.size())
+		{
+			std::cout << "BatchOptimizer:\t checkpoints don't cover embeddings." << std::endl;
+			throw new std::exception();
+		}
+
+		checkpoints.reset(new CheckpointWriter(path));
+		checkpointEvery = every ? every : 1;
+	}
+
+	// copies the state for the checkpoint thread, and returns straight away
+	void checkpoint()
+	{
+		PROFILE_PHASE("BatchOptimizer::checkpoint");
+
+		if(!checkpoints)
+		{
+			std::cout << "BatchOptimizer:\t checkpoint() needs setCheckpoint first." << std::endl;
+			throw new std::exception();
+		}
+
+		auto& s = checkpoints->begin();
+		s.epochs = epochsRuns;
+		s.learningRate = learningRate;
+		s.learningRateDecay = learningRateDecay;
+		s.decayFrequency = decayFrequency;
+		s.lastError = lastOverallError;
+
+		bindParams();
+		s.params.assign(paramValues.begin(), paramValues.end());
+		s.gradients.assign(paramDerivs.begin(), paramDerivs.end());
+		static_cast<OptimizerT*>(this)->getOptimizerState(s.optimizerState);
+
+		checkpoints->commit();
+	}
+
+	CheckpointWriter* getCheckpointWriter() { return checkpoints.get(); }
+
+	// Restores the training state saved at path, so that training carries
+	// on exactly as if it hadn't stopped. False if there is no checkpoint
+	// there; throws if it was saved for a model with different params.
+	bool resume(const std::string& path)
+	{
+		if(embeddings.size())
+		{
+			std::cout << "BatchOptimizer:\t checkpoints don't cover embeddings." << std::endl;
+			throw new std::exception();
+		}
+
+		TrainingState s;
+		if(!loadTrainingState(s, path))
+			return false;
+
+		bindParams();
+		if(s.params.size() != nParams)
+		{
+			std::cout << "BatchOptimizer:\t " << path << " has " << s.params.size()
+				<< " params, the graph has " << nParams << "." << std::endl;
+			throw new std::exception();
+		}
+
+		epochsRuns = s.epochs;
+		learningRate = s.learningRate;
+		learningRateDecay = s.learningRateDecay;
+		decayFrequency = s.decayFrequency;
+		lastOverallError = s.lastError;
+
+		std::copy(s.params.begin(), s.params.end(), paramValues.begin());
+		std::copy(s.gradients.begin(), s.gradients.end(), paramDerivs.begin());
+		static_cast<OptimizerT*>(this)->setOptimizerState(s.optimizerState);
+
+		return true;
+	}
+
+	// state of the optimizer itself to checkpoint, for optimizers that have
+	// any; they hide these
+	void getOptimizerState(std::vector<double>& state) { state.clear(); }
+	void setOptimizerState(const std::vector<double>& state) {}
+
+	// For optimizers that evaluate the training set themselves (e.g. in a
+	// line search), and so may already hold the gradient at the current
+	// params when the next epoch starts; runEpoch then doesn't compute it
+	// again. They hide these too.
+	bool gradientIsCurrent() { return false; }
+	// makes runEpochs stop
+	bool converged() { return false; }
+	// whether updateParams also steps the touched rows of the embeddings
+	bool updatesEmbeddings() { return false; }
+
+	unsigned getEpochs() { return epochsRuns; }
+	// the summed training loss of the last epoch, over all ranks
+	double getLastError() { return lastOverallError; }
+
+	// For a model that is linear in its params (see isLinearInParams),
+	// trained on SquareLoss: sets the params to the minimum of the loss in
+	// one pass over the training set, by solving the normal equations,
+	// plus ridge*|w|^2 if ridge > 0. Counts as one epoch. Returns false,
+	// leaving the params alone, if the model or loss doesn't qualify or
+	// the system is singular; runEpochs still works then.
+	bool fitLeastSquares(double ridge = 0)
+	{
+		PROFILE_PHASE("BatchOptimizer::fitLeastSquares");
+
+		if(!graph || !inputs || embeddings.size() || convolutions.size() || !std::is_same<LossT, SquareLoss>::value || !isLinearInParams(*graph))
+			return false;
+
+		bindParams();
+		NormalEquations eq(nParams);
+		eq.accumulate(*graph, inputs, outputs, setSize);
+
+		// each rank holds the sums over its own shard
+		if(transport)
+		{
+			ringAllReduce(*transport, eq.AtA.data(), eq.AtA.size());
+			ringAllReduce(*transport, eq.Atb.data(), eq.Atb.size());
+		}
+
+		std::vector<double> w(nParams);
+		if(!eq.solve(ridge, w.data()))
+			return false;
+
+		std::copy(w.begin(), w.end(), paramValues.begin());
+		epochsRuns++;
+		return true;
+	}
+
 	void runEpochs(unsigned iterations) {
+        stopped = false;
         for(int i = 0; i < iterations; ++i) {
             if((epochsRuns + 1) % decayFrequency == 0) {
                 setLearningRate(learningRate * learningRateDecay);
             }
             runEpoch();
+
+            if(checkpoints && epochsRuns % checkpointEvery == 0)
+                checkpoint();
+
+            if(validator && epochsRuns % validateEvery == 0 && validate()) {
+                stopped = true;
+                restoreBest();
+                break;
+            }
+
+            if(static_cast<OptimizerT*>(this)->converged())
+                break;
         }
     }
 
-	void updateParamsInterface() { static_cast<OptimizerT*>(this)->updateParams(); }
+	void updateParamsInterface()
+	{
+		PROFILE_PHASE("BatchOptimizer::updateParams");
+		static_cast<OptimizerT*>(this)->updateParams();
+	}
 
 	void runEpoch()
 	{
+		PROFILE_PHASE("BatchOptimizer::runEpoch");
+
+		bindParams();
+		if(!static_cast<OptimizerT*>(this)->gradientIsCurrent())
+			evaluate(true);
+
+		// gradient clipping
+		if(maxGradient > 0)
+		{
+			for(unsigned k = 0; k < nParams; ++k)
+			{	
+				if(paramDerivs[k] > maxGradient) paramDerivs[k] = maxGradient;
+				else if(paramDerivs[k] < -maxGradient) paramDerivs[k] = -maxGradient;
+			}
+
+			for(auto& e : embeddings)
+			{
+				for(auto& g : e.layer->getGradients())
+				{
+					if(g > maxGradient) g = maxGradient;
+					else if(g < -maxGradient) g = -maxGradient;
+				}
+			}
+		}
+
+		// update params
+		updateParamsInterface();
+
+        epochsRuns++;
+	}
+
+	void setGradientClipping(double maxGrad=-1) { maxGradient = maxGrad; }
+
+	void setLearningRate(double r) { learningRate = r; }
+	double getLearningRate() { return learningRate; }
+
+	void setLearningRateDecay(double r) { learningRateDecay = r; }
+	double getLearningRateDecay() { return learningRateDecay; }
+
+	void setDecayFrequency(unsigned x) { decayFrequency = x; }
+	double getDecayFrequency() { return decayFrequency; }
+
+
+protected:
+	// Sums the loss over the training set, on all ranks, at the current
+	// params into lastOverallError, and returns the mean. With gradients,
+	// paramDerivs gets the mean gradient; without, it's left alone and
+	// there is no backprop.
+	double evaluate(bool gradients)
+	{
+		PROFILE_PHASE("BatchOptimizer::evaluate");
+
+		if(gradients)
+		{
+			std::fill(paramDerivs.begin(), paramDerivs.end(), 0.0);
+			for(auto& e : embeddings)
+				e.layer->clearGradients();
+		}
+
+		double overallError = 0;
+		if(graph)
+			overallError = evaluateGraph(gradients);
+		else
+			overallError = evaluateModel(inputs, outputs, setSize, gradients);
+
+		double count = setSize;
+		if(transport)
+			allReduce(overallError, count, gradients);
+
+		if(gradients)
+		{
+			for(unsigned k = 0; k < nParams; ++k)
+				paramDerivs[k] /= count;
+
+			for(auto& e : embeddings)
+			{
+				for(auto& g : e.layer->getGradients())
+					g /= count;
+			}
+		}
+
+		lastOverallError = overallError;
+		lastMeanError = overallError / count;
+		return lastMeanError;
+	}
+
+	// the summed loss, and gradient into paramDerivs, of this rank's shard
+	double evaluateGraph(bool gradients)
+	{
+		if(sparseInputs)
+			return evaluateSparse(gradients);
+
 		unsigned inW = graph->inputNodes.size();
 		unsigned outW = graph->outputNodes.size();
+		bool mapped = embeddings.size() || convolutions.size();
+		if(mapped)
+			inW = mapInputColumns();
 
-		memset(paramDerivs.data(), 0, sizeof(double)*nParams);
+		// the convolutions' outputs for the whole shard at once
+		for(auto& c : convolutions)
+		{
+			unsigned n = c.columns.size();
+			c.out.resize(setSize * n);
+			c.layer->forward(c.signals, setSize, c.out.data());
+			if(gradients)
+				c.dOut.resize(setSize * n);
+		}
 
 		double overallError = 0;
 
@@ -52,64 +466,323 @@ struct BatchOptimizer
 		// compute summed derivative
 		for(unsigned j = 0; j < setSize; ++j)
 		{
-			auto outputs = graph->forwardPass(inPtr);
+			const double* row = inPtr;
+			if(mapped)
+				row = mappedRow(j, inPtr);
+
+			auto outputs = graph->forwardPass(row);
 			overallError += LossT::loss(outputs.data(), outPtr, outW);
-			auto baseDeriv = LossT::derivative(outputs.data(), outPtr, outW);
-			graph->backProp(baseDeriv);
 
-			for(unsigned k = 0; k < nParams; ++k)
-				paramDerivs[k] += graph->paramNodes[k]->getDerivative(0) / (double)setSize;
+			if(gradients)
+			{
+				auto baseDeriv = LossT::derivative(outputs.data(), outPtr, outW);
+				graph->backProp(baseDeriv);
+
+				graph->parameters.accumulateGradients();
+				for(auto& e : embeddings)
+					e.layer->accumulateGradients(e.indices[j]);
+
+				for(auto& c : convolutions)
+				{
+					unsigned n = c.columns.size();
+					for(unsigned o = 0; o < n; ++o)
+						c.dOut[j*n + o] = graph->inputNodes[c.columns[o]]->getDerivative(0);
+				}
+			}
 
 			inPtr += inW;
 			outPtr += outW;
 
 		}
 
-		lastOverallError = overallError;
+		// the kernels' gradients, by the transposed multiply
+		for(auto& c : convolutions)
+		{
+			if(!gradients)
+				break;
 
-		// gradient clipping
-		if(maxGradient > 0)
+			c.grads.assign(c.params.size(), 0);
+			c.layer->backward(c.signals, c.dOut.data(), setSize, c.grads.data());
+			for(unsigned k = 0; k < c.params.size(); ++k)
+				paramDerivs[c.params[k]] += c.grads[k];
+		}
+
+		return overallError;
+	}
+
+	// Finds the embeddings' and convolutions' nodes among the graph's
+	// inputs, and the convolutions' weights among its params. Returns the
+	// number of the other inputs, which the training set holds.
+	unsigned mapInputColumns()
+	{
+		auto& in = graph->inputNodes;
+		std::unordered_map<InputNode*, unsigned> column;
+		for(unsigned c = 0; c < in.size(); ++c)
+			column[in[c]] = c;
+
+		std::vector<char> filled(in.size(), 0);
+		for(auto& e : embeddings)
 		{
-			for(unsigned k = 0; k < nParams; ++k)
-			{	
-				if(paramDerivs[k] > maxGradient) paramDerivs[k] = maxGradient;
-				else if(paramDerivs[k] < -maxGradient) paramDerivs[k] = -maxGradient;
+			e.columns.clear();
+			for(auto n : e.layer->getInputNodes())
+			{
+				auto it = column.find(n);
+				if(it == column.end() || filled[it->second])
+				{
+					std::cout << "BatchOptimizer:\t an embedding's nodes aren't inputs of the graph." << std::endl;
+					throw new std::exception();
+				}
+
+				filled[it->second] = 1;
+				e.columns.push_back(it->second);
 			}
 		}
 
-		// update params
-		updateParamsInterface();
+		std::unordered_map<InputNode*, unsigned> param;
+		for(unsigned k = 0; k < graph->paramNodes.size(); ++k)
+			param[graph->paramNodes[k]] = k;
 
-        epochsRuns++;
+		for(auto& c : convolutions)
+		{
+			c.columns.clear();
+			for(auto n : c.layer->getInputNodes())
+			{
+				auto it = column.find(n);
+				if(it == column.end() || filled[it->second])
+				{
+					std::cout << "BatchOptimizer:\t a convolution's outputs aren't inputs of the graph." << std::endl;
+					throw new std::exception();
+				}
+
+				filled[it->second] = 1;
+				c.columns.push_back(it->second);
+			}
+
+			c.params.clear();
+			for(auto n : c.layer->getWeightNodes())
+			{
+				auto it = param.find(n);
+				if(it == param.end())
+				{
+					std::cout << "BatchOptimizer:\t a convolution's weights aren't params of the graph." << std::endl;
+					throw new std::exception();
+				}
+				c.params.push_back(it->second);
+			}
+		}
+
+		denseColumns.clear();
+		for(unsigned c = 0; c < in.size(); ++c)
+		{
+			if(!filled[c])
+				denseColumns.push_back(c);
+		}
+
+		inputRow.resize(in.size());
+		return denseColumns.size();
 	}
 
-	void setGradientClipping(double maxGrad=-1) { maxGradient = maxGrad; }
+	// the graph's input row for sample j, given its other inputs
+	const double* mappedRow(unsigned j, const double* dense)
+	{
+		for(unsigned c = 0; c < denseColumns.size(); ++c)
+			inputRow[denseColumns[c]] = dense[c];
 
-	void setLearningRate(double r) { learningRate = r; }
-	double getLearningRate() { return learningRate; }
+		for(auto& e : embeddings)
+		{
+			const double* w = e.layer->lookup(e.indices[j]);
+			for(unsigned d = 0; d < e.columns.size(); ++d)
+				inputRow[e.columns[d]] = w[d];
+		}
 
-	void setLearningRateDecay(double r) { learningRateDecay = r; }
-	double getLearningRateDecay() { return learningRateDecay; }
+		for(auto& c : convolutions)
+		{
+			const double* y = &c.out[j * c.columns.size()];
+			for(unsigned o = 0; o < c.columns.size(); ++o)
+				inputRow[c.columns[o]] = y[o];
+		}
 
-	void setDecayFrequency(unsigned x) { decayFrequency = x; }
-	double getDecayFrequency() { return decayFrequency; }
+		return inputRow.data();
+	}
+
+	double evaluateSparse(bool gradients)
+	{
+		if(embeddings.size() || convolutions.size())
+		{
+			std::cout << "BatchOptimizer:\t embeddings and convolutions can't be trained from sparse inputs." << std::endl;
+			throw new std::exception();
+		}
 
+		// a new context when the graph's structure changed
+		if(!sparseContext || &sparseContext->getSchedule() != &graph->schedule())
+			sparseContext.reset(new SparseContext(*graph));
 
-protected:
-    Graph *graph;
+		unsigned outW = graph->outputNodes.size();
+		double overallError = 0;
+		double *outPtr = outputs;
+
+		for(unsigned j = 0; j < setSize; ++j)
+		{
+			auto& y = graph->forwardPass(*sparseContext, sparseInputs->row(j));
+			overallError += LossT::loss(y.data(), outPtr, outW);
+
+			if(gradients)
+			{
+				auto baseDeriv = LossT::derivative(y.data(), outPtr, outW);
+				graph->backProp(*sparseContext, baseDeriv);
+				sparseContext->accumulateGradients(paramDerivs.data());
+			}
+
+			outPtr += outW;
+		}
+
+		return overallError;
+	}
+
+	// Submits a snapshot to the validator; true if it's time to stop.
+	//
+	// In a data parallel job the ranks vote, so that no replica stops
+	// without the others. They vote on the previous snapshot, which has had
+	// `every` epochs to be evaluated, so training doesn't wait on the
+	// current one, and the stop comes one validation later than it would
+	// on one process. The replicas have to validate on the same epochs
+	// (checked with every epoch's all-reduce, see allReduce), on the same
+	// validation set, and so get the same losses; anything else throws on
+	// every rank.
+	bool validate()
+	{
+		PROFILE_PHASE("BatchOptimizer::validate");
+
+		if(!transport)
+		{
+			validator->submit(epochsRuns, paramValues.data());
+			return patience && validator->sinceBest() >= patience;
+		}
+
+		validator->wait();
+		double loss = validator->getLastLoss();
+		bool stop = patience && validator->sinceBest() >= patience;
+
+		double votes[3] = { loss, loss*loss, stop ? 1.0 : 0.0 };
+		ringAllReduce(*transport, votes, 3);
+
+		double ranks = transport->size();
+		double mean = votes[0] / ranks;
+		double variance = votes[1] / ranks - mean*mean;
+		if((votes[2] != 0 && votes[2] != ranks) || variance > 1e-12 * std::max(1.0, mean*mean))
+		{
+			std::cout << "BatchOptimizer:\t validation has to be set up the same on every rank." << std::endl;
+			throw new std::exception();
+		}
+
+		if(votes[2] > 0)
+			return true;
+
+		validator->submit(epochsRuns, paramValues.data());
+		return false;
+	}
+
+	// Sums the gradients, error and sample count over all ranks. Also
+	// counts the ranks that validate after this epoch: validate() only
+	// runs on validation epochs, and its collective would hang if only
+	// some ranks came, so a mismatch throws here on every rank instead.
+	void allReduce(double& error, double& count, bool gradients = true)
+	{
+		unsigned n = gradients ? nParams : 0;
+		reduceBuffer.resize(n + 3);
+		std::copy(paramDerivs.begin(), paramDerivs.begin() + n, reduceBuffer.begin());
+		reduceBuffer[n] = error;
+		reduceBuffer[n + 1] = count;
+		reduceBuffer[n + 2] = validator && (epochsRuns + 1) % validateEvery == 0;
+
+		ringAllReduce(*transport, reduceBuffer.data(), reduceBuffer.size());
+
+		double validating = reduceBuffer[n + 2];
+		if(validating != 0 && validating != transport->size())
+		{
+			std::cout << "BatchOptimizer:\t validation has to be set up the same on every rank." << std::endl;
+			throw new std::exception();
+		}
+
+		std::copy(reduceBuffer.begin(), reduceBuffer.begin() + n, paramDerivs.begin());
+		error = reduceBuffer[n];
+		count = reduceBuffer[n + 1];
+	}
+
+	// Picks up params registered since the last epoch. Only looks at the
+	// param nodes when their number or the store's binding changed, so
+	// nodes replaced in place in graph->paramNodes need bindParameters().
+	void bindParams()
+	{
+		if(!graph)
+			return;
+
+		auto& store = graph->parameters;
+		if(store.getVersion() == boundVersion && graph->paramNodes.size() == nParams)
+			return;
+
+		graph->bindParameters();
+		paramValues = store.values();
+		paramDerivs = store.gradients();
+		nParams = paramDerivs.size();
+		boundVersion = store.getVersion();
+	}
+
+    Graph *graph = nullptr;
     double* inputs;
     double* outputs;
     unsigned setSize;
 
+    const SparseRows* sparseInputs = nullptr;
+    std::unique_ptr<SparseContext> sparseContext;
+
+    struct Embedding
+    {
+        EmbeddingLayer* layer;
+        const unsigned* indices;
+        std::vector<unsigned> columns;  // of its nodes among the graph's inputs
+    };
+    std::vector<Embedding> embeddings;
+
+    struct Convolution
+    {
+        Conv2DLayer* layer;
+        const double* signals;
+        std::vector<unsigned> columns;  // of its outputs among the graph's inputs
+        std::vector<unsigned> params;   // of its weights among the graph's params
+        std::vector<double> out, dOut, grads;
+    };
+    std::vector<Convolution> convolutions;
+    std::vector<unsigned> denseColumns;
+    std::vector<double> inputRow;
+
     double lastOverallError = 0;
+    double lastMeanError = 0;
     double learningRate = 0.2;
     double learningRateDecay = 0.5;
     unsigned decayFrequency = 100;
     unsigned epochsRuns = 0;
     double maxGradient = -1;
 
-    std::vector<double> paramDerivs;
-    unsigned nParams;
+    // views of graph->parameters, or of the model's arrays
+    Span<double> paramValues;
+    Span<double> paramDerivs;
+    unsigned nParams = 0;
+    unsigned long boundVersion = ~0ul;  // of graph->parameters, as of bindParams
+
+    std::function<double(const double*, const double*, unsigned, bool)> evaluateModel;
+
+    Transport* transport = nullptr;
+    std::vector<double> reduceBuffer;
+
+    std::unique_ptr<Validator> validator;
+    unsigned validateEvery = 10;
+    unsigned patience = 0;
+    double minImprovement = 0;
+
+    std::unique_ptr<CheckpointWriter> checkpoints;
+    unsigned checkpointEvery = 100;
+    bool stopped = false;
 };
 
 
@@ -120,16 +793,38 @@ struct GradientDescent : public BatchOptimizer<GradientDescent, LossT>
 		this->setGraph(g);
 	}
 
+	template<typename ModelT>
+	GradientDescent(ModelT *model) {
+		this->setModel(model);
+	}
+
+	bool updatesEmbeddings() { return true; }
+
 	void updateParams()
 	{
-		unsigned nParams = this->graph->paramNodes.size();
+		auto w = this->paramValues;
+		auto dw = this->paramDerivs;
+		unsigned nParams = this->nParams;
+		double rate = this->learningRate;
+
 		for(unsigned k = 0; k < nParams; ++k)
+			w[k] -= rate * dw[k];
+
+		// only the table rows the epoch touched
+		for(auto& e : this->embeddings)
 		{
-			auto pNode = this->graph->paramNodes[k];
-			
-			double w = pNode->getInput();
-			pNode->setInput(w - this->learningRate*this->paramDerivs[k]);
-		}		
+			EmbeddingLayer& layer = *e.layer;
+			unsigned dim = layer.dimension();
+			auto& rows = layer.touchedRows();
+
+			for(unsigned i = 0; i < rows.size(); ++i)
+			{
+				double* row = layer.row(rows[i]);
+				const double* g = layer.rowGradient(i);
+				for(unsigned d = 0; d < dim; ++d)
+					row[d] -= rate * g[d];
+			}
+		}
 	}
 };
 
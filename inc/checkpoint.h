@@ -0,0 +1,73 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Everything needed to pick a BatchOptimizer's training up where it left off.
+struct TrainingState
+{
+	unsigned epochs = 0;
+	double learningRate = 0;
+	double learningRateDecay = 0;
+	unsigned decayFrequency = 0;
+	double lastError = 0;
+
+	std::vector<double> params;
+	std::vector<double> gradients;       // from the last epoch
+	std::vector<double> optimizerState;  // e.g. momentum, if the optimizer has any
+};
+
+// Writes the state to path through a temporary file that is then renamed
+// over it, so path always holds a complete checkpoint, old or new.
+void saveTrainingState(const TrainingState& state, const std::string& path);
+// false if there is no file at path; throws if it isn't a checkpoint
+bool loadTrainingState(TrainingState& state, const std::string& path);
+
+// Writes checkpoints on a thread of its own, so training only pays for
+// copying the state. There are two buffers: begin() hands out the one the
+// writer isn't busy with, and commit() queues it. A checkpoint that is
+// still queued when the next one is committed is replaced by it.
+struct CheckpointWriter
+{
+	explicit CheckpointWriter(const std::string& path);
+	~CheckpointWriter();  // writes out the last checkpoint first
+
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+	const std::string& getPath() const { return path; }
+
+	// fill in the buffer, then commit it
+	TrainingState& begin();
+	void commit();
+
+	// until the last committed checkpoint is on disk
+	void flush();
+
+	unsigned long getWritten();
+	unsigned long getSkipped();
+
+private:
+	void loop();
+
+	std::string path;
+
+	TrainingState buffers[2];
+	int filling = -1;   // held by begin() until commit()
+	int queued = -1;
+	int writing = -1;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	bool stopping = false;
+	unsigned long written = 0;
+	unsigned long skipped = 0;
+
+	std::thread writer;
+};
+
+#endif // CHECKPOINT_H
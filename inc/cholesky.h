@@ -0,0 +1,14 @@
+#ifndef CHOLESKY_H
+#define CHOLESKY_H
+
+// Cholesky factorization A = L L^T of a symmetric positive definite n x n
+// row-major matrix, in place: the lower triangle of A becomes L, and what
+// is left above the diagonal is scratch. Only the lower triangle of A is
+// read. Blocked, with the trailing updates done by gemm (see gemm.h).
+// Returns false if A isn't positive definite.
+bool cholesky(unsigned n, double* A, unsigned lda);
+
+// Solves L L^T x = b in place, given the factor from cholesky().
+void choleskySolve(unsigned n, const double* L, unsigned lda, double* b);
+
+#endif // CHOLESKY_H
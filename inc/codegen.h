@@ -0,0 +1,29 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "graph.h"
+
+#include <ostream>
+#include <string>
+
+// Writes a standalone C++ source file evaluating the graph's forward pass
+// with the current param values baked in:
+//
+//   void <function>(const double* in, double* out);
+//
+// where in and out follow the order of inputNodes and outputNodes. The
+// file only depends on <cmath>.
+//
+// VectorMultNodes in the same level that share their inputs and whose
+// weights are params (i.e. the rows of a LinearLayer) become one
+// matrix-vector loop over a constexpr weight array, laid out so that the
+// inner loop vectorizes, and an activation applied to every row of such a
+// layer becomes an element-wise loop. Everything else is straight-line
+// code. Rows are summed in the same order as VectorMultNode::compute, so
+// the results match forwardPass.
+//
+// Throws if the graph contains a node that can't be exported (see
+// Node::expression).
+void exportCpp(Graph& graph, std::ostream& out, const std::string& function = "predict");
+
+#endif // CODEGEN_H
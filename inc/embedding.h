@@ -0,0 +1,72 @@
+#ifndef EMBEDDING_H
+#define EMBEDDING_H
+
+#include "graph.h"
+#include "nodeset.h"
+#include "nodetypes.h"
+#include "parameterstore.h"
+
+#include <vector>
+
+// A table of numRows x dim weights for a categorical feature: category r
+// is represented by row r. This replaces a one-hot input into a
+// LinearLayer, which needs a weight node per category and output, and a
+// dense gradient that size every step.
+//
+// The table is one contiguous array, outside the graph's params. The
+// layer's nodes are InputNodes, to be added to the graph's inputs, which
+// are given the looked up row. After a backProp their derivatives are the
+// gradient of that row, and accumulateGradients adds it to a row-sparse
+// gradient that only holds the rows touched since clearGradients. Nothing
+// per step costs time in numRows.
+//
+// BatchOptimizer::addEmbedding trains one (see batchoptimizer.h).
+struct EmbeddingLayer
+{
+	EmbeddingLayer(unsigned numRows, unsigned dim);
+
+	// the dim nodes taking the looked up row
+	std::vector<InputNode*> getInputNodes() { return nodes.getInputs(); }
+	std::vector<Node*> getOutputNodes() { return nodes.getNodes(); }
+
+	unsigned numRows() const { return rows; }
+	unsigned dimension() const { return dim; }
+
+	// uniform in +-1/sqrt(dim)
+	void randomizeWeights();
+
+	// row r of the table; throws if there is no such row
+	const double* lookup(unsigned r) const;
+	double* row(unsigned r) { return table.data() + (size_t)r*dim; }
+
+	// Adds scale * the derivatives of the layer's nodes, after a backProp
+	// of a sample that looked up row r, to the gradient of row r.
+	void accumulateGradients(unsigned r, double scale=1);
+	// the same, for dLoss/d row given as dim values
+	void accumulateGradients(unsigned r, const double* dRow, double scale=1);
+
+	// The rows with a gradient, in the order they were first touched, and
+	// their gradients, dim values apiece in the same order.
+	const std::vector<unsigned>& touchedRows() const { return touched; }
+	Span<double> getGradients() { return Span<double>(gradients.data(), gradients.size()); }
+	double* rowGradient(unsigned i) { return gradients.data() + (size_t)i*dim; }
+
+	// forgets the touched rows, in time proportional to their number
+	void clearGradients();
+
+private:
+	// the gradient of row r, zero if it wasn't touched yet
+	double* touch(unsigned r);
+
+	unsigned rows, dim;
+	std::vector<double> table;
+	NodeSet<InputNode> nodes;
+
+	std::vector<unsigned> touched;
+	std::vector<double> gradients;
+	// per table row: its index in touched, or NOT_TOUCHED
+	std::vector<unsigned> slot;
+	static constexpr unsigned NOT_TOUCHED = ~0u;
+};
+
+#endif // EMBEDDING_H
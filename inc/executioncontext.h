@@ -0,0 +1,75 @@
+#ifndef EXECUTION_CONTEXT_H
+#define EXECUTION_CONTEXT_H
+
+#include "graph.h"
+
+#include <memory>
+#include <vector>
+
+// The per-evaluation state of a graph: node outputs, partial derivatives
+// and backprop adjoints, indexed by schedule position. The graph itself
+// (structure and params) is only read, so one model can serve any number
+// of threads at once, each with its own context.
+//
+// A context is tied to the graph's schedule when it is created; make a new
+// one after changing the graph's structure.
+struct ExecutionContext
+{
+	explicit ExecutionContext(Graph& g);
+
+	// evaluate with these param values instead of the graph's,
+	// e.g. a snapshot; nullptr goes back to the graph's
+	void setParams(const double* values) { params = values; }
+	const double* getParams() const { return params; }
+
+	const std::vector<double>& getOutputs() const { return outputs; }
+	double getOutput(unsigned i) const { return outputs.at(i); }
+
+	// output of any node evaluated by the graph
+	double getValue(const Node* n) const;
+
+	// derivatives from the last backProp
+	double getGradient(unsigned param) const;
+	double getInputGradient(unsigned input) const;
+	// the same for one of the seeds of the last multi-seed backProp
+	double getGradient(unsigned param, unsigned seed) const;
+	double getInputGradient(unsigned input, unsigned seed) const;
+	unsigned numSeeds() const { return seeds; }
+	// grads[k] += scale * d/d param k, for every param
+	void accumulateGradients(double* grads, double scale=1) const;
+
+	const Schedule& getSchedule() const { return *schedule; }
+
+	// bytes of activation state held by the context
+	size_t activationBytes() const;
+
+private:
+	friend struct Graph;
+
+	std::shared_ptr<const Schedule> schedule;
+	const double* params = nullptr;
+
+	std::vector<double> values;    // per node
+	std::vector<double> partials;  // per argument edge, see Schedule::argOffsets
+	std::vector<double> adjoints;  // per node
+	std::vector<double> outputs;   // per graph output
+	std::vector<double> args;      // gather buffer for Node::compute
+
+	// per node, the adjoints of each seed of a multi-seed backProp, in
+	// rows of seedStride (seeds rounded up to whole SIMD blocks)
+	std::vector<double> seedAdjoints;
+	unsigned seeds = 0, seedStride = 0;
+};
+
+// The derivatives of every output of a graph with respect to every input
+// and param, in row-major matrices with a row per output.
+struct Jacobian
+{
+	double input(unsigned output, unsigned i) const { return dInputs[output*numInputs + i]; }
+	double param(unsigned output, unsigned k) const { return dParams[output*numParams + k]; }
+
+	unsigned numOutputs = 0, numInputs = 0, numParams = 0;
+	std::vector<double> dInputs, dParams;
+};
+
+#endif // EXECUTION_CONTEXT_H
@@ -0,0 +1,84 @@
+#ifndef EXECUTORS_H
+#define EXECUTORS_H
+
+#include "graph.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Runs the graph one topological level at a time. The nodes of a level are
+// independent of each other, so each level is split across the thread pool,
+// with a barrier before the next level starts. Backprop walks the levels in
+// reverse. Levels with fewer than minParallelLevel nodes run serially on the
+// calling thread, since handing them to the pool costs more than it saves.
+struct WavefrontExecutor : public Executor
+{
+	WavefrontExecutor(ThreadPool& pool, unsigned minParallelLevel = 64, unsigned grain = 16);
+
+	virtual void forward(Graph& g);
+	virtual void backward(Graph& g, const double *baseDeriv, unsigned n);
+
+	void setMinParallelLevel(unsigned n) { minParallelLevel = n; }
+	unsigned getMinParallelLevel() { return minParallelLevel; }
+
+private:
+	// calls visit(i) for every schedule index i in level l
+	template<typename VisitT>
+	void runLevel(const Schedule& s, unsigned l, VisitT visit);
+
+	ThreadPool& pool;
+	unsigned minParallelLevel;
+	unsigned grain;
+};
+
+// Fixed capacity Chase-Lev deque of schedule indices. The owning thread
+// pushes and pops at the bottom, other threads steal from the top.
+struct WorkStealingDeque
+{
+	explicit WorkStealingDeque(unsigned capacity);
+
+	void clear() { top = 0; bottom = 0; }
+
+	void push(unsigned x);
+	bool pop(unsigned& x);
+	bool steal(unsigned& x);
+
+private:
+	std::atomic<long> top;
+	std::atomic<long> bottom;
+	std::vector<std::atomic<unsigned>> items;
+	unsigned long mask;
+};
+
+// Runs each node as soon as its last parent finishes (or, for backprop, its
+// last child), instead of waiting for the whole level. Every node has a count
+// of unfinished parents; whichever thread finishes the last parent pushes the
+// node onto its own deque, and idle threads steal from the others.
+// This keeps all threads busy on irregular graphs where levels are uneven.
+struct WorkStealingExecutor : public Executor
+{
+	explicit WorkStealingExecutor(ThreadPool& pool);
+
+	virtual void forward(Graph& g);
+	virtual void backward(Graph& g, const double *baseDeriv, unsigned n);
+
+private:
+	void prepare(const Schedule& s);
+
+	// runs visit(i) on `total` nodes, starting from the ready ones; the CSR
+	// offsets/indices list the nodes waiting on each node
+	template<typename VisitT>
+	void run(const std::vector<unsigned>& ready, unsigned total,
+		const std::vector<unsigned>& offsets, const std::vector<unsigned>& indices,
+		VisitT visit);
+
+	ThreadPool& pool;
+	std::vector<std::unique_ptr<WorkStealingDeque>> deques;
+	std::unique_ptr<std::atomic<int>[]> pending;
+	unsigned capacity = 0;
+	std::vector<unsigned> ready;
+};
+
+#endif // EXECUTORS_H
@@ -0,0 +1,19 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+// Dense row-major matrix multiply:
+//
+//   C = beta*C + op(A) * op(B)
+//
+// with op(A) M x K, op(B) K x N and C M x N; op transposes when the flag
+// is set, so A is stored K x M when transA and B is stored N x K when
+// transB. lda, ldb and ldc are the row strides as stored.
+//
+// Blocked over K and N so a panel of op(B) stays in cache, with the
+// innermost loop running along a contiguous row so it vectorizes. With
+// transB each panel is first packed into rows of op(B).
+void gemm(bool transA, bool transB, unsigned M, unsigned N, unsigned K,
+	const double* A, unsigned lda, const double* B, unsigned ldb,
+	double beta, double* C, unsigned ldc);
+
+#endif // GEMM_H
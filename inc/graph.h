@@ -1,12 +1,33 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include "schedule.h"
+#include "parameterstore.h"
+#include "profiler.h"
+
+#include <atomic>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <string>
 
 struct Node
 {
-	virtual void forward() = 0;
+	// nodes of any type may be deleted through a Node pointer
+	virtual ~Node() {}
+
+	// Evaluates the node without touching any node's state: in[i] is the
+	// output of parents[i], and partials[i] is set to d output / d in[i].
+	// This is what lets many ExecutionContexts evaluate a graph at once.
+	virtual double compute(const double* in, double* partials) const = 0;
+
+	// computes output and partialDerivatives from the parents' outputs
+	virtual void forward();
+
+	// The same as compute, as a C++ expression of the parents' values
+	// (args[i] for parents[i]), for exporting graphs as code (see
+	// codegen.h). Empty if the node can't be exported.
+	virtual std::string expression(const std::vector<std::string>& args) const { return ""; }
 
 	// public since they need to be accessible by the graph class
 	std::vector<Node*> parents;
@@ -19,11 +40,24 @@ struct Node
 	double getDerivative(int index);
 	double getDerivative(Node* n);
 	void computeDerivatives(double downstream=1);
+	// for nodes that don't feed into any output, e.g. pruned weights
+	void zeroDerivatives();
 	bool isReadyForward();
 	bool isReadyBackward();
 
+	// heap bytes of the node's edge lists, and of its derivatives and
+	// partial derivatives, which are kept between passes
+	size_t edgeBytes() const;
+	size_t derivativeBytes() const;
+
 	void setParent(Node* n);
 	void setParents(const std::vector<Node*> &parentV);
+	void addParent(Node* n);
+
+	// bumped whenever any node's parents change, so that graphs
+	// know when to rebuild their schedule; graphs may be built on
+	// several threads at once
+	static std::atomic<unsigned long> topologyVersion;
 
 protected:
 	double output = 0;
@@ -32,6 +66,23 @@ protected:
 };
 
 struct InputNode;
+struct Graph;
+struct ExecutionContext;
+struct Jacobian;
+struct SegmentedContext;
+struct SparseContext;
+struct SparseRow;
+struct InferenceContext;
+struct MemoryReport;
+
+// Strategy for running the forward and backward sweeps of a graph.
+// See executors.h.
+struct Executor
+{
+	virtual ~Executor() {}
+	virtual void forward(Graph& g) = 0;
+	virtual void backward(Graph& g, const double *baseDeriv, unsigned n) = 0;
+};
 
 struct Graph
 {
@@ -39,18 +90,70 @@ struct Graph
 	std::vector<InputNode*> paramNodes;
 	std::vector<Node*> outputNodes;
 
+	// values and gradients of the paramNodes, in the same order
+	ParameterStore parameters;
+	// rebinds the store if paramNodes was changed without addParamNodes
+	void bindParameters();
+
+	// Constructs a T that lives as long as the graph. Lets a callback
+	// build a complete copy of a model, layers and all, into a graph.
+	template<typename T, typename... Args>
+	T& make(Args&&... args)
+	{
+		auto p = std::make_shared<T>(std::forward<Args>(args)...);
+		owned.push_back(p);
+		return *p;
+	}
+
 	void addInputNodes(const std::vector<InputNode*> &inputs);
+	// throws, changing nothing, for a null node or one that is a param
+	// of another graph
 	void addParamNodes(const std::vector<InputNode*> &inputs);
 
 	void setInputs(const std::vector<double> &values);
 	void setInputs(const double* values, unsigned n);
 
 	void setParams(const std::vector<double> &values);
-	void updateParams(std::function<double(double,double)> update );
+
+	// w = update(w, dw) for every param, with dw the param's derivative
+	// from the last backProp
+	template<typename UpdateT>
+	void updateParams(UpdateT update);
 
 	std::vector<double> forwardPass(const std::vector<double> &inputValues);
 	std::vector<double> forwardPass(const double* inputValues);
 
+	// Re-entrant versions, keeping all evaluation state in ctx instead of
+	// the nodes: any number of threads can evaluate the graph at once,
+	// each with its own context (see executioncontext.h).
+	const std::vector<double>& forwardPass(ExecutionContext& ctx, const double* inputValues);
+	void backProp(ExecutionContext& ctx, const double *baseDeriv, unsigned n);
+	void backProp(ExecutionContext& ctx, const std::vector<double>& baseDeriv);
+	// Reverse mode for k seed vectors of n (one per output) at once,
+	// laid out one after the other: a single traversal that pushes all k
+	// adjoints of a node to its parents together. Read the results with
+	// ctx.getGradient(param, seed).
+	void backProp(ExecutionContext& ctx, const double *seeds, unsigned n, unsigned k);
+	// every output's derivatives at the given inputs, from one forwardPass
+	// and one backProp seeded with the identity
+	void jacobian(ExecutionContext& ctx, const double* inputValues, Jacobian& J);
+	// forwardPass over `rows` consecutive input rows, writing one row of
+	// outputs per input row; the params are read once for the whole batch
+	void forwardBatch(ExecutionContext& ctx, const double* inputValues, unsigned rows, double* outputValues);
+
+	// The same with gradient checkpointing: less activation memory, for
+	// evaluating the graph again, piece by piece, in backProp (see
+	// segmentedcontext.h).
+	const std::vector<double>& forwardPass(SegmentedContext& ctx, const double* inputValues);
+	void backProp(SegmentedContext& ctx, const double *baseDeriv, unsigned n);
+	void backProp(SegmentedContext& ctx, const std::vector<double>& baseDeriv);
+
+	// The same for an input row given by its nonzeros: the first layer
+	// only visits the nonzero inputs (see sparseinput.h).
+	const std::vector<double>& forwardPass(SparseContext& ctx, const SparseRow& row);
+	void backProp(SparseContext& ctx, const double *baseDeriv, unsigned n);
+	void backProp(SparseContext& ctx, const std::vector<double>& baseDeriv);
+
 	double getOutput(int i=0);
 	void traverse();
 
@@ -60,6 +163,44 @@ struct Graph
 	void traverseNodes( std::function<void(Node*)> visit );
 	void setGraphUnexecuted();
 	void setGraphUnderivated();
+
+	// Evaluates the graph for inference only, keeping the node values in a
+	// small pool of buffers that are reused once nothing reads them any
+	// more (see memoryplan.h).
+	const std::vector<double>& forwardPass(InferenceContext& ctx, const double* inputValues);
+
+	// what the graph's nodes, params and schedule take up
+	MemoryReport memoryReport();
+
+	// the topological levels of the graph, rebuilt when the graph changed
+	const Schedule& schedule();
+	std::shared_ptr<const Schedule> sharedSchedule();
+
+	// run traverse and backProp with the given executor instead of serially
+	// (nullptr restores the default); the graph doesn't take ownership
+	void setExecutor(Executor* e) { executor = e; }
+
+private:
+	std::shared_ptr<Schedule> compiled;
+	Executor* executor = nullptr;
+	std::vector<std::shared_ptr<void>> owned;
 };
 
+template<typename UpdateT>
+void Graph::updateParams(UpdateT update)
+{
+	PROFILE_PHASE("Graph::updateParams");
+
+	bindParameters();
+	auto w = parameters.values();
+	unsigned n = w.size();
+
+	parameters.zeroGradients();
+	parameters.accumulateGradients();
+	auto dw = parameters.gradients();
+
+	for(unsigned k = 0; k < n; ++k)
+		w[k] = update(w[k], dw[k]);
+}
+
 #endif//GRAPH_H
\ No newline at end of file
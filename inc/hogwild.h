@@ -0,0 +1,192 @@
+#ifndef HOGWILD_H
+#define HOGWILD_H
+
+#include "graph.h"
+#include "executioncontext.h"
+#include "nodetypes.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct LossProbe
+{
+	double seconds;         // since run() started
+	unsigned long updates;  // samples applied so far, over all workers
+	double loss;            // mean loss over the training set
+};
+
+// Asynchronous SGD without locks (Hogwild!). Every worker thread evaluates
+// the graph through its own ExecutionContext, reading the graph's params
+// as they are being written. Workers pick random samples and write their
+// update straight into the shared params with relaxed atomic loads and
+// stores: there is no barrier, and updates from different workers may
+// overwrite each other, which works out when gradients are sparse.
+// Zero gradients are skipped, so sparse models only touch the params a
+// sample actually uses.
+// A probe thread periodically measures the loss with a context of its own.
+template<typename LossT>
+struct HogwildTrainer
+{
+	HogwildTrainer(Graph* graph, unsigned nThreads = std::thread::hardware_concurrency())
+	: graph(graph)
+	, nThreads(nThreads ? nThreads : 1)
+	{}
+
+	void setTrainingSet(double* in, double* out, unsigned n)
+	{
+		inputs = in;
+		outputs = out;
+		setSize = n;
+	}
+
+	void setLearningRate(double r) { learningRate = r; }
+	double getLearningRate() { return learningRate; }
+
+	void setProbeInterval(double seconds) { probeInterval = seconds; }
+	void setProbeCallback(std::function<void(const LossProbe&)> f) { probeCallback = f; }
+
+	// Applies epochs*setSize single-sample updates, spread over the workers.
+	void run(unsigned epochs)
+	{
+		std::vector<std::unique_ptr<ExecutionContext>> contexts;
+		for(unsigned t = 0; t < nThreads + 1; ++t)
+			contexts.emplace_back(new ExecutionContext(*graph));
+
+		unsigned long budget = (unsigned long)epochs * setSize;
+		std::atomic<unsigned long> taken(0);
+		std::atomic<unsigned long> applied(0);
+
+		bool finished = false;
+		std::mutex finishLock;
+		std::condition_variable finishedChanged;
+
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::thread> workers;
+		for(unsigned t = 0; t < nThreads; ++t)
+		{
+			workers.emplace_back([&, t] {
+				work(*contexts[t], t, budget, taken, applied);
+			});
+		}
+
+		// probe until the workers run out of samples
+		ExecutionContext& prober = *contexts[nThreads];
+		std::thread probeThread([&] {
+			auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(probeInterval));
+			auto next = start + interval;
+
+			std::unique_lock<std::mutex> guard(finishLock);
+			while(!finishedChanged.wait_until(guard, next, [&] { return finished; }))
+			{
+				probe(prober, start, applied.load());
+				next += interval;
+			}
+		});
+
+		for(auto& w : workers)
+			w.join();
+
+		{
+			std::lock_guard<std::mutex> guard(finishLock);
+			finished = true;
+		}
+		finishedChanged.notify_one();
+		probeThread.join();
+
+		probe(prober, start, applied.load());
+	}
+
+	std::vector<LossProbe> getProbes()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return probes;
+	}
+
+	double getLastLoss()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		return probes.size() ? probes.back().loss : 0;
+	}
+
+private:
+	void work(ExecutionContext& ctx, unsigned t, unsigned long budget,
+		std::atomic<unsigned long>& taken, std::atomic<unsigned long>& applied)
+	{
+		unsigned inW = graph->inputNodes.size();
+		unsigned outW = graph->outputNodes.size();
+		unsigned nParams = graph->paramNodes.size();
+		double* w = graph->parameters.values().data();
+
+		unsigned rng = 2654435761u * (t + 1);
+
+		while(taken.fetch_add(1, std::memory_order_relaxed) < budget)
+		{
+			rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+			unsigned j = rng % setSize;
+
+			auto& out = graph->forwardPass(ctx, inputs + j*inW);
+			auto baseDeriv = LossT::derivative(out.data(), outputs + j*outW, outW);
+			graph->backProp(ctx, baseDeriv);
+
+			for(unsigned k = 0; k < nParams; ++k)
+			{
+				double dw = ctx.getGradient(k);
+				if(dw != 0)
+					relaxedStore(w + k, relaxedLoad(w + k) - learningRate * dw);
+			}
+
+			applied.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void probe(ExecutionContext& ctx, std::chrono::steady_clock::time_point start, unsigned long updates)
+	{
+		unsigned inW = graph->inputNodes.size();
+		unsigned outW = graph->outputNodes.size();
+
+		double loss = 0;
+		for(unsigned j = 0; j < setSize; ++j)
+		{
+			auto& out = graph->forwardPass(ctx, inputs + j*inW);
+			loss += LossT::loss(out.data(), outputs + j*outW, outW);
+		}
+
+		LossProbe p;
+		p.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		p.updates = updates;
+		p.loss = loss / setSize;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			probes.push_back(p);
+		}
+
+		if(probeCallback)
+			probeCallback(p);
+	}
+
+	Graph* graph;
+	unsigned nThreads;
+
+	double* inputs = nullptr;
+	double* outputs = nullptr;
+	unsigned setSize = 0;
+
+	double learningRate = 0.01;
+	double probeInterval = 0.1;
+	std::function<void(const LossProbe&)> probeCallback;
+
+	std::mutex lock;
+	std::vector<LossProbe> probes;
+};
+
+#endif // HOGWILD_H
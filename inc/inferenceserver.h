@@ -0,0 +1,77 @@
+#ifndef INFERENCE_SERVER_H
+#define INFERENCE_SERVER_H
+
+#include "microbatcher.h"
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Serves a MicroBatcher over a Unix-domain stream socket.
+//
+// Wire format, in native byte order since both ends are on one host:
+//   request: uint32 kind, uint32 n, then n doubles
+//   reply:   uint32 n, then n doubles (n = 0 for a malformed request)
+// PREDICT sends one row of inputs and gets one row of outputs back.
+// SHAPE and STATS send no values; SHAPE replies {inputs, outputs} and
+// STATS replies {requests, batches, meanBatch, p50, p99, requestsPerSecond}.
+//
+// Each connection is served by its own thread and handles one request at
+// a time; concurrent requests come from concurrent connections.
+struct InferenceServer
+{
+	enum Kind : unsigned { PREDICT = 0, SHAPE = 1, STATS = 2 };
+
+	InferenceServer(MicroBatcher& batcher, const std::string& path);
+	~InferenceServer();
+
+	InferenceServer(const InferenceServer&) = delete;
+	InferenceServer& operator=(const InferenceServer&) = delete;
+
+	// binds the socket (replacing a stale one at path) and starts accepting
+	void start();
+	// closes the socket and every connection, and waits for their threads
+	void stop();
+
+private:
+	void acceptLoop();
+	void serve(int fd);
+	// joins the handlers of closed connections; call with lock held
+	void reapHandlers();
+
+	MicroBatcher& batcher;
+	std::string path;
+	int listenFd = -1;
+
+	std::thread acceptor;
+	std::mutex lock;
+	std::vector<int> connections;
+	std::vector<std::thread> handlers;
+	std::vector<std::thread::id> finished;
+	bool stopping = false;
+};
+
+// A blocking client for one connection to an InferenceServer.
+struct InferenceClient
+{
+	explicit InferenceClient(const std::string& path);
+	~InferenceClient();
+
+	InferenceClient(const InferenceClient&) = delete;
+	InferenceClient& operator=(const InferenceClient&) = delete;
+
+	unsigned inputWidth() const { return inW; }
+	unsigned outputWidth() const { return outW; }
+
+	std::vector<double> predict(const double* inputs);
+	ServingStats stats();
+
+private:
+	std::vector<double> call(unsigned kind, const double* data, unsigned n);
+
+	int fd = -1;
+	unsigned inW = 0, outW = 0;
+};
+
+#endif // INFERENCE_SERVER_H
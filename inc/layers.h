@@ -20,12 +20,120 @@ struct LinearLayer
     void randomizeWeights();
     void printWeights();
 
+    // Magnitude pruning: removes the weights with |w| <= threshold from
+    // the layer's VectorMultNodes, so forward and backward only visit the
+    // remaining ones. Pruned weights are set to 0 and stay disconnected,
+    // which keeps them at 0 through further training. The bias is never
+    // pruned. Returns the number of weights pruned so far.
+    unsigned prune(double threshold);
+    // prunes the given fraction of the weights with the smallest magnitude
+    unsigned pruneFraction(double fraction);
+
+    bool isPruned(unsigned row, unsigned col) { return pruned.at(row*numInputs + col); }
+    unsigned nonZeros() { return colIndices.size(); }
+
+    // the kept weights in CSR form: row r keeps the columns
+    // colIndices[rowOffsets[r] .. rowOffsets[r+1]], the bias column last
+    const std::vector<unsigned>& getRowOffsets() const { return rowOffsets; }
+    const std::vector<unsigned>& getColumnIndices() const { return colIndices; }
+
 protected:
+    // points every row's VectorMultNode at its kept weights
+    void connectRows();
+
     std::vector<Node*> m_inputs;
     size_t numOutputs, numInputs;
     NodeSet<InputNode> weights;
     InputNode bias;
     std::shared_ptr<VectorMultNode[]> vectorNodes;
+
+    std::vector<char> pruned;
+    std::vector<unsigned> rowOffsets, colIndices;
+};
+
+// A 2D convolution over `channels` planes of height x width inputs, with
+// `filters` kernels of channels x kernelH x kernelW weights and a bias per
+// filter. Inputs are laid out channel by channel, row by row, and so are
+// the outputs (filters x outputHeight() x outputWidth()); the padding is
+// zeros.
+//
+// Built over input nodes, every output is a VectorMultNode over its patch,
+// and all the outputs of a filter share that filter's weight nodes. That
+// only shares params: the graph still evaluates a node per output.
+//
+// Built without input nodes, the layer is lowered: its outputs are input
+// nodes for the graph it feeds (add getInputNodes() to the graph's inputs),
+// and the layer itself is evaluated on raw arrays in batches, by im2col and
+// a matrix multiply (see gemm.h), and differentiated by the transposed
+// multiply. BatchOptimizer::addConvolution trains a lowered layer together
+// with its graph that way. The batch functions work in either mode.
+struct Conv2DLayer
+{
+    Conv2DLayer(const std::vector<Node*>& inputs, unsigned channels, unsigned height, unsigned width,
+        unsigned filters, unsigned kernelH, unsigned kernelW,
+        unsigned strideH = 1, unsigned strideW = 1, unsigned padH = 0, unsigned padW = 0);
+
+    // lowered
+    Conv2DLayer(unsigned channels, unsigned height, unsigned width,
+        unsigned filters, unsigned kernelH, unsigned kernelW,
+        unsigned strideH = 1, unsigned strideW = 1, unsigned padH = 0, unsigned padW = 0);
+
+    // the kernels (filters x channels x kernelH x kernelW), then the biases
+    std::vector<InputNode*> getWeightNodes();
+    std::vector<Node*> getOutputNodes();
+    void randomizeWeights();
+
+    bool isLowered() { return loweredOutputs != nullptr; }
+    // lowered: the output nodes, which the graph takes as inputs
+    std::vector<InputNode*> getInputNodes();
+
+    unsigned outputHeight() { return outH; }
+    unsigned outputWidth() { return outW; }
+    unsigned inputSize() { return C*H*W; }
+    unsigned outputSize() { return F*outH*outW; }
+
+    // out = the layer applied to each of the batch's input rows
+    void forward(const double* in, unsigned batch, double* out);
+
+    // Given dLoss/dOut for each row, adds the gradient of every weight (in
+    // getWeightNodes order) summed over the batch to grads, and writes
+    // dLoss/dIn to dIn unless it is nullptr.
+    void backward(const double* in, const double* dOut, unsigned batch, double* grads, double* dIn = nullptr);
+
+protected:
+    // sets outH and outW; throws if the kernel doesn't fit
+    void setShape();
+
+    // columns of the patches: row (c, ky, kx), column (y, x) of the output
+    void im2col(const double* in, double* cols);
+    void col2im(const double* cols, double* in);
+
+    unsigned C, H, W, F, KH, KW, SH, SW, PH, PW;
+    unsigned outH, outW;
+
+    NodeSet<InputNode> weights;
+    InputNode bias;
+    std::shared_ptr<VectorMultNode[]> outputs;
+    std::shared_ptr<InputNode[]> loweredOutputs;
+
+    std::vector<double> cols, kernel;
+};
+
+// A 1D convolution over `channels` sequences of the given length.
+struct Conv1DLayer : Conv2DLayer
+{
+    Conv1DLayer(const std::vector<Node*>& inputs, unsigned channels, unsigned length,
+        unsigned filters, unsigned kernel, unsigned stride = 1, unsigned pad = 0)
+    : Conv2DLayer(inputs, channels, 1, length, filters, 1, kernel, 1, stride, 0, pad)
+    {}
+
+    // lowered
+    Conv1DLayer(unsigned channels, unsigned length,
+        unsigned filters, unsigned kernel, unsigned stride = 1, unsigned pad = 0)
+    : Conv2DLayer(channels, 1, length, filters, 1, kernel, 1, stride, 0, pad)
+    {}
+
+    unsigned outputLength() { return outW; }
 };
 
 template<typename ActivationNodeT>
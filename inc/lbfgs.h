@@ -0,0 +1,288 @@
+#ifndef LBFGS_H
+#define LBFGS_H
+
+#include "batchoptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Limited memory BFGS over the full-batch mean loss. Each epoch builds a
+// quasi-Newton direction from the last `history` steps and the changes in
+// gradient they caused, then takes a step along it that satisfies the
+// Wolfe conditions:
+//
+//   f(x + a d) <= f(x) + c1 a g.d          (enough decrease)
+//   g(x + a d).d >= c2 g.d                 (not too short)
+//
+// Trial steps that are only being shortened evaluate the loss without
+// backprop. The gradient at the accepted step is kept for the next epoch,
+// so a unit step, which is what is usually taken, costs one pass over the
+// training set, the same as an epoch of GradientDescent.
+//
+// The learning rate and its decay aren't used, and gradient clipping
+// shouldn't be: it breaks the quasi-Newton model. runEpochs stops once
+// the largest gradient component falls below the tolerance.
+template<typename LossT>
+struct LBFGS : public BatchOptimizer<LBFGS, LossT>
+{
+	LBFGS(Graph *g, unsigned history = 10)
+	: m(history ? history : 1)
+	{
+		this->setGraph(g);
+	}
+
+	template<typename ModelT>
+	LBFGS(ModelT *model, unsigned history = 10)
+	: m(history ? history : 1)
+	{
+		this->setModel(model);
+	}
+
+	void setTolerance(double t) { tolerance = t; }
+	double getTolerance() { return tolerance; }
+
+	bool converged() { return done; }
+
+	// passes over the training set made by the line searches, beyond the
+	// one per epoch
+	unsigned long getExtraEvaluations() { return extraEvaluations; }
+
+	bool gradientIsCurrent()
+	{
+		auto w = this->paramValues;
+		return valid && x.size() == w.size() && std::equal(w.begin(), w.end(), x.begin());
+	}
+
+	void updateParams()
+	{
+		auto w = this->paramValues;
+		auto dw = this->paramDerivs;
+		unsigned n = this->nParams;
+
+		// runEpoch has just evaluated the gradient here
+		if(!gradientIsCurrent())
+		{
+			if(x.size() != n)
+				clearHistory();
+			x.assign(w.begin(), w.end());
+			g.assign(dw.begin(), dw.end());
+			f = this->lastMeanError;
+			valid = true;
+		}
+
+		double gMax = 0;
+		for(unsigned k = 0; k < n; ++k)
+			gMax = std::max(gMax, std::abs(g[k]));
+		done = gMax <= tolerance;
+		if(done)
+			return;
+
+		direction();
+		double dg = dot(d.data(), g.data());
+		if(!(dg < 0))
+		{
+			// the history no longer describes the loss here
+			clearHistory();
+			direction();
+			dg = dot(d.data(), g.data());
+		}
+
+		double a = count ? 1 : std::min(1.0, 1 / std::sqrt(dot(g.data(), g.data())));
+		if(!lineSearch(a, dg))
+		{
+			for(unsigned k = 0; k < n; ++k)
+				w[k] = x[k];
+			valid = false;
+
+			// not even a steepest descent step helps; we're as close as
+			// rounding lets us get
+			done = !count;
+			clearHistory();
+			return;
+		}
+
+		// the new curvature pair; the Wolfe conditions make s.y > 0
+		double* s = &S[head * n];
+		double* y = &Y[head * n];
+		for(unsigned k = 0; k < n; ++k)
+		{
+			s[k] = w[k] - x[k];
+			y[k] = dw[k] - g[k];
+		}
+		double sy = dot(s, y);
+		if(sy > 0)
+		{
+			rho[head] = 1 / sy;
+			head = (head + 1) % m;
+			count = std::min(count + 1, m);
+		}
+
+		x.assign(w.begin(), w.end());
+		g.assign(dw.begin(), dw.end());
+		f = this->lastMeanError;
+	}
+
+	void getOptimizerState(std::vector<double>& state)
+	{
+		state.assign({ (double)m, (double)count, (double)head, (double)valid, f });
+		state.insert(state.end(), x.begin(), x.end());
+		state.insert(state.end(), g.begin(), g.end());
+		state.insert(state.end(), S.begin(), S.end());
+		state.insert(state.end(), Y.begin(), Y.end());
+		state.insert(state.end(), rho.begin(), rho.end());
+	}
+
+	void setOptimizerState(const std::vector<double>& state)
+	{
+		unsigned n = this->nParams;
+		if(state.size() < 5 || state[0] != m || state.size() != 5 + 2*n + 2*m*n + m)
+			throw new std::exception();
+
+		clearHistory();
+		count = state[1];
+		head = state[2];
+		valid = state[3] != 0;
+		f = state[4];
+
+		auto it = state.begin() + 5;
+		x.assign(it, it + n); it += n;
+		g.assign(it, it + n); it += n;
+		std::copy(it, it + m*n, S.begin()); it += m*n;
+		std::copy(it, it + m*n, Y.begin()); it += m*n;
+		std::copy(it, it + m, rho.begin());
+	}
+
+private:
+	void clearHistory()
+	{
+		unsigned n = this->nParams;
+		S.assign(m * n, 0);
+		Y.assign(m * n, 0);
+		rho.assign(m, 0);
+		count = head = 0;
+	}
+
+	double dot(const double* a, const double* b)
+	{
+		double sum = 0;
+		for(unsigned k = 0; k < this->nParams; ++k)
+			sum += a[k] * b[k];
+		return sum;
+	}
+
+	// d = -H g by the two-loop recursion, newest pair first
+	void direction()
+	{
+		unsigned n = this->nParams;
+		d.assign(g.begin(), g.end());
+		alpha.resize(m);
+
+		for(unsigned i = 0; i < count; ++i)
+		{
+			unsigned j = (head + m - 1 - i) % m;
+			alpha[j] = rho[j] * dot(&S[j*n], d.data());
+			const double* y = &Y[j*n];
+			for(unsigned k = 0; k < n; ++k)
+				d[k] -= alpha[j] * y[k];
+		}
+
+		// H0 = gamma I, scaled by the newest pair
+		if(count)
+		{
+			unsigned j = (head + m - 1) % m;
+			const double* y = &Y[j*n];
+			double gamma = 1 / (rho[j] * dot(y, y));
+			for(unsigned k = 0; k < n; ++k)
+				d[k] *= gamma;
+		}
+
+		for(unsigned i = count; i-- > 0; )
+		{
+			unsigned j = (head + m - 1 - i) % m;
+			double beta = rho[j] * dot(&Y[j*n], d.data());
+			const double* s = &S[j*n];
+			for(unsigned k = 0; k < n; ++k)
+				d[k] += (alpha[j] - beta) * s[k];
+		}
+
+		for(unsigned k = 0; k < n; ++k)
+			d[k] = -d[k];
+	}
+
+	// Bisection on [lo, hi], doubling while there is no upper bound, with
+	// the params left at the accepted step and its gradient in paramDerivs.
+	// False if no step within maxTrials satisfies both conditions.
+	bool lineSearch(double a, double dg)
+	{
+		PROFILE_PHASE("LBFGS::lineSearch");
+
+		const double c1 = 1e-4, c2 = 0.9;
+		const unsigned maxTrials = 30;
+		const double inf = std::numeric_limits<double>::infinity();
+
+		auto w = this->paramValues;
+		auto dw = this->paramDerivs;
+		unsigned n = this->nParams;
+		double lo = 0, hi = inf;
+
+		for(unsigned trial = 0; trial < maxTrials; ++trial)
+		{
+			if(trial)
+				extraEvaluations++;
+
+			for(unsigned k = 0; k < n; ++k)
+				w[k] = x[k] + a * d[k];
+
+			// while shortening the step, try the loss alone first
+			bool withGradient = hi == inf;
+			double fa = this->evaluate(withGradient);
+
+			if(!(fa <= f + c1 * a * dg))
+			{
+				// a parabola through f(0), f'(0) and f(a), if it's the first cut
+				double next = lo == 0 ? -dg * a * a / (2 * (fa - f - dg * a)) : 0.5 * (lo + hi);
+				hi = a;
+				a = std::isfinite(next) ? std::min(std::max(next, lo + 0.1 * (hi - lo)), lo + 0.5 * (hi - lo)) : 0.5 * (lo + hi);
+				continue;
+			}
+
+			if(!withGradient)
+			{
+				extraEvaluations++;
+				this->evaluate(true);
+			}
+
+			if(dot(dw.begin(), d.data()) < c2 * dg)
+			{
+				lo = a;
+				a = hi == inf ? 2 * a : 0.5 * (lo + hi);
+				continue;
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	unsigned m;
+	double tolerance = 1e-8;
+	bool done = false;
+
+	// the params, mean loss and gradient the last step ended at
+	std::vector<double> x, g;
+	double f = 0;
+	bool valid = false;
+
+	// the last `count` pairs s = x' - x, y = g' - g, in a ring of m rows
+	// starting at head - count
+	std::vector<double> S, Y, rho;
+	unsigned count = 0, head = 0;
+
+	std::vector<double> d, alpha;
+	unsigned long extraEvaluations = 0;
+};
+
+#endif // LBFGS_H
@@ -0,0 +1,42 @@
+#ifndef LEAST_SQUARES_H
+#define LEAST_SQUARES_H
+
+#include "graph.h"
+
+#include <vector>
+
+// True if every output of the graph is an affine function of the params,
+// e.g. a LinearLayer over any features of the inputs: params only reach
+// the outputs through additions, and through products whose other factor
+// doesn't depend on the params. Then squared loss has a closed-form
+// minimum.
+bool isLinearInParams(Graph& g);
+
+// The normal equations of a least squares fit of a model linear in its
+// params, summed over the training set:
+//
+//   min_w  sum_j |f(x_j; w) - y_j|^2
+//   AtA w = Atb,  with a row of A per output of each sample
+//
+// The rows of A are the gradients of the outputs with respect to the
+// params, taken with an ExecutionContext; accumulating is a single pass
+// over the data.
+struct NormalEquations
+{
+	explicit NormalEquations(unsigned nParams);
+
+	void accumulate(Graph& g, const double* in, const double* out, unsigned n);
+
+	// Solves for the params, adding ridge*|w|^2 to the loss. The columns
+	// are scaled to a unit diagonal first, so features of very different
+	// magnitude (x, x^2, x^3, ...) don't wreck the precision. Returns
+	// false if the system is singular; try a ridge > 0.
+	bool solve(double ridge, double* w) const;
+
+	unsigned nParams;
+	std::vector<double> AtA;  // nParams x nParams, row-major
+	std::vector<double> Atb;
+	unsigned long rows = 0;
+};
+
+#endif // LEAST_SQUARES_H
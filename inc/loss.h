@@ -5,7 +5,7 @@
 
 struct SquareLoss
 {
-	static double loss(double *yout, double *yexpected, unsigned n)
+	static double loss(const double *yout, const double *yexpected, unsigned n)
 	{
 		double totalLoss = 0;
 
@@ -18,15 +18,18 @@ struct SquareLoss
 		return totalLoss;
 	}
 
-	static std::vector<double> derivative(double *yout, double *yexpected, unsigned n)
+	static std::vector<double> derivative(const double *yout, const double *yexpected, unsigned n)
 	{
-		std::vector<double> result;
-		result.reserve(n);
+		std::vector<double> result(n);
+		derivative(yout, yexpected, n, result.data());
+		return result;
+	}
 
+	// without allocating, for hot loops (see staticnet.h)
+	static void derivative(const double *yout, const double *yexpected, unsigned n, double *result)
+	{
 		for(unsigned i = 0; i < n; ++i)
-			result.push_back(2*(yout[i] - yexpected[i]));
-
-		return result;
+			result[i] = 2*(yout[i] - yexpected[i]);
 	}
 };
 
@@ -0,0 +1,85 @@
+#ifndef MEMORY_PLAN_H
+#define MEMORY_PLAN_H
+
+#include "graph.h"
+
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct MemoryUsage
+{
+	unsigned count = 0;
+	size_t bytes = 0;
+};
+
+// What a graph takes up, from Graph::memoryReport. The nodes are counted
+// with their edge lists and the derivatives they keep between passes.
+struct MemoryReport
+{
+	std::map<std::string, MemoryUsage> nodeTypes;
+	size_t nodeBytes = 0;        // all the nodes, by type above
+	size_t derivativeBytes = 0;  // of which derivatives and partials
+	size_t paramBytes = 0;       // the ParameterStore's values and gradients
+	size_t scheduleBytes = 0;
+
+	size_t total() const { return nodeBytes + paramBytes + scheduleBytes; }
+	void write(std::ostream& out) const;
+};
+
+// Liveness-based buffer assignment for inference. Walking the schedule
+// in order, a node's value needs a buffer from when it is computed until
+// its last child has read it; outputs keep theirs to the end. Each node
+// gets a slot in a pool of buffers, reusing slots whose value is dead,
+// so for a stack of layers the pool holds about two layers' worth.
+// Params and constants aren't copied, so they don't take slots.
+struct BufferPlan
+{
+	void build(const Schedule& s);
+
+	// per schedule node, its slot, or -1 for params
+	std::vector<int> slotOf;
+	unsigned numSlots = 0;
+};
+
+// The state for evaluating a graph through a BufferPlan (see
+// Graph::forwardPass(InferenceContext&, ...)): forward only, with no
+// partial derivatives kept, and a value per slot rather than per node.
+struct InferenceContext
+{
+	explicit InferenceContext(Graph& g);
+
+	void setParams(const double* values) { params = values; }
+	const double* getParams() const { return params; }
+
+	const std::vector<double>& getOutputs() const { return outputs; }
+	double getOutput(unsigned i) const { return outputs.at(i); }
+
+	const Schedule& getSchedule() const { return *schedule; }
+	const BufferPlan& getPlan() const { return plan; }
+
+	// bytes of activation state held by the context, and what it would
+	// take with a buffer per node
+	size_t activationBytes() const;
+	size_t unplannedBytes() const;
+
+private:
+	friend struct Graph;
+
+	std::shared_ptr<const Schedule> schedule;
+	const double* params = nullptr;
+	BufferPlan plan;
+
+	// per argument edge: >= 0 for a slot, else -(k+1) for param k, or
+	// -(nParams+c+1) for constant c
+	std::vector<int> args;
+	std::vector<int> outputArgs;
+
+	std::vector<double> buffers;  // one per slot
+	std::vector<double> outputs;
+	std::vector<double> scratch;  // arguments and partials of one node
+};
+
+#endif // MEMORY_PLAN_H
@@ -0,0 +1,84 @@
+#ifndef MICROBATCHER_H
+#define MICROBATCHER_H
+
+#include "graph.h"
+#include "executioncontext.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ServingStats
+{
+	unsigned long requests = 0;
+	unsigned long batches = 0;
+	double meanBatch = 0;
+	// seconds from submit() until the result is ready, over the most
+	// recent requests
+	double p50 = 0;
+	double p99 = 0;
+	double requestsPerSecond = 0;  // since start or resetStats()
+};
+
+// Coalesces single-row requests from many threads into micro-batches.
+// A batch is evaluated as soon as it holds maxBatch rows, or when its
+// oldest request has waited maxDelay seconds, whichever comes first, so
+// maxDelay bounds the latency added by batching.
+// Batches are evaluated one at a time on a thread of the batcher, through
+// an ExecutionContext; the graph's params may be changed in between.
+struct MicroBatcher
+{
+	typedef std::chrono::steady_clock clock;
+
+	MicroBatcher(Graph& graph, unsigned maxBatch = 32, double maxDelay = 0.001);
+	~MicroBatcher();
+
+	MicroBatcher(const MicroBatcher&) = delete;
+	MicroBatcher& operator=(const MicroBatcher&) = delete;
+
+	unsigned inputWidth() const { return inW; }
+	unsigned outputWidth() const { return outW; }
+
+	// copies one row of inputWidth() values; thread safe
+	std::future<std::vector<double>> submit(const double* inputs);
+
+	ServingStats getStats();
+	void resetStats();
+
+private:
+	struct Request
+	{
+		std::vector<double> inputs;
+		std::promise<std::vector<double>> result;
+		clock::time_point arrival;
+	};
+
+	void loop();
+	void record(const std::vector<Request>& batch, clock::time_point done);
+
+	Graph& graph;
+	ExecutionContext ctx;
+	unsigned inW, outW;
+	unsigned maxBatch;
+	clock::duration maxDelay;
+
+	std::mutex lock;
+	std::condition_variable arrived;
+	std::deque<Request> queue;
+	bool stopping = false;
+
+	std::mutex statsLock;
+	ServingStats totals;
+	clock::time_point statsStart;
+	std::vector<double> latencies;  // ring of the most recent ones
+	unsigned long latencyCount = 0;
+
+	std::thread evaluator;
+};
+
+#endif // MICROBATCHER_H
@@ -2,15 +2,29 @@
 #define GRAPH_NODE_TYPES_H
 
 #include "graph.h"
+#include "parameterstore.h"
 
 struct InputNode : public Node
 {
 	InputNode();
 	explicit InputNode (double i);
+	~InputNode();
 	void setInput(double i);
 	double getInput();
 
+	// input nodes have no parents, so this just returns the value
+	virtual double compute(const double* in, double* partials) const;
 	virtual void forward();
+
+	// once bound, the node's value lives in the store
+	// (see ParameterStore::bind)
+	void bind(ParameterStore* s, unsigned index);
+	void unbind();
+	ParameterStore* getStore() { return store; }
+
+private:
+	ParameterStore* store = nullptr;
+	unsigned storeIndex = 0;
 };
 
 // struct VectorInputNode : public Node
@@ -24,21 +38,24 @@ struct InputNode : public Node
 struct AdditionNode : public Node
 {
 	AdditionNode(Node* a, Node* b);
-	virtual void forward();
+	virtual double compute(const double* in, double* partials) const;
+	virtual std::string expression(const std::vector<std::string>& args) const;
 };
 
 struct MultiplicationNode : public Node
 {
 	MultiplicationNode() {}
 	MultiplicationNode(Node* a, Node* b);
-	virtual void forward();
+	virtual double compute(const double* in, double* partials) const;
+	virtual std::string expression(const std::vector<std::string>& args) const;
 };
 
 struct VectorMultNode : public Node
 {
 	VectorMultNode();
 	VectorMultNode(std::vector<Node*> inputs, std::vector<Node*> weights);
-	virtual void forward();
+	virtual double compute(const double* in, double* partials) const;
+	virtual std::string expression(const std::vector<std::string>& args) const;
 	void setInputs(std::vector<Node*> inputs, std::vector<Node*> weights);
 };
 
@@ -46,7 +63,8 @@ struct SigmoidNode : public Node
 {
 	SigmoidNode();
 	SigmoidNode(Node* p);
-	virtual void forward();
+	virtual double compute(const double* in, double* partials) const;
+	virtual std::string expression(const std::vector<std::string>& args) const;
 };
 
 template <typename ForwardFunc, typename BackwardFunc>
@@ -55,13 +73,10 @@ struct FunctionNode : public Node
 	FunctionNode() {}
 	FunctionNode(Node* p) { setParent(p); }
 
-	virtual void forward()
+	virtual double compute(const double* in, double* partials) const
 	{
-		auto p = parents.at(0);
-		double in = p->getOutput();
-		output = ForwardFunc(in);
-
-		partialDerivatives.at(0) = BackwardFunc(in);
+		partials[0] = BackwardFunc(in[0]);
+		return ForwardFunc(in[0]);
 	}
 };
 
@@ -69,7 +84,9 @@ struct MaxNode : public Node
 {
 	MaxNode() {}
 	MaxNode(const std::vector<Node*>& p);
-	virtual void forward();
+	virtual double compute(const double* in, double* partials) const;
+	// uses a max_ helper that the exporter defines
+	virtual std::string expression(const std::vector<std::string>& args) const;
 };
 
 struct InverseNode : public Node
@@ -77,7 +94,8 @@ struct InverseNode : public Node
 	InverseNode() {}
 	InverseNode(Node* p) { setParent(p); }
 
-	virtual void forward();
+	virtual double compute(const double* in, double* partials) const;
+	virtual std::string expression(const std::vector<std::string>& args) const;
 };
 
 #endif // NODETYPES_H
@@ -0,0 +1,95 @@
+#ifndef PARAMETER_STORE_H
+#define PARAMETER_STORE_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+struct InputNode;
+
+// Non-owning view of a contiguous array, in the spirit of std::span.
+template<typename T>
+struct Span
+{
+	Span() : ptr(nullptr), n(0) {}
+	Span(T* ptr, size_t n) : ptr(ptr), n(n) {}
+
+	T* data() const { return ptr; }
+	size_t size() const { return n; }
+	T& operator[](size_t i) const { return ptr[i]; }
+	T* begin() const { return ptr; }
+	T* end() const { return ptr + n; }
+
+private:
+	T* ptr;
+	size_t n;
+};
+
+// Owns the values and gradients of a graph's param nodes in two flat,
+// cache line aligned arrays. Bound param nodes read their value from the
+// store by index, so optimizers can work on whole arrays at once.
+// Either side may go first: a destroyed store gives the nodes their
+// values back, and a destroyed node is forgotten by the store.
+struct ParameterStore
+{
+	ParameterStore() {}
+	~ParameterStore();
+	ParameterStore(const ParameterStore&) = delete;
+	ParameterStore& operator=(const ParameterStore&) = delete;
+
+	// Takes over the current values of the nodes and points the nodes at
+	// the store. Nodes previously bound to this store but not in params
+	// are given their value back. A node belongs to one store at a time:
+	// this throws if one is bound to another store, e.g. a param node
+	// registered with two graphs, or if one is null. On a throw nothing
+	// changes.
+	void bind(const std::vector<InputNode*> &params);
+
+	// for a bound node that is being destroyed
+	void forget(unsigned index);
+
+	// bumped by every bind, so that views of the arrays know to refresh
+	unsigned long getVersion() const { return version; }
+
+	unsigned size() const { return nodes.size(); }
+	bool isBoundTo(const std::vector<InputNode*> &params) const { return nodes == params; }
+
+	Span<double> values() { return Span<double>(valueData.get(), nodes.size()); }
+	Span<double> gradients() { return Span<double>(gradientData.get(), nodes.size()); }
+	Span<const double> values() const { return Span<const double>(valueData.get(), nodes.size()); }
+	Span<const double> gradients() const { return Span<const double>(gradientData.get(), nodes.size()); }
+
+	void zeroGradients();
+
+	// gradients[k] += scale * derivative of the k'th param node,
+	// after a backProp
+	void accumulateGradients(double scale=1);
+
+private:
+	struct AlignedFree { void operator()(double* p) { free(p); } };
+	typedef std::unique_ptr<double[], AlignedFree> AlignedArray;
+
+	static AlignedArray allocate(size_t n);
+
+	std::vector<InputNode*> nodes;
+	AlignedArray valueData;
+	AlignedArray gradientData;
+	unsigned long version = 0;
+};
+
+// For params shared between threads without locks (see hogwild.h):
+// individual loads and stores are atomic, but nothing is ordered.
+inline double relaxedLoad(const double* p)
+{
+	double v;
+	__atomic_load(p, &v, __ATOMIC_RELAXED);
+	return v;
+}
+
+inline void relaxedStore(double* p, double v)
+{
+	__atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+
+#endif // PARAMETER_STORE_H
@@ -0,0 +1,128 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <typeindex>
+#include <vector>
+
+// Opt-in instrumentation of graph phases and node calls.
+// The PROFILE_* macros compile to nothing unless TOYML_PROFILE is defined
+// (build with `make PROFILE=1`), so the default build pays nothing.
+
+struct Node;
+
+// the demangled name of the node's dynamic type, e.g. "SigmoidNode"
+std::string nodeTypeName(const Node* n);
+
+struct ProfileStats
+{
+	unsigned long calls = 0;
+	unsigned long long nanoseconds = 0;
+	unsigned long long cycles = 0;
+};
+
+struct TraceEvent
+{
+	std::string name;
+	const char* category;
+	unsigned long long start;
+	unsigned long long duration;
+	unsigned long thread;
+};
+
+struct Profiler
+{
+	static Profiler& instance();
+
+	static unsigned long long now();
+	static unsigned long long cycles();
+
+	void record(const char* name, const char* category,
+		unsigned long long start, unsigned long long end, unsigned long long cycleCount);
+	void recordNode(const Node* n, const char* category,
+		unsigned long long start, unsigned long long end, unsigned long long cycleCount);
+
+	// while tracing, every recorded call is also kept as a timeline event
+	void startTrace();
+	void stopTrace();
+	bool isTracing() { return tracing.load(std::memory_order_relaxed); }
+
+	void reset();
+
+	std::map<std::string, ProfileStats> getPhaseStats();
+	std::map<std::string, ProfileStats> getNodeStats();
+
+	void writeReport(std::ostream& out);
+	void writeChromeTrace(std::ostream& out);
+
+private:
+	// what one thread has recorded; its lock is only contended by readers
+	struct ThreadBuffer
+	{
+		std::mutex lock;
+		std::map<std::string, ProfileStats> phaseStats;
+		std::map<std::string, ProfileStats> nodeStats;
+		std::map<std::type_index, std::string> typeNames;
+		std::vector<TraceEvent> events;
+	};
+	friend struct ThreadBufferHandle;
+
+	ThreadBuffer& threadBuffer();
+	// folds the buffer of a thread that is exiting into retired
+	void retire(const std::shared_ptr<ThreadBuffer>& b);
+
+	const std::string& typeName(ThreadBuffer& b, const Node* n);
+	void add(ThreadBuffer& b, std::map<std::string, ProfileStats>& stats, const std::string& name,
+		const char* category, unsigned long long start, unsigned long long end,
+		unsigned long long cycleCount);
+
+	// with lock held: the stats of every buffer, summed
+	std::map<std::string, ProfileStats> merged(std::map<std::string, ProfileStats> ThreadBuffer::*stats);
+
+	std::mutex lock;  // buffers and retired
+	std::atomic<bool> tracing{false};
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	ThreadBuffer retired;
+};
+
+struct ProfileScope
+{
+	ProfileScope(const char* name, const Node* node=nullptr)
+	: name(name), node(node), start(Profiler::now()), startCycles(Profiler::cycles()) {}
+
+	~ProfileScope()
+	{
+		auto end = Profiler::now();
+		auto c = Profiler::cycles() - startCycles;
+
+		if(node)
+			Profiler::instance().recordNode(node, name, start, end, c);
+		else
+			Profiler::instance().record(name, "phase", start, end, c);
+	}
+
+private:
+	const char* name;
+	const Node* node;
+	unsigned long long start;
+	unsigned long long startCycles;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef TOYML_PROFILE
+#define PROFILE_PHASE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_NODE(name, node) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name, node)
+#else
+#define PROFILE_PHASE(name) do {} while(0)
+#define PROFILE_NODE(name, node) do {} while(0)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,99 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include "graph.h"
+#include "layers.h"
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// One LinearLayer with int8 weights. Each row has its own weight scale
+// (largest |weight| / 127), and the layer's input is quantized with a
+// single scale calibrated on sample inputs. Products and the bias are
+// accumulated in int32, then dequantized with the two scales.
+struct QuantizedLayer
+{
+	unsigned nIn = 0, nOut = 0;
+
+	std::vector<int8_t> weights;    // nOut x nIn, row-major
+	std::vector<float> rowScale;    // per output row
+	std::vector<int32_t> bias;      // in accumulator units, rowScale * inputScale
+	float inputScale = 1;
+	double (*activation)(double) = nullptr;  // nullptr for a linear layer
+
+	// y = activation(dequantize(W_q * quantize(x) + bias_q))
+	void forward(const double* x, int8_t* scratch, double* y) const;
+
+	size_t bytes() const;
+};
+
+// Post-training int8 quantization of a stack of layers, e.g. an MLP built
+// from Layer<>s and a final LinearLayer. Add the layers in the order they
+// are applied, then calibrate on a sample of typical inputs; the graph's
+// current weights are what gets quantized.
+struct QuantizedNetwork
+{
+	void addLayer(LinearLayer& l);
+
+	template<typename ActivationNodeT>
+	void addLayer(Layer<ActivationNodeT>& l)
+	{
+		addLayer(static_cast<LinearLayer&>(l));
+		pending.back().activation = [](double x) {
+			static const ActivationNodeT node;
+			double partial;
+			return node.compute(&x, &partial);
+		};
+	}
+
+	// Picks the input scale of every layer from the range of values it sees
+	// on n rows of inputs, then converts the weights to int8.
+	void calibrate(const double* inputs, unsigned n);
+	bool isCalibrated() const { return layers.size() && pending.empty(); }
+
+	unsigned inputWidth() const;
+	unsigned outputWidth() const;
+
+	// thread safe once calibrated
+	void predict(const double* in, double* out) const;
+
+	// memory taken by the quantized weights, scales and biases, and by the
+	// same layers as doubles
+	size_t bytes() const;
+	size_t doubleBytes() const;
+
+	const std::vector<QuantizedLayer>& getLayers() const { return layers; }
+
+private:
+	// a layer's weights as doubles, until calibrate()
+	struct PendingLayer
+	{
+		unsigned nIn, nOut;
+		std::vector<double> weights;  // nOut x (nIn + 1), bias last
+		double biasValue;
+		double (*activation)(double) = nullptr;
+	};
+
+	std::vector<PendingLayer> pending;
+	std::vector<QuantizedLayer> layers;
+};
+
+// How far the quantized outputs drift from the graph's, over a set of
+// inputs.
+struct QuantizationReport
+{
+	unsigned samples = 0;
+	double maxAbsError = 0;
+	double meanAbsError = 0;
+	double rmsError = 0;
+	double maxAbsOutput = 0;  // of the double model, for scale
+	size_t doubleBytes = 0;
+	size_t quantizedBytes = 0;
+
+	void write(std::ostream& out) const;
+};
+
+QuantizationReport compareQuantized(Graph& graph, const QuantizedNetwork& q, const double* inputs, unsigned n);
+
+#endif // QUANTIZE_H
@@ -0,0 +1,129 @@
+#ifndef RECURRENT_H
+#define RECURRENT_H
+
+#include "graph.h"
+#include "executioncontext.h"
+#include "layers.h"
+#include "nodeset.h"
+#include "nodetypes.h"
+
+#include <memory>
+#include <vector>
+
+// A recurrent layer h_t = cell(x_t, h_{t-1}), with h_0 = 0.
+//
+// The cell is a single graph whose inputs are the step's inputs followed
+// by the previous hidden state, compiled once and run for every step of a
+// sequence. Each step is evaluated in its own ExecutionContext, taken from
+// a ring of `window` contexts, so a step's activations stay around for
+// backprop until `window` more steps have been taken. Every step reads
+// the same params, the cell graph's.
+//
+// Training uses truncated backpropagation through time: backward() pushes
+// the gradient back through the last `window` steps at most, and the
+// hidden state carries on past that but its gradient doesn't. Memory is
+// bounded by the window, not the length of the sequence.
+struct Recurrence
+{
+	Recurrence(unsigned nInputs, unsigned nHidden, unsigned window);
+	virtual ~Recurrence() {}
+
+	unsigned inputSize() const { return nIn; }
+	unsigned hiddenSize() const { return nHidden; }
+	unsigned windowSize() const { return window; }
+
+	// the cell; its params are the layer's params
+	Graph& getCell() { return cell; }
+
+	// uniform in +-1/sqrt(fan in), so long sequences don't saturate
+	void randomizeWeights();
+
+	// back to h = 0 with nothing to backprop, to start a new sequence
+	void reset();
+
+	// Takes one step and returns h_t. Once `window` steps have been taken
+	// since the last backward(), the oldest one is dropped.
+	const std::vector<double>& step(const double* x);
+	const std::vector<double>& getHidden() const { return hidden; }
+
+	// the steps backward() would go through
+	unsigned pendingSteps() const { return pending; }
+
+	// Truncated BPTT over the pending steps: dH holds dLoss/dh for each of
+	// them (pendingSteps() rows of hiddenSize(), oldest first). Adds the
+	// gradient of every param to the cell's parameters.gradients() and
+	// leaves no steps pending.
+	void backward(const double* dH);
+
+	// Runs a sequence of T steps from h = 0 against a target hidden state
+	// per step, calling backward() every `window` steps, and returns the
+	// summed loss. Gradients are added as in backward().
+	template<typename LossT>
+	double accumulateSequence(const double* xs, const double* targets, unsigned T);
+
+	// bytes of activation state held by the window's contexts
+	size_t activationBytes() const;
+
+protected:
+	// compiles the cell and allocates the window; called by the derived
+	// class once the cell graph is complete
+	void compile();
+
+	Graph cell;
+	NodeSet<InputNode> cellInputs;  // x_t, then h_{t-1}
+
+	unsigned nIn, nHidden, window;
+	std::vector<std::unique_ptr<ExecutionContext>> contexts;
+	unsigned next = 0;     // ring slot of the next step
+	unsigned pending = 0;  // steps kept for backward()
+
+	std::vector<double> stepInput;  // x_t and h_{t-1}
+	std::vector<double> hidden;
+	std::vector<double> seed, carry;
+};
+
+// The Elman cell: h_t = act(W [x_t; h_{t-1}; 1]), a Layer<> over the
+// step's inputs and the previous hidden state.
+template<typename ActivationNodeT>
+struct RecurrentLayer : Recurrence
+{
+	RecurrentLayer(unsigned nInputs, unsigned nHidden, unsigned window = 16)
+	: Recurrence(nInputs, nHidden, window)
+	{
+		auto& layer = cell.make<Layer<ActivationNodeT>>(cellInputs.getNodes(), nHidden);
+		cell.addParamNodes(layer.getWeightNodes());
+		cell.outputNodes = layer.getOutputNodes();
+
+		compile();
+		randomizeWeights();
+	}
+};
+
+template<typename LossT>
+double Recurrence::accumulateSequence(const double* xs, const double* targets, unsigned T)
+{
+	reset();
+
+	std::vector<double> dH;
+	dH.reserve(window * nHidden);
+
+	double loss = 0;
+	for(unsigned t = 0; t < T; ++t)
+	{
+		auto& h = step(xs + t*nIn);
+		loss += LossT::loss(h.data(), targets + t*nHidden, nHidden);
+
+		auto d = LossT::derivative(h.data(), targets + t*nHidden, nHidden);
+		dH.insert(dH.end(), d.begin(), d.end());
+
+		if(pending == window || t + 1 == T)
+		{
+			backward(dH.data());
+			dH.clear();
+		}
+	}
+
+	return loss;
+}
+
+#endif // RECURRENT_H
@@ -0,0 +1,71 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+struct Node;
+struct InputNode;
+
+// The nodes of a graph in topological order, partitioned into levels.
+// Level 0 holds the input and param nodes, and every other node sits one
+// level past its deepest parent, so the nodes within a level never depend
+// on each other. Nodes that aren't reachable from the inputs or params
+// (e.g. the bias node of a LinearLayer) are treated as constants and
+// left out.
+struct Schedule
+{
+	void build(const std::vector<InputNode*> &inputs,
+		const std::vector<InputNode*> &params,
+		const std::vector<Node*> &outputs);
+
+	// true if the graph's registered nodes or any node's parents changed
+	// since the schedule was built
+	bool isStale(const std::vector<InputNode*> &inputs,
+		const std::vector<InputNode*> &params,
+		const std::vector<Node*> &outputs) const;
+
+	// heap bytes taken up by the schedule
+	size_t bytes() const;
+
+	unsigned numLevels() const { return levels.size() - 1; }
+	unsigned levelSize(unsigned l) const { return levels[l+1] - levels[l]; }
+	Node* const* levelBegin(unsigned l) const { return nodes.data() + levels[l]; }
+
+	std::vector<Node*> nodes;
+	// nodes[levels[l]] .. nodes[levels[l+1]] make up level l
+	std::vector<unsigned> levels;
+	// nonzero if the node is an output node or an ancestor of one,
+	// i.e. if it takes part in backprop
+	std::vector<char> reachesOutput;
+	// position of the node in the graph's outputNodes, or -1
+	std::vector<int> outputIndex;
+	std::unordered_map<const Node*, unsigned> indexOf;
+
+	// the edges between scheduled nodes by schedule index, in CSR form:
+	// the children of node i are childIndices[childOffsets[i] .. childOffsets[i+1]]
+	std::vector<unsigned> childOffsets, childIndices;
+	std::vector<unsigned> parentOffsets, parentIndices;
+
+	// All parents of node i in order, including constants, for evaluating
+	// nodes out of place (see ExecutionContext): argIndices[argOffsets[i] + j]
+	// is the schedule index of parent j, or -(c+1) for constants[c].
+	std::vector<unsigned> argOffsets;
+	std::vector<int> argIndices;
+	std::vector<Node*> constants;
+
+	// schedule index of each of the graph's input, param and output
+	// nodes (outputs use the argIndices encoding)
+	std::vector<unsigned> inputIndex, paramIndex;
+	std::vector<int> outputSlot;
+
+private:
+	bool built = false;
+	unsigned long version = 0;
+	std::vector<InputNode*> inputNodes;
+	std::vector<InputNode*> paramNodes;
+	std::vector<Node*> outputNodes;
+};
+
+#endif // SCHEDULE_H
@@ -0,0 +1,93 @@
+#ifndef SEGMENTED_CONTEXT_H
+#define SEGMENTED_CONTEXT_H
+
+#include "graph.h"
+
+#include <memory>
+#include <vector>
+
+// An ExecutionContext that trades recomputation for activation memory
+// (gradient checkpointing). The graph's levels are split into segments,
+// and only the values that later segments or the outputs read are kept
+// from the forward pass, plus the inputs. backProp goes through the
+// segments last to first, evaluating each one again from the kept values
+// to get its partial derivatives back. The params are read in place, so
+// they mustn't change between forwardPass and backProp.
+//
+// So instead of every node's value, partials and adjoint, the context
+// holds the kept values and one segment's worth of the rest: with
+// segments of about sqrt(depth) levels, activation memory goes from
+// O(depth) to O(sqrt(depth)) layers, for one extra forward pass.
+struct SegmentedContext
+{
+	// about sqrt(levels) segments of even depth if segments is 0
+	explicit SegmentedContext(Graph& g, unsigned segments = 0);
+	// a segment ends after the level of each of the given nodes,
+	// e.g. the outputs of chosen layers
+	SegmentedContext(Graph& g, const std::vector<Node*>& boundaries);
+
+	void setParams(const double* values) { params = values; }
+	const double* getParams() const { return params; }
+
+	const std::vector<double>& getOutputs() const { return outputs; }
+	double getOutput(unsigned i) const { return outputs.at(i); }
+
+	// derivatives from the last backProp
+	double getGradient(unsigned param) const;
+	double getInputGradient(unsigned input) const;
+	void accumulateGradients(double* grads, double scale=1) const;
+
+	const Schedule& getSchedule() const { return *schedule; }
+	unsigned numSegments() const { return segments.size() - 1; }
+	// number of values kept from the forward pass
+	unsigned numKept() const { return kept.size(); }
+
+	// bytes of activation state held by this context, and by an
+	// ExecutionContext for the same graph
+	size_t activationBytes() const;
+	size_t unsegmentedBytes() const;
+
+private:
+	friend struct Graph;
+
+	// splits at the given levels (each one starts a segment)
+	void build(std::vector<unsigned> cuts);
+	// evaluates segment k into the scratch arrays
+	void evaluate(unsigned k);
+	double slotValue(unsigned slot) const
+	{
+		return slot < nParams ? relaxedLoad(weights + slot) : kept[slot - nParams];
+	}
+
+	std::shared_ptr<const Schedule> schedule;
+	const double* params = nullptr;
+
+	// segment k is nodes segments[k] .. segments[k+1] of the schedule
+	std::vector<unsigned> segments;
+	// Slots are the values that outlive their segment: the params first,
+	// read from the params array, then the rest, in kept.
+	//
+	// per argument edge: >= 0 for a node of the same segment, relative to
+	// the segment's start, else -(slot+1)
+	std::vector<int> localArgs;
+	// per node, its slot, or -1
+	std::vector<int> slotOf;
+	std::vector<int> outputSlot;   // per graph output
+	unsigned nParams = 0;
+	unsigned constantBase = 0;     // constants[c] is slot constantBase + c
+	int resident = -1;             // the segment in the scratch arrays
+
+	const double* weights = nullptr;  // the params of the last forwardPass
+	std::vector<double> kept;         // slot s >= nParams is kept[s - nParams]
+	std::vector<double> keptAdjoints; // per slot
+
+	// one segment's worth
+	std::vector<double> values;
+	std::vector<double> partials;
+	std::vector<double> adjoints;
+
+	std::vector<double> outputs;
+	std::vector<double> args;
+};
+
+#endif // SEGMENTED_CONTEXT_H
@@ -0,0 +1,100 @@
+#ifndef SPARSE_INPUT_H
+#define SPARSE_INPUT_H
+
+#include "graph.h"
+
+#include <memory>
+#include <vector>
+
+// One input row given by its nonzeros: inputs indices[i] are values[i],
+// every other input is 0.
+struct SparseRow
+{
+	const unsigned* indices;
+	const double* values;
+	unsigned nnz;
+};
+
+// Input rows in CSR form, e.g. one-hot or bag-of-features data: row r
+// holds the nonzeros offsets[r] .. offsets[r+1].
+struct SparseRows
+{
+	explicit SparseRows(unsigned cols) : cols(cols) {}
+
+	void addRow(const unsigned* indices, const double* values, unsigned nnz);
+	// keeps the nonzeros of a dense row of cols values
+	void addDenseRow(const double* row);
+
+	unsigned rows() const { return offsets.size() - 1; }
+	SparseRow row(unsigned r) const
+	{
+		return { indices.data() + offsets[r], values.data() + offsets[r], offsets[r+1] - offsets[r] };
+	}
+
+	unsigned cols;
+	std::vector<unsigned> offsets = { 0 };
+	std::vector<unsigned> indices;
+	std::vector<double> values;
+};
+
+// An ExecutionContext for sparse input rows. The graph's inputs may only
+// feed VectorMultNodes, against params, like the inputs of a LinearLayer
+// or Layer<> do. Those first layer nodes are summed over the nonzero
+// inputs only, and backProp leaves the gradients of the weights of zero
+// inputs alone, so a row costs O(nonzeros x first layer width) there
+// rather than O(inputs x width). The rest of the graph is evaluated as
+// usual. Params are read in place, like SegmentedContext does.
+//
+// Throws from the constructor if an input feeds anything else.
+struct SparseContext
+{
+	explicit SparseContext(Graph& g);
+
+	void setParams(const double* values) { params = values; }
+	const double* getParams() const { return params; }
+
+	const std::vector<double>& getOutputs() const { return outputs; }
+	double getOutput(unsigned i) const { return outputs.at(i); }
+
+	// grads[k] += scale * d/d param k from the last backProp, touching
+	// only the params that took part in it
+	void accumulateGradients(double* grads, double scale=1) const;
+
+	const Schedule& getSchedule() const { return *schedule; }
+	// number of params read by every row, whatever its nonzeros
+	unsigned numDenseParams() const { return denseParams.size(); }
+
+private:
+	friend struct Graph;
+
+	std::shared_ptr<const Schedule> schedule;
+	const double* params = nullptr;
+	const double* weights = nullptr;  // the params of the last forwardPass
+
+	// the first layer: for input c, the nodes it feeds and the params
+	// it's multiplied with are consumers[consumerOffsets[c] ..]
+	struct Consumer { unsigned node, param; };
+	std::vector<unsigned> consumerOffsets;
+	std::vector<Consumer> consumers;
+	std::vector<char> isSparse;  // per node
+	// the argument edges of the first layer's pairs without an input,
+	// e.g. the bias times its weight
+	std::vector<unsigned> fixedOffsets, fixedEdges;
+	std::vector<unsigned> sparseNodes;
+
+	// the params that aren't only multiplied with inputs, as param indices
+	std::vector<unsigned> denseParams;
+	std::vector<int> paramOf;  // per node
+
+	std::vector<double> values;    // per node
+	std::vector<double> partials;  // per argument edge
+	std::vector<double> adjoints;  // per node
+	std::vector<double> outputs;
+	std::vector<double> args;
+
+	// the nonzeros of the last forwardPass
+	std::vector<unsigned> rowIndices;
+	std::vector<double> rowValues;
+};
+
+#endif // SPARSE_INPUT_H
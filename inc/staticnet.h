@@ -0,0 +1,236 @@
+#ifndef STATIC_NET_H
+#define STATIC_NET_H
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <tuple>
+#include <utility>
+
+// Networks whose shape is fixed at compile time, for small models where
+// a Graph's heap nodes and virtual calls cost more than the arithmetic:
+//
+//   StaticNet<StaticLayer<2, 2, SigmoidActivation>,
+//             StaticLayer<2, 1, SigmoidActivation>> xor;
+//
+// The weights and activations live in std::arrays inside the net, and
+// forward and backward are unrolled completely, so keep the layers small.
+// A net trains with any BatchOptimizer through its constructor taking a
+// net (see batchoptimizer.h); it has to stay where it is while the
+// optimizer holds it.
+
+// calls f(0) .. f(N-1), unrolled
+template<typename F, unsigned... I>
+inline void staticForImpl(F& f, std::integer_sequence<unsigned, I...>)
+{
+	(f(I), ...);
+}
+
+template<unsigned N, typename F>
+inline void staticFor(F&& f)
+{
+	staticForImpl(f, std::make_integer_sequence<unsigned, N>());
+}
+
+// Activations for StaticLayer. derivative() takes the activation's
+// output, which is what backward has at hand.
+struct IdentityActivation
+{
+	static double value(double x) { return x; }
+	static double derivative(double y) { return 1; }
+};
+
+struct SigmoidActivation
+{
+	static double value(double x) { return 1.0 / (1.0 + std::exp(-x)); }
+	static double derivative(double y) { return y * (1 - y); }
+};
+
+struct TanhActivation
+{
+	static double value(double x) { return std::tanh(x); }
+	static double derivative(double y) { return 1 - y*y; }
+};
+
+struct ReLUActivation
+{
+	static double value(double x) { return x > 0 ? x : 0; }
+	static double derivative(double y) { return y > 0 ? 1 : 0; }
+};
+
+// y = Act(W x + b). The weights are laid out like a LinearLayer's: Out
+// rows of In weights followed by the bias, so params can be copied
+// between the two.
+template<unsigned In, unsigned Out, typename Act = IdentityActivation>
+struct StaticLayer
+{
+	static constexpr unsigned inputs = In;
+	static constexpr unsigned outputs = Out;
+	static constexpr unsigned numParams = Out * (In + 1);
+
+	static void forward(const double* w, const double* x, double* y)
+	{
+		staticFor<Out>([&](unsigned o) {
+			const double* row = w + o*(In + 1);
+			double sum = row[In];
+			staticFor<In>([&](unsigned i) { sum += row[i] * x[i]; });
+			y[o] = Act::value(sum);
+		});
+	}
+
+	// Given the layer's input x, output y and dLoss/dy, adds dLoss/dw to
+	// dw and, with InputGradient, writes dLoss/dx to dx.
+	template<bool InputGradient>
+	static void backward(const double* w, const double* x, const double* y, const double* dy,
+		double* dw, double* dx)
+	{
+		if constexpr(InputGradient)
+			staticFor<In>([&](unsigned i) { dx[i] = 0; });
+
+		staticFor<Out>([&](unsigned o) {
+			const double* row = w + o*(In + 1);
+			double* drow = dw + o*(In + 1);
+			double d = dy[o] * Act::derivative(y[o]);
+
+			staticFor<In>([&](unsigned i) {
+				drow[i] += d * x[i];
+				if constexpr(InputGradient)
+					dx[i] += d * row[i];
+			});
+			drow[In] += d;
+		});
+	}
+};
+
+template<typename... Layers>
+struct StaticNet
+{
+	typedef std::tuple<Layers...> LayerTypes;
+	template<unsigned I>
+	using LayerT = typename std::tuple_element<I, LayerTypes>::type;
+
+	static constexpr unsigned numLayers = sizeof...(Layers);
+	static constexpr unsigned numInputs = LayerT<0>::inputs;
+	static constexpr unsigned numOutputs = LayerT<numLayers - 1>::outputs;
+	static constexpr unsigned numParams = (Layers::numParams + ...);
+	static constexpr unsigned numActivations = (Layers::outputs + ...);
+
+	// each layer's params and outputs start where the previous one's end
+	template<unsigned I>
+	static constexpr unsigned paramOffset()
+	{
+		if constexpr(I == 0)
+			return 0;
+		else
+			return paramOffset<I-1>() + LayerT<I-1>::numParams;
+	}
+
+	template<unsigned I>
+	static constexpr unsigned outputOffset()
+	{
+		if constexpr(I == 0)
+			return 0;
+		else
+			return outputOffset<I-1>() + LayerT<I-1>::outputs;
+	}
+
+	template<unsigned... I>
+	static constexpr bool shapesMatch(std::integer_sequence<unsigned, I...>)
+	{
+		return ((LayerT<I>::outputs == LayerT<I+1>::inputs) && ... && true);
+	}
+	static_assert(shapesMatch(std::make_integer_sequence<unsigned, numLayers - 1>()),
+		"each layer's inputs have to match the previous layer's outputs");
+
+	StaticNet()
+	{
+		params.fill(0);
+		gradients.fill(0);
+		activations.fill(0);
+	}
+
+	// uniform in [0, 1], like LinearLayer::randomizeWeights
+	void randomizeWeights()
+	{
+		for(auto& w : params)
+			w = static_cast<double>(rand()) / RAND_MAX;
+	}
+
+	// the outputs stay valid until the next forward
+	const double* forward(const double* in)
+	{
+		forwardFrom<0>(in);
+		return activations.data() + outputOffset<numLayers - 1>();
+	}
+
+	// Adds the gradient of the loss to gradients, given dLoss/dOut at the
+	// last forward, which has to have been on the same input.
+	void backward(const double* in, const double* dOut)
+	{
+		backwardFrom<numLayers - 1>(in, dOut);
+	}
+
+	// Sums LossT over n samples, laid out like a BatchOptimizer's training
+	// set; with gradients, also adds up the gradient of the sum.
+	template<typename LossT>
+	double evaluate(const double* in, const double* out, unsigned n, bool withGradients)
+	{
+		double total = 0;
+		std::array<double, numOutputs> dOut;
+
+		for(unsigned j = 0; j < n; ++j)
+		{
+			const double* x = in + j*numInputs;
+			const double* target = out + j*numOutputs;
+			const double* y = forward(x);
+
+			total += LossT::loss(y, target, numOutputs);
+			if(withGradients)
+			{
+				LossT::derivative(y, target, numOutputs, dOut.data());
+				backward(x, dOut.data());
+			}
+		}
+
+		return total;
+	}
+
+	std::array<double, numParams> params;
+	std::array<double, numParams> gradients;
+
+private:
+	template<unsigned I>
+	const double* layerInput(const double* in) const
+	{
+		if constexpr(I == 0)
+			return in;
+		else
+			return activations.data() + outputOffset<I-1>();
+	}
+
+	template<unsigned I>
+	void forwardFrom(const double* in)
+	{
+		LayerT<I>::forward(params.data() + paramOffset<I>(), layerInput<I>(in),
+			activations.data() + outputOffset<I>());
+
+		if constexpr(I + 1 < numLayers)
+			forwardFrom<I+1>(in);
+	}
+
+	template<unsigned I>
+	void backwardFrom(const double* in, const double* dy)
+	{
+		std::array<double, LayerT<I>::inputs> dx;
+
+		LayerT<I>::template backward<(I > 0)>(params.data() + paramOffset<I>(), layerInput<I>(in),
+			activations.data() + outputOffset<I>(), dy, gradients.data() + paramOffset<I>(), dx.data());
+
+		if constexpr(I > 0)
+			backwardFrom<I-1>(in, dx.data());
+	}
+
+	std::array<double, numActivations> activations;
+};
+
+#endif // STATIC_NET_H
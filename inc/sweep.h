@@ -0,0 +1,159 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "batchoptimizer.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// The hyperparameters of one trial of a Sweep. The seed is passed to
+// srand() right before the trial's graph is built, so it decides what
+// randomizeWeights() gives.
+struct TrialConfig
+{
+	unsigned seed = 0;
+	double learningRate = 0.2;
+	double learningRateDecay = 0.5;
+	unsigned decayFrequency = 100;
+	double maxGradient = -1;
+};
+
+struct TrialResult
+{
+	TrialConfig config;
+	// mean loss over the training set, as of the trial's last epoch
+	double loss = 0;
+	unsigned epochs = 0;
+	// false if the trial was dropped for a better one
+	bool survived = true;
+};
+
+// Builds one copy of the model into the graph: creates the nodes and
+// layers, randomizes them and registers them with the graph. Returns
+// whatever owns the nodes, so they live as long as the graph does.
+typedef std::function<std::shared_ptr<void>(Graph& g)> GraphBuilder;
+
+// configs for n random restarts of the same hyperparameters
+std::vector<TrialConfig> restarts(unsigned n, TrialConfig base = TrialConfig(), unsigned firstSeed = 1);
+
+// Trains independent copies of a model, one per TrialConfig, on a thread
+// pool, to get a good model despite bad initializations (e.g. the local
+// optima of XOR) or to pick hyperparameters.
+//
+// Successive halving: all trials run roundEpochs epochs, then only the
+// best keepFraction of them by training loss go on to the next round,
+// until one is left, which trains up to maxEpochs. Most of the budget
+// goes to the promising trials, so a sweep takes not much longer than a
+// single run once there are as many trials as threads. Training stops as
+// soon as a trial's loss is at most the target loss.
+template<template<typename T> class OptimT, typename LossT>
+struct Sweep
+{
+	typedef OptimT<LossT> OptimizerT;
+
+	// The builder is called for each trial in turn on this thread, since
+	// randomizeWeights uses rand(). The training set is shared by all
+	// trials and has to outlive the sweep.
+	Sweep(const GraphBuilder& build, const std::vector<TrialConfig>& configs,
+		double* in, double* out, unsigned n)
+	: setSize(n)
+	{
+		if(configs.empty())
+			throw new std::exception();
+
+		for(auto& c : configs)
+		{
+			trials.emplace_back();
+			Trial& t = trials.back();
+
+			srand(c.seed);
+			t.graph.reset(new Graph());
+			t.owner = build(*t.graph);
+
+			t.optimizer.reset(new OptimizerT(t.graph.get()));
+			t.optimizer->setLearningRate(c.learningRate);
+			t.optimizer->setLearningRateDecay(c.learningRateDecay);
+			t.optimizer->setDecayFrequency(c.decayFrequency);
+			t.optimizer->setGradientClipping(c.maxGradient);
+			t.optimizer->setTrainingSet(in, out, n);
+
+			t.result.config = c;
+		}
+	}
+
+	void setRoundEpochs(unsigned e) { roundEpochs = e ? e : 1; }
+	void setKeepFraction(double f) { keepFraction = f; }
+	void setTargetLoss(double l) { targetLoss = l; }
+
+	// Runs the sweep and returns the best trial's index; its graph holds
+	// the trained params.
+	unsigned run(ThreadPool& pool, unsigned maxEpochs)
+	{
+		std::vector<unsigned> alive;
+		for(unsigned i = 0; i < trials.size(); ++i)
+			alive.push_back(i);
+
+		unsigned done = 0;
+		while(done < maxEpochs)
+		{
+			unsigned epochs = std::min(roundEpochs, maxEpochs - done);
+
+			pool.parallelFor(alive.size(), [&](unsigned i) {
+				Trial& t = trials[alive[i]];
+				t.optimizer->runEpochs(epochs);
+				t.result.epochs = t.optimizer->getEpochs();
+				t.result.loss = t.optimizer->getLastError() / setSize;
+			});
+			done += epochs;
+
+			// diverged trials go last
+			std::sort(alive.begin(), alive.end(), [&](unsigned a, unsigned b) {
+				double la = trials[a].result.loss, lb = trials[b].result.loss;
+				if(std::isnan(la) || std::isnan(lb))
+					return !std::isnan(la) && std::isnan(lb);
+				return la < lb;
+			});
+
+			if(trials[alive[0]].result.loss <= targetLoss)
+				break;
+
+			unsigned keep = std::max(1u, (unsigned)std::ceil(alive.size() * keepFraction));
+			for(unsigned i = keep; i < alive.size(); ++i)
+				trials[alive[i]].result.survived = false;
+			alive.resize(keep);
+		}
+
+		best = alive[0];
+		return best;
+	}
+
+	unsigned getBest() { return best; }
+	unsigned numTrials() { return trials.size(); }
+	Graph& getGraph(unsigned trial) { return *trials.at(trial).graph; }
+	OptimizerT& getOptimizer(unsigned trial) { return *trials.at(trial).optimizer; }
+	const TrialResult& getResult(unsigned trial) { return trials.at(trial).result; }
+
+private:
+	struct Trial
+	{
+		std::unique_ptr<Graph> graph;
+		std::shared_ptr<void> owner;
+		std::unique_ptr<OptimizerT> optimizer;
+		TrialResult result;
+	};
+
+	std::vector<Trial> trials;
+	unsigned setSize;
+
+	unsigned roundEpochs = 1000;
+	double keepFraction = 0.5;
+	double targetLoss = 0;
+	unsigned best = 0;
+};
+
+#endif // SWEEP_H
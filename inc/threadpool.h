@@ -0,0 +1,49 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A persistent pool of worker threads. Work is handed out in rounds:
+// every call blocks until all threads (including the calling thread,
+// which takes part in the work) are done, so each call acts as a barrier.
+struct ThreadPool
+{
+	// nWorkers threads are spawned in addition to the calling thread
+	explicit ThreadPool(unsigned nWorkers = defaultWorkers());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	static unsigned defaultWorkers();
+
+	// number of threads that take part in a round (workers + caller)
+	unsigned size() { return workers.size() + 1; }
+
+	// calls f(threadIndex) once on every thread, threadIndex in [0, size())
+	void runOnAll(const std::function<void(unsigned)>& f);
+
+	// calls f(i) for every i in [0, n), handing out chunks of `grain` indices
+	void parallelFor(unsigned n, const std::function<void(unsigned)>& f, unsigned grain=1);
+
+private:
+	void workerLoop(unsigned index);
+
+	std::vector<std::thread> workers;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	const std::function<void(unsigned)>* job = nullptr;
+	unsigned long generation = 0;
+	unsigned finished = 0;
+	bool stopping = false;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,89 @@
+#ifndef VALIDATOR_H
+#define VALIDATOR_H
+
+#include "graph.h"
+#include "executioncontext.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ValidationResult
+{
+	unsigned epoch;  // the snapshot was taken after this many epochs
+	double loss;     // mean loss over the validation set
+};
+
+// Measures the loss on a held-out set in the background. submit() copies
+// the params and returns straight away; a thread of the validator then
+// evaluates the copy through its own ExecutionContext while training goes
+// on. If a snapshot is submitted before the previous one was picked up,
+// the newer one replaces it.
+//
+// The validator keeps the params of the best snapshot so far, for early
+// stopping (see BatchOptimizer::setEarlyStopping).
+struct Validator
+{
+	typedef double (*LossFunction)(const double* yout, const double* yexpected, unsigned n);
+
+	Validator(Graph& graph, LossFunction loss);
+	~Validator();
+
+	Validator(const Validator&) = delete;
+	Validator& operator=(const Validator&) = delete;
+
+	void setValidationSet(const double* in, const double* out, unsigned n);
+	// a snapshot only counts as the new best if it beats the best loss by more
+	void setMinImprovement(double delta);
+
+	// never blocks on an evaluation in progress
+	void submit(unsigned epoch, const double* params);
+	// until the last submitted snapshot has been evaluated
+	void wait();
+
+	std::vector<ValidationResult> getResults();
+	// loss of the last snapshot evaluated, 0 if none was
+	double getLastLoss();
+	unsigned long getSkipped();
+
+	// best mean loss so far, and the epoch and params it was measured at
+	double getBestLoss();
+	unsigned getBestEpoch();
+	std::vector<double> getBestParams();
+	// snapshots evaluated since the best one
+	unsigned sinceBest();
+
+private:
+	void loop();
+	double evaluate(const double* params);
+
+	Graph& graph;
+	LossFunction loss;
+	ExecutionContext ctx;
+	unsigned nParams;
+
+	const double* inputs = nullptr;
+	const double* outputs = nullptr;
+	unsigned setSize = 0;
+	double minImprovement = 0;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::vector<double> mailbox;   // the next snapshot to evaluate
+	unsigned mailboxEpoch = 0;
+	bool mailboxFull = false;
+	bool busy = false;
+	bool stopping = false;
+
+	std::vector<ValidationResult> results;
+	unsigned long skipped = 0;
+	double bestLoss = 0;
+	unsigned bestEpoch = 0;
+	unsigned bestIndex = 0;        // into results
+	std::vector<double> best;
+
+	std::thread evaluator;
+};
+
+#endif // VALIDATOR_H
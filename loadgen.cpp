@@ -0,0 +1,108 @@
+#include "inferenceserver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Load generator for server.cpp: opens `connections` connections, each
+// sending random rows back to back for the given number of seconds, then
+// prints the latency seen by the clients and the server's own stats as
+// JSON.
+//
+// usage: loadgen [socketPath] [connections] [seconds]
+
+typedef std::chrono::steady_clock loadclock;
+
+double percentile(std::vector<double>& v, double p)
+{
+    if(v.empty())
+        return 0;
+
+    unsigned k = std::min<unsigned>(v.size() - 1, p * v.size());
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/toyml.sock";
+    unsigned connections = argc > 2 ? std::atoi(argv[2]) : 8;
+    double seconds = argc > 3 ? std::atof(argv[3]) : 5;
+
+    std::vector<std::vector<double>> latencies(connections);
+    std::atomic<unsigned> failed(0);
+
+    auto start = loadclock::now();
+    auto end = start + std::chrono::duration_cast<loadclock::duration>(std::chrono::duration<double>(seconds));
+
+    std::vector<std::thread> clients;
+    for(unsigned c = 0; c < connections; ++c)
+    {
+        clients.emplace_back([&, c] {
+            try
+            {
+                InferenceClient client(path);
+
+                unsigned rng = 2654435761u * (c + 1);
+                std::vector<double> row(client.inputWidth());
+
+                while(loadclock::now() < end)
+                {
+                    for(auto& x : row)
+                    {
+                        rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+                        x = (double)rng / ~0u;
+                    }
+
+                    auto sent = loadclock::now();
+                    client.predict(row.data());
+                    latencies[c].push_back(std::chrono::duration<double>(loadclock::now() - sent).count());
+                }
+            }
+            catch(std::exception*)
+            {
+                ++failed;
+            }
+        });
+    }
+
+    for(auto& t : clients)
+        t.join();
+
+    double elapsed = std::chrono::duration<double>(loadclock::now() - start).count();
+
+    std::vector<double> all;
+    for(auto& l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+
+    if(failed == connections)
+    {
+        std::cerr << "couldn't reach a server on " << path << std::endl;
+        return 1;
+    }
+
+    InferenceClient client(path);
+    auto s = client.stats();
+
+    std::cout << "{\n"
+              << "  \"connections\": " << connections << ",\n"
+              << "  \"failed_connections\": " << failed << ",\n"
+              << "  \"requests\": " << all.size() << ",\n"
+              << "  \"requests_per_sec\": " << all.size() / elapsed << ",\n"
+              << "  \"p50_ms\": " << percentile(all, 0.5) * 1000 << ",\n"
+              << "  \"p99_ms\": " << percentile(all, 0.99) * 1000 << ",\n"
+              << "  \"server\": {\"requests\": " << s.requests
+              << ", \"batches\": " << s.batches
+              << ", \"mean_batch\": " << s.meanBatch
+              << ", \"p50_ms\": " << s.p50 * 1000
+              << ", \"p99_ms\": " << s.p99 * 1000
+              << ", \"requests_per_sec\": " << s.requestsPerSecond << "}\n"
+              << "}" << std::endl;
+
+    return 0;
+}
@@ -5,12 +5,14 @@
 #include "graph.h"
 #include "nodetypes.h"
 #include "layers.h"
+#include "profiler.h"
 
 #include <iostream>
 #include <cmath>
 #include <cstring>
 #include <cstdlib>
 #include <ctime>
+#include <fstream>
 
 int main()
 {
@@ -72,7 +74,32 @@ int main()
 
     // Train the network
     optimizer.setTrainingSet(inputValues, expectedOutputs, TRAINING_SET_SIZE);
-    optimizer.runEpochs(100000);
+
+    // XOR has no examples to spare for a held-out set, so validate on the
+    // training set, to stop once the loss has flattened out
+    optimizer.setValidationSet(inputValues, expectedOutputs, TRAINING_SET_SIZE, 1000);
+    optimizer.setEarlyStopping(5, 1e-5);
+
+    const unsigned EPOCHS = 100000;
+#ifdef TOYML_PROFILE
+    // Capture a timeline of the first epoch (open it in chrome://tracing).
+    // The others follow as usual, so the model is the same as without it.
+    Profiler::instance().startTrace();
+    optimizer.runEpochs(1);
+    Profiler::instance().stopTrace();
+    optimizer.runEpochs(EPOCHS - 1);
+#else
+    optimizer.runEpochs(EPOCHS);
+#endif
+    if(optimizer.stoppedEarly())
+        std::cout << "Stopped early, keeping the params from epoch "
+                  << optimizer.getValidator()->getBestEpoch() << std::endl;
+
+#ifdef TOYML_PROFILE
+    std::ofstream trace("toyml_trace.json");
+    Profiler::instance().writeChromeTrace(trace);
+    Profiler::instance().writeReport(std::cout);
+#endif
 
     // Test the network
     // A small percent of times (~10%), the test fails.
@@ -85,6 +112,8 @@ int main()
     // These factors combined mean that once we are in a valley with a bad local
     // optimum, and our learning rate is too small to jump out of the valley
     // we are completely trapped in the valley.
+    // Training several restarts at once with a Sweep (see sweep.h) and
+    // keeping the best one avoids it.
 
     for(int j = 0; j < 4; ++j)
     {
@@ -107,17 +107,23 @@ int main()
 
     GradientDescent<SquareLoss> optimizer(&graph);
     optimizer.setTrainingSet(inputValues, expectedOutputs, N_POINTS);
-    optimizer.setGradientClipping(500);
 
-    for(int i = 0; i < 5; i++)
+    // the model is linear in its weights, so least squares has a closed form
+    if(!optimizer.fitLeastSquares())
     {
-        optimizer.setLearningRate(0.0001);
-        int n = 2000;
-        optimizer.runEpochs(n);
-        std::cout << "\t" <<  n * (i+1) << " epochs...\n";    
+        optimizer.setGradientClipping(500);
+
+        for(int i = 0; i < 5; i++)
+        {
+            optimizer.setLearningRate(0.0001);
+            int n = 2000;
+            optimizer.runEpochs(n);
+            std::cout << "\t" <<  n * (i+1) << " epochs...\n";    
+        }
+
+        std::cout << optimizer.getLearningRate() << std::endl;
     }
 
-    std::cout << optimizer.getLearningRate() << std::endl;
     auto weights = layer.getWeightNodes();
 
     std::cout << "fit coefficients: " << std::endl;
@@ -0,0 +1,81 @@
+#include "graph.h"
+#include "nodetypes.h"
+#include "layers.h"
+#include "microbatcher.h"
+#include "inferenceserver.h"
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Serves a randomly initialized MLP (`depth` sigmoid layers of the given
+// width and one linear output) over a Unix-domain socket, coalescing
+// concurrent requests into micro-batches. Runs until SIGINT or SIGTERM,
+// then prints the serving stats as JSON. See loadgen.cpp for a client.
+//
+// usage: server [socketPath] [maxBatch] [maxDelayMs] [width] [depth]
+
+void buildModel(Graph& graph, unsigned width, unsigned depth)
+{
+    auto& inputs = graph.make<NodeSet<InputNode>>(width);
+    graph.addInputNodes(inputs.getInputs());
+
+    auto v = inputs.getNodes();
+    for(unsigned d = 0; d < depth; ++d)
+    {
+        auto& layer = graph.make<Layer<SigmoidNode>>(v, width);
+        layer.randomizeWeights();
+        graph.addParamNodes(layer.getWeightNodes());
+        v = layer.getOutputNodes();
+    }
+
+    auto& output = graph.make<LinearLayer>(v, 1);
+    output.randomizeWeights();
+    graph.addParamNodes(output.getWeightNodes());
+    graph.outputNodes = output.getOutputNodes();
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/toyml.sock";
+    unsigned maxBatch = argc > 2 ? std::atoi(argv[2]) : 32;
+    double maxDelayMs = argc > 3 ? std::atof(argv[3]) : 1;
+    unsigned width = argc > 4 ? std::atoi(argv[4]) : 16;
+    unsigned depth = argc > 5 ? std::atoi(argv[5]) : 2;
+
+    srand(1);
+
+    Graph graph;
+    buildModel(graph, width, depth);
+
+    // block the signals before any thread starts, so only sigwait sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    MicroBatcher batcher(graph, maxBatch, maxDelayMs / 1000);
+    InferenceServer server(batcher, path);
+    server.start();
+
+    std::cerr << "serving on " << path << std::endl;
+
+    int sig;
+    sigwait(&signals, &sig);
+
+    server.stop();
+
+    auto s = batcher.getStats();
+    std::cout << "{\n"
+              << "  \"requests\": " << s.requests << ",\n"
+              << "  \"batches\": " << s.batches << ",\n"
+              << "  \"mean_batch\": " << s.meanBatch << ",\n"
+              << "  \"p50_ms\": " << s.p50 * 1000 << ",\n"
+              << "  \"p99_ms\": " << s.p99 * 1000 << ",\n"
+              << "  \"requests_per_sec\": " << s.requestsPerSecond << "\n"
+              << "}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include "allreduce.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------------- Shared Memory Layout ----------------------
+// [header][channel 0][channel 1]...; channel r carries rank r -> rank r+1
+
+namespace
+{
+	const unsigned long ALIGN = 64;
+
+	struct ShmHeader
+	{
+		unsigned size;
+		unsigned capacity;
+	};
+
+	struct ShmChannel
+	{
+		alignas(64) std::atomic<unsigned long> head; // written by the sender
+		alignas(64) std::atomic<unsigned long> tail; // written by the receiver
+
+		double* items() { return reinterpret_cast<double*>(this + 1); }
+	};
+
+	unsigned long roundUp(unsigned long x) { return (x + ALIGN - 1) / ALIGN * ALIGN; }
+
+	unsigned long headerBytes() { return roundUp(sizeof(ShmHeader)); }
+
+	unsigned long channelBytes(unsigned capacity)
+	{
+		return roundUp(sizeof(ShmChannel) + capacity * sizeof(double));
+	}
+
+	unsigned long segmentBytes(unsigned size, unsigned capacity)
+	{
+		return headerBytes() + size * channelBytes(capacity);
+	}
+
+	ShmHeader* header(void* base) { return static_cast<ShmHeader*>(base); }
+
+	ShmChannel* channel(void* base, unsigned r)
+	{
+		auto p = static_cast<char*>(base) + headerBytes() + r * channelBytes(header(base)->capacity);
+		return reinterpret_cast<ShmChannel*>(p);
+	}
+
+	void* mapSegment(const std::string& name, unsigned long length, int flags)
+	{
+		int fd = shm_open(name.c_str(), flags, 0600);
+		if(fd < 0)
+		{
+			std::cout << "SharedMemoryTransport:\t couldn't open " << name << std::endl;
+			throw new std::exception();
+		}
+
+		if((flags & O_CREAT) && ftruncate(fd, length) != 0)
+		{
+			close(fd);
+			throw new std::exception();
+		}
+
+		if(!length)
+		{
+			struct stat st;
+			if(fstat(fd, &st) != 0)
+			{
+				std::cout << "SharedMemoryTransport:\t couldn't stat " << name << std::endl;
+				close(fd);
+				throw new std::exception();
+			}
+			length = st.st_size;
+		}
+
+		void* p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+
+		if(p == MAP_FAILED)
+			throw new std::exception();
+
+		return p;
+	}
+}
+
+// ---------------------- Shared Memory Transport ----------------------
+
+void SharedMemoryTransport::create(const std::string& name, unsigned size, unsigned capacity)
+{
+	if(!size || !capacity)
+		throw new std::exception();
+
+	unsigned long length = segmentBytes(size, capacity);
+	void* base = mapSegment(name, length, O_CREAT | O_EXCL | O_RDWR);
+
+	auto h = new (base) ShmHeader;
+	h->size = size;
+	h->capacity = capacity;
+
+	for(unsigned r = 0; r < size; ++r)
+	{
+		auto c = new (channel(base, r)) ShmChannel;
+		c->head = 0;
+		c->tail = 0;
+	}
+
+	munmap(base, length);
+}
+
+void SharedMemoryTransport::unlink(const std::string& name)
+{
+	shm_unlink(name.c_str());
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const std::string& name, unsigned rank)
+: myRank(rank)
+{
+	base = mapSegment(name, 0, O_RDWR);
+	length = segmentBytes(header(base)->size, header(base)->capacity);
+
+	if(rank >= size())
+		throw new std::exception();
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+	if(base)
+		munmap(base, length);
+}
+
+unsigned SharedMemoryTransport::size() { return header(base)->size; }
+unsigned SharedMemoryTransport::maxChunk() { return header(base)->capacity; }
+
+void SharedMemoryTransport::sendNext(const double* data, unsigned n)
+{
+	auto c = channel(base, myRank);
+	auto items = c->items();
+	unsigned long cap = maxChunk();
+	unsigned long head = c->head.load(std::memory_order_relaxed);
+
+	while(n)
+	{
+		unsigned long tail = c->tail.load(std::memory_order_acquire);
+		unsigned long space = cap - (head - tail);
+		if(!space)
+		{
+			sched_yield();
+			continue;
+		}
+
+		unsigned long count = std::min<unsigned long>(space, n);
+		for(unsigned long i = 0; i < count; ++i)
+			items[(head + i) % cap] = data[i];
+
+		head += count;
+		c->head.store(head, std::memory_order_release);
+
+		data += count;
+		n -= count;
+	}
+}
+
+void SharedMemoryTransport::recvPrev(double* data, unsigned n)
+{
+	auto c = channel(base, (myRank + size() - 1) % size());
+	auto items = c->items();
+	unsigned long cap = maxChunk();
+	unsigned long tail = c->tail.load(std::memory_order_relaxed);
+
+	while(n)
+	{
+		unsigned long head = c->head.load(std::memory_order_acquire);
+		unsigned long available = head - tail;
+		if(!available)
+		{
+			sched_yield();
+			continue;
+		}
+
+		unsigned long count = std::min<unsigned long>(available, n);
+		for(unsigned long i = 0; i < count; ++i)
+			data[i] = items[(tail + i) % cap];
+
+		tail += count;
+		c->tail.store(tail, std::memory_order_release);
+
+		data += count;
+		n -= count;
+	}
+}
+
+// ---------------------- Collectives ----------------------
+
+namespace
+{
+	// segment s of n elements split p ways
+	unsigned segmentBegin(unsigned n, unsigned p, unsigned s) { return (unsigned long)n * s / p; }
+
+	// Sends segment `out` while receiving segment `in` in chunks, so no
+	// more than one chunk per rank is ever waiting in a channel.
+	template<typename CombineT>
+	void exchange(Transport& t, double* data, unsigned n, unsigned out, unsigned in,
+		unsigned chunk, std::vector<double>& scratch, CombineT combine)
+	{
+		unsigned p = t.size();
+		unsigned outBegin = segmentBegin(n, p, out), outEnd = segmentBegin(n, p, out + 1);
+		unsigned inBegin = segmentBegin(n, p, in), inEnd = segmentBegin(n, p, in + 1);
+
+		while(outBegin < outEnd || inBegin < inEnd)
+		{
+			if(outBegin < outEnd)
+			{
+				unsigned count = std::min(chunk, outEnd - outBegin);
+				t.sendNext(data + outBegin, count);
+				outBegin += count;
+			}
+
+			if(inBegin < inEnd)
+			{
+				unsigned count = std::min(chunk, inEnd - inBegin);
+				t.recvPrev(scratch.data(), count);
+				combine(data + inBegin, scratch.data(), count);
+				inBegin += count;
+			}
+		}
+	}
+}
+
+void ringAllReduce(Transport& t, double* data, unsigned n, unsigned chunk)
+{
+	unsigned p = t.size();
+	unsigned r = t.rank();
+
+	if(p == 1 || !n)
+		return;
+
+	// two chunks in flight per channel must fit
+	chunk = std::max(std::min(chunk, t.maxChunk() / 2), 1u);
+
+	std::vector<double> scratch(chunk);
+
+	// reduce-scatter: after p-1 steps rank r holds the sum of segment r+1
+	for(unsigned s = 0; s + 1 < p; ++s)
+	{
+		exchange(t, data, n, (r + p - s) % p, (r + 2*p - s - 1) % p, chunk, scratch,
+			[](double* dst, const double* src, unsigned count) {
+				for(unsigned i = 0; i < count; ++i)
+					dst[i] += src[i];
+			});
+	}
+
+	// all-gather: pass the finished segments around the ring
+	for(unsigned s = 0; s + 1 < p; ++s)
+	{
+		exchange(t, data, n, (r + 1 + p - s) % p, (r + p - s) % p, chunk, scratch,
+			[](double* dst, const double* src, unsigned count) {
+				std::copy(src, src + count, dst);
+			});
+	}
+}
+
+void ringBroadcast(Transport& t, double* data, unsigned n, unsigned root, unsigned chunk)
+{
+	unsigned p = t.size();
+	unsigned r = t.rank();
+
+	if(p == 1 || !n)
+		return;
+
+	chunk = std::max(chunk, 1u);
+
+	// pipelined: each rank forwards a chunk as soon as it arrives
+	bool last = (r + 1) % p == root;
+	for(unsigned begin = 0; begin < n; begin += chunk)
+	{
+		unsigned count = std::min(chunk, n - begin);
+
+		if(r != root)
+			t.recvPrev(data + begin, count);
+
+		if(!last)
+			t.sendNext(data + begin, count);
+	}
+}
@@ -0,0 +1,220 @@
+#include "checkpoint.h"
+#include "profiler.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include <unistd.h>
+
+namespace
+{
+	const char MAGIC[8] = { 'T', 'O', 'Y', 'M', 'L', 'C', 'K', '1' };
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t epochs;
+		uint32_t decayFrequency;
+		double learningRate;
+		double learningRateDecay;
+		double lastError;
+		uint64_t nParams;
+		uint64_t nOptimizerState;
+	};
+
+	bool writeAll(FILE* f, const void* data, size_t bytes)
+	{
+		return !bytes || fwrite(data, bytes, 1, f) == 1;
+	}
+
+	bool readAll(FILE* f, void* data, size_t bytes)
+	{
+		return !bytes || fread(data, bytes, 1, f) == 1;
+	}
+}
+
+// ---------------------- Files ----------------------
+
+void saveTrainingState(const TrainingState& state, const std::string& path)
+{
+	PROFILE_PHASE("saveTrainingState");
+
+	if(state.gradients.size() != state.params.size())
+		throw new std::exception();
+
+	Header h;
+	std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+	h.epochs = state.epochs;
+	h.decayFrequency = state.decayFrequency;
+	h.learningRate = state.learningRate;
+	h.learningRateDecay = state.learningRateDecay;
+	h.lastError = state.lastError;
+	h.nParams = state.params.size();
+	h.nOptimizerState = state.optimizerState.size();
+
+	std::string tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if(!f)
+	{
+		std::cout << "saveTrainingState:\t can't open " << tmp << "." << std::endl;
+		throw new std::exception();
+	}
+
+	bool ok = writeAll(f, &h, sizeof(h))
+		&& writeAll(f, state.params.data(), state.params.size() * sizeof(double))
+		&& writeAll(f, state.gradients.data(), state.gradients.size() * sizeof(double))
+		&& writeAll(f, state.optimizerState.data(), state.optimizerState.size() * sizeof(double));
+
+	// on disk before the rename, or a crash could leave path empty
+	ok = fflush(f) == 0 && ok;
+	ok = fsync(fileno(f)) == 0 && ok;
+	ok = fclose(f) == 0 && ok;
+
+	if(!ok || std::rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		std::cout << "saveTrainingState:\t failed to write " << path << "." << std::endl;
+		std::remove(tmp.c_str());
+		throw new std::exception();
+	}
+}
+
+bool loadTrainingState(TrainingState& state, const std::string& path)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if(!f)
+		return false;
+
+	Header h;
+	bool ok = readAll(f, &h, sizeof(h)) && !std::memcmp(h.magic, MAGIC, sizeof(MAGIC));
+	if(ok)
+	{
+		state.epochs = h.epochs;
+		state.decayFrequency = h.decayFrequency;
+		state.learningRate = h.learningRate;
+		state.learningRateDecay = h.learningRateDecay;
+		state.lastError = h.lastError;
+		state.params.resize(h.nParams);
+		state.gradients.resize(h.nParams);
+		state.optimizerState.resize(h.nOptimizerState);
+
+		ok = readAll(f, state.params.data(), h.nParams * sizeof(double))
+			&& readAll(f, state.gradients.data(), h.nParams * sizeof(double))
+			&& readAll(f, state.optimizerState.data(), h.nOptimizerState * sizeof(double));
+	}
+	fclose(f);
+
+	if(!ok)
+	{
+		std::cout << "loadTrainingState:\t " << path << " isn't a valid checkpoint." << std::endl;
+		throw new std::exception();
+	}
+
+	return true;
+}
+
+// ---------------------- Checkpoint Writer ----------------------
+
+CheckpointWriter::CheckpointWriter(const std::string& path)
+: path(path)
+{
+	writer = std::thread([this] { loop(); });
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	flush();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	writer.join();
+}
+
+TrainingState& CheckpointWriter::begin()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	// whichever buffer isn't being written; a queued checkpoint in it is
+	// replaced by this one
+	int b = writing == 0 ? 1 : 0;
+	if(queued == b)
+	{
+		queued = -1;
+		++skipped;
+	}
+
+	filling = b;
+	return buffers[b];
+}
+
+void CheckpointWriter::commit()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if(filling < 0)
+			throw new std::exception();
+
+		queued = filling;
+		filling = -1;
+	}
+	changed.notify_all();
+}
+
+void CheckpointWriter::flush()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&] { return queued < 0 && writing < 0; });
+}
+
+void CheckpointWriter::loop()
+{
+	while(true)
+	{
+		int b;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [&] { return stopping || queued >= 0; });
+			if(queued < 0)
+				return;
+
+			b = writing = queued;
+			queued = -1;
+		}
+
+		bool ok = true;
+		try
+		{
+			saveTrainingState(buffers[b], path);
+		}
+		catch(std::exception* e)
+		{
+			// already reported; training goes on, and the next checkpoint may succeed
+			delete e;
+			ok = false;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			writing = -1;
+			if(ok)
+				++written;
+		}
+		changed.notify_all();
+	}
+}
+
+unsigned long CheckpointWriter::getWritten()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return written;
+}
+
+unsigned long CheckpointWriter::getSkipped()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return skipped;
+}
@@ -0,0 +1,102 @@
+#include "cholesky.h"
+#include "gemm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+	const unsigned NB = 64;
+
+	// unblocked factorization of the diagonal block at k0
+	bool factorBlock(unsigned k0, unsigned nb, double* A, unsigned lda)
+	{
+		for(unsigned j = k0; j < k0 + nb; ++j)
+		{
+			double* rj = A + j*lda;
+
+			double d = rj[j];
+			for(unsigned k = k0; k < j; ++k)
+				d -= rj[k] * rj[k];
+			if(!(d > 0))
+				return false;
+			rj[j] = std::sqrt(d);
+
+			for(unsigned i = j + 1; i < k0 + nb; ++i)
+			{
+				double* ri = A + i*lda;
+				double s = ri[j];
+				for(unsigned k = k0; k < j; ++k)
+					s -= ri[k] * rj[k];
+				ri[j] = s / rj[j];
+			}
+		}
+		return true;
+	}
+}
+
+bool cholesky(unsigned n, double* A, unsigned lda)
+{
+	std::vector<double> panel;
+
+	for(unsigned k0 = 0; k0 < n; k0 += NB)
+	{
+		unsigned nb = std::min(NB, n - k0);
+		unsigned k1 = k0 + nb;
+		unsigned m = n - k1;
+
+		if(!factorBlock(k0, nb, A, lda))
+			return false;
+		if(!m)
+			break;
+
+		// the panel below the block: P = A21 L11^-T, a row at a time
+		for(unsigned i = k1; i < n; ++i)
+		{
+			double* ri = A + i*lda;
+			for(unsigned j = k0; j < k1; ++j)
+			{
+				const double* rj = A + j*lda;
+				double s = ri[j];
+				for(unsigned k = k0; k < j; ++k)
+					s -= ri[k] * rj[k];
+				ri[j] = s / rj[j];
+			}
+		}
+
+		// A22 -= P P^T; gemm only adds, so with -P on one side
+		panel.resize(m * nb);
+		for(unsigned i = 0; i < m; ++i)
+		{
+			const double* ri = A + (k1 + i)*lda + k0;
+			for(unsigned j = 0; j < nb; ++j)
+				panel[i*nb + j] = -ri[j];
+		}
+		gemm(false, true, m, m, nb, panel.data(), nb, A + k1*lda + k0, lda, 1, A + k1*lda + k1, lda);
+	}
+
+	return true;
+}
+
+void choleskySolve(unsigned n, const double* L, unsigned lda, double* b)
+{
+	// L y = b
+	for(unsigned i = 0; i < n; ++i)
+	{
+		const double* ri = L + i*lda;
+		double s = b[i];
+		for(unsigned k = 0; k < i; ++k)
+			s -= ri[k] * b[k];
+		b[i] = s / ri[i];
+	}
+
+	// L^T x = y
+	for(unsigned i = n; i-- > 0; )
+	{
+		double s = b[i] / L[i*lda + i];
+		b[i] = s;
+		for(unsigned k = 0; k < i; ++k)
+			b[k] -= L[i*lda + k] * s;
+	}
+}
@@ -0,0 +1,401 @@
+#include "codegen.h"
+#include "nodetypes.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <typeinfo>
+#include <vector>
+
+namespace
+{
+	std::string literal(double x)
+	{
+		std::ostringstream ss;
+		ss << std::setprecision(17) << x;
+
+		auto s = ss.str();
+		if(s.find_first_of(".e") == std::string::npos)
+			s += ".0";
+
+		return x < 0 ? "(" + s + ")" : s;
+	}
+
+	// The rows of a LinearLayer: VectorMultNodes in one level sharing their
+	// inputs, with param or constant weights.
+	struct MatVec
+	{
+		unsigned level;
+		std::vector<unsigned> rows;        // schedule indices
+		std::vector<int> x;                // the shared inputs, as Schedule::argIndices
+		std::vector<unsigned> activation;  // a single-parent node per row, or empty
+		bool ordered = false;
+	};
+
+	struct Exporter
+	{
+		Exporter(Graph& g)
+		: s(g.schedule())
+		, w(g.parameters.values())
+		, paramOf(s.nodes.size(), -1)
+		, inputOf(s.nodes.size(), -1)
+		, slot(s.nodes.size(), -1)
+		, matVecOf(s.nodes.size(), -1)
+		, activationOf(s.nodes.size(), -1)
+		{
+			for(unsigned k = 0; k < s.paramIndex.size(); ++k)
+				paramOf[s.paramIndex[k]] = k;
+			for(unsigned i = 0; i < s.inputIndex.size(); ++i)
+				inputOf[s.inputIndex[i]] = i;
+		}
+
+		void write(std::ostream& out, const std::string& function);
+
+	private:
+		unsigned numArgs(unsigned i) const { return s.argOffsets[i+1] - s.argOffsets[i]; }
+		int arg(unsigned i, unsigned j) const { return s.argIndices[s.argOffsets[i] + j]; }
+		bool isWeight(int a) const { return a < 0 || paramOf[a] >= 0; }
+
+		double value(int a) const { return a < 0 ? s.constants[-a - 1]->getOutput() : w[paramOf[a]]; }
+		std::string argString(int a);
+
+		void findMatVecs();
+		void findActivations();
+		void orderRows();
+		void emitMatVec(unsigned id);
+		void emitActivation(unsigned id);
+		void emitNode(unsigned i);
+
+		const Schedule& s;
+		Span<double> w;
+
+		std::vector<int> paramOf, inputOf, slot;
+		std::vector<int> matVecOf, activationOf;
+		std::vector<MatVec> matVecs;
+
+		unsigned nSlots = 0;
+		bool usesParams = false;
+		std::ostringstream arrays, body;
+	};
+
+	std::string Exporter::argString(int a)
+	{
+		if(a < 0)
+			return literal(value(a));
+
+		if(inputOf[a] >= 0)
+			return "in[" + std::to_string(inputOf[a]) + "]";
+
+		if(paramOf[a] >= 0)
+		{
+			usesParams = true;
+			return "P[" + std::to_string(paramOf[a]) + "]";
+		}
+
+		return "v[" + std::to_string(slot[a]) + "]";
+	}
+
+	void Exporter::findMatVecs()
+	{
+		for(unsigned l = 1; l < s.numLevels(); ++l)
+		{
+			std::map<std::vector<int>, unsigned> byInputs;
+
+			for(unsigned i = s.levels[l]; i < s.levels[l+1]; ++i)
+			{
+				if(!dynamic_cast<const VectorMultNode*>(s.nodes[i]))
+					continue;
+
+				unsigned n = numArgs(i) / 2;
+				std::vector<int> x;
+				bool ok = true;
+
+				for(unsigned j = 0; j < n; ++j)
+				{
+					x.push_back(arg(i, j));
+					ok = ok && (arg(i, j) < 0 || paramOf[arg(i, j)] < 0) && isWeight(arg(i, n + j));
+				}
+
+				if(!ok || !n)
+					continue;
+
+				auto it = byInputs.find(x);
+				if(it == byInputs.end())
+				{
+					it = byInputs.emplace(x, matVecs.size()).first;
+					matVecs.emplace_back();
+					matVecs.back().level = l;
+					matVecs.back().x = x;
+				}
+
+				matVecs[it->second].rows.push_back(i);
+				matVecOf[i] = it->second;
+			}
+		}
+	}
+
+	void Exporter::findActivations()
+	{
+		for(unsigned id = 0; id < matVecs.size(); ++id)
+		{
+			auto& m = matVecs[id];
+
+			// candidates by node type, one per row
+			std::map<std::string, std::vector<int>> byType;
+			for(unsigned r = 0; r < m.rows.size(); ++r)
+			{
+				unsigned g = m.rows[r];
+				for(unsigned e = s.childOffsets[g]; e < s.childOffsets[g+1]; ++e)
+				{
+					unsigned c = s.childIndices[e];
+					if(numArgs(c) != 1 || matVecOf[c] >= 0)
+						continue;
+
+					auto& rowsOfType = byType[typeid(*s.nodes[c]).name()];
+					rowsOfType.resize(m.rows.size(), -1);
+					if(rowsOfType[r] < 0)
+						rowsOfType[r] = c;
+				}
+			}
+
+			for(auto& t : byType)
+			{
+				if(std::find(t.second.begin(), t.second.end(), -1) != t.second.end())
+					continue;
+
+				for(int c : t.second)
+				{
+					m.activation.push_back(c);
+					activationOf[c] = id;
+				}
+				break;
+			}
+		}
+	}
+
+	void Exporter::orderRows()
+	{
+		// lay out each layer's rows in the order the next layer reads them,
+		// so it can read them straight out of v
+		for(auto& next : matVecs)
+		{
+			std::vector<int> x;
+			for(int a : next.x)
+			{
+				if(a >= 0)
+					x.push_back(a);
+			}
+
+			if(x.empty())
+				continue;
+
+			bool direct = matVecOf[x[0]] >= 0;
+			int id = direct ? matVecOf[x[0]] : activationOf[x[0]];
+			if(id < 0 || matVecs[id].ordered || matVecs[id].rows.size() != x.size())
+				continue;
+
+			auto& m = matVecs[id];
+			auto& from = direct ? m.rows : m.activation;
+
+			std::vector<unsigned> perm;
+			for(int a : x)
+			{
+				auto it = std::find(from.begin(), from.end(), (unsigned)a);
+				if(it == from.end())
+					break;
+				perm.push_back(it - from.begin());
+			}
+
+			std::vector<unsigned> sorted(perm);
+			std::sort(sorted.begin(), sorted.end());
+			if(perm.size() != x.size() || std::unique(sorted.begin(), sorted.end()) != sorted.end())
+				continue;
+
+			std::vector<unsigned> rows, activation;
+			for(unsigned r : perm)
+			{
+				rows.push_back(m.rows[r]);
+				if(m.activation.size())
+					activation.push_back(m.activation[r]);
+			}
+
+			m.rows = rows;
+			m.activation = activation;
+			m.ordered = true;
+		}
+	}
+
+	void Exporter::emitMatVec(unsigned id)
+	{
+		auto& m = matVecs[id];
+		unsigned n = m.x.size();
+		unsigned rows = m.rows.size();
+		std::string W = "W" + std::to_string(id);
+
+		// transposed, so the inner loop runs over the rows
+		arrays << "\tconstexpr double " << W << "[" << n << "][" << rows << "] = {\n";
+		for(unsigned j = 0; j < n; ++j)
+		{
+			arrays << "\t\t{";
+			for(unsigned r = 0; r < rows; ++r)
+				arrays << (r ? ", " : "") << literal(value(arg(m.rows[r], n + j)));
+			arrays << "},\n";
+		}
+		arrays << "\t};\n\n";
+
+		// read the inputs in place if they're contiguous, followed by constants
+		unsigned nVar = 0;
+		while(nVar < n && m.x[nVar] >= 0)
+			++nVar;
+
+		bool fromInputs = nVar && inputOf[m.x[0]] >= 0;
+		bool inPlace = true;
+		for(unsigned j = 0; j < n; ++j)
+		{
+			int a = m.x[j];
+			if(j >= nVar)
+				inPlace = inPlace && a < 0;
+			else if(fromInputs)
+				inPlace = inPlace && inputOf[a] == inputOf[m.x[0]] + (int)j;
+			else
+				inPlace = inPlace && inputOf[a] < 0 && slot[a] == slot[m.x[0]] + (int)j;
+		}
+
+		unsigned first = nSlots;
+		for(unsigned r = 0; r < rows; ++r)
+			slot[m.rows[r]] = nSlots++;
+
+		body << "\t// " << rows << " x " << n << " layer\n";
+		body << "\t{\n";
+
+		std::string x;
+		if(inPlace && nVar)
+		{
+			x = fromInputs ? "in" : "v";
+			int offset = fromInputs ? inputOf[m.x[0]] : slot[m.x[0]];
+			if(offset)
+				x += " + " + std::to_string(offset);
+			x = "(" + x + ")";
+		}
+		else
+		{
+			nVar = n;
+			x = "x";
+			body << "\t\tconst double x[" << n << "] = { ";
+			for(unsigned j = 0; j < n; ++j)
+				body << (j ? ", " : "") << argString(m.x[j]);
+			body << " };\n";
+		}
+
+		body << "\t\tdouble* y = v + " << first << ";\n"
+		     << "\t\tfor(int o = 0; o < " << rows << "; ++o)\n"
+		     << "\t\t\ty[o] = 0.0;\n";
+
+		if(nVar)
+		{
+			body << "\t\tfor(int i = 0; i < " << nVar << "; ++i)\n"
+			     << "\t\t{\n"
+			     << "\t\t\tconst double xi = " << x << "[i];\n"
+			     << "\t\t\tfor(int o = 0; o < " << rows << "; ++o)\n"
+			     << "\t\t\t\ty[o] += " << W << "[i][o] * xi;\n"
+			     << "\t\t}\n";
+		}
+
+		for(unsigned j = nVar; j < n; ++j)
+		{
+			body << "\t\tfor(int o = 0; o < " << rows << "; ++o)\n"
+			     << "\t\t\ty[o] += " << W << "[" << j << "][o] * " << argString(m.x[j]) << ";\n";
+		}
+
+		body << "\t}\n";
+	}
+
+	void Exporter::emitActivation(unsigned id)
+	{
+		auto& m = matVecs[id];
+		unsigned rows = m.rows.size();
+
+		unsigned first = nSlots;
+		for(unsigned r = 0; r < rows; ++r)
+			slot[m.activation[r]] = nSlots++;
+
+		std::string in = "v[" + std::to_string(slot[m.rows[0]]) + " + o]";
+		body << "\tfor(int o = 0; o < " << rows << "; ++o)\n"
+		     << "\t\tv[" << first << " + o] = " << s.nodes[m.activation[0]]->expression({in}) << ";\n";
+	}
+
+	void Exporter::emitNode(unsigned i)
+	{
+		std::vector<std::string> args;
+		for(unsigned j = 0; j < numArgs(i); ++j)
+			args.push_back(argString(arg(i, j)));
+
+		auto e = s.nodes[i]->expression(args);
+		if(e.empty())
+		{
+			std::cout << "exportCpp:\t can't export a " << typeid(*s.nodes[i]).name() << std::endl;
+			throw new std::exception();
+		}
+
+		slot[i] = nSlots++;
+		body << "\tv[" << slot[i] << "] = " << e << ";\n";
+	}
+
+	void Exporter::write(std::ostream& out, const std::string& function)
+	{
+		findMatVecs();
+		findActivations();
+		orderRows();
+
+		// each level only depends on earlier ones
+		for(unsigned l = 1; l < s.numLevels(); ++l)
+		{
+			for(unsigned id = 0; id < matVecs.size(); ++id)
+			{
+				if(matVecs[id].level == l)
+					emitMatVec(id);
+				if(matVecs[id].level + 1 == l && matVecs[id].activation.size())
+					emitActivation(id);
+			}
+
+			for(unsigned i = s.levels[l]; i < s.levels[l+1]; ++i)
+			{
+				if(slot[i] < 0)
+					emitNode(i);
+			}
+		}
+
+		for(unsigned o = 0; o < s.outputSlot.size(); ++o)
+			body << "\tout[" << o << "] = " << argString(s.outputSlot[o]) << ";\n";
+
+		if(usesParams)
+		{
+			arrays << "\tconstexpr double P[" << std::max<unsigned>(w.size(), 1) << "] = { ";
+			for(unsigned k = 0; k < w.size(); ++k)
+				arrays << (k ? ", " : "") << literal(w[k]);
+			arrays << " };\n\n";
+		}
+
+		out << "// Generated by exportCpp from a graph with " << s.inputIndex.size() << " inputs, "
+		    << s.outputSlot.size() << " outputs and " << s.nodes.size() << " nodes.\n"
+		    << "// Do not edit.\n"
+		    << "#include <cmath>\n\n"
+		    << "namespace\n"
+		    << "{\n"
+		    << "\tinline double max_(double a, double b) { return b > a ? b : a; }\n\n"
+		    << arrays.str()
+		    << "}\n\n"
+		    << "void " << function << "(const double* in, double* out)\n"
+		    << "{\n"
+		    << "\tdouble v[" << std::max(nSlots, 1u) << "];\n\n"
+		    << body.str()
+		    << "}\n";
+	}
+}
+
+void exportCpp(Graph& graph, std::ostream& out, const std::string& function)
+{
+	Exporter(graph).write(out, function);
+}
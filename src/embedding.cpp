@@ -0,0 +1,81 @@
+#include "embedding.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+EmbeddingLayer::EmbeddingLayer(unsigned numRows, unsigned dim)
+: rows(numRows)
+, dim(dim)
+, table((size_t)numRows*dim, 0)
+, nodes(dim)
+, slot(numRows, NOT_TOUCHED)
+{
+	if(!numRows)
+	{
+		std::cout << "EmbeddingLayer:\t a table needs at least one row." << std::endl;
+		throw new std::exception();
+	}
+}
+
+void EmbeddingLayer::randomizeWeights()
+{
+	double range = 1 / std::sqrt(double(dim));
+
+	for(auto& x : table)
+		x = range * (2.0 * rand() / RAND_MAX - 1);
+}
+
+const double* EmbeddingLayer::lookup(unsigned r) const
+{
+	if(r >= rows)
+	{
+		std::cout << "EmbeddingLayer:\t row " << r << " of " << rows << " looked up." << std::endl;
+		throw new std::exception();
+	}
+
+	return table.data() + (size_t)r*dim;
+}
+
+double* EmbeddingLayer::touch(unsigned r)
+{
+	if(r >= rows)
+	{
+		std::cout << "EmbeddingLayer:\t row " << r << " of " << rows << " updated." << std::endl;
+		throw new std::exception();
+	}
+
+	if(slot[r] == NOT_TOUCHED)
+	{
+		slot[r] = touched.size();
+		touched.push_back(r);
+		gradients.resize(gradients.size() + dim, 0);
+	}
+
+	return gradients.data() + (size_t)slot[r]*dim;
+}
+
+void EmbeddingLayer::accumulateGradients(unsigned r, double scale)
+{
+	double* g = touch(r);
+
+	for(unsigned d = 0; d < dim; ++d)
+		g[d] += scale * nodes.at(d).getDerivative(0);
+}
+
+void EmbeddingLayer::accumulateGradients(unsigned r, const double* dRow, double scale)
+{
+	double* g = touch(r);
+
+	for(unsigned d = 0; d < dim; ++d)
+		g[d] += scale * dRow[d];
+}
+
+void EmbeddingLayer::clearGradients()
+{
+	for(auto r : touched)
+		slot[r] = NOT_TOUCHED;
+
+	touched.clear();
+	gradients.clear();
+}
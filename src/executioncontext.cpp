@@ -0,0 +1,290 @@
+#include "executioncontext.h"
+#include "nodetypes.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// ---------------------- Execution Context ----------------------
+
+ExecutionContext::ExecutionContext(Graph& g)
+: schedule(g.sharedSchedule())
+{
+	auto& s = *schedule;
+
+	values.assign(s.nodes.size(), 0);
+	adjoints.assign(s.nodes.size(), 0);
+	partials.assign(s.argIndices.size(), 0);
+	outputs.assign(s.outputSlot.size(), 0);
+
+	unsigned maxArgs = 0;
+	for(unsigned i = 0; i < s.nodes.size(); ++i)
+		maxArgs = std::max(maxArgs, s.argOffsets[i+1] - s.argOffsets[i]);
+	args.resize(maxArgs);
+}
+
+double ExecutionContext::getValue(const Node* n) const
+{
+	auto it = schedule->indexOf.find(n);
+	if(it == schedule->indexOf.end())
+	{
+		std::cout << "getValue:\t node isn't part of the graph." << std::endl;
+		throw new std::exception();
+	}
+
+	return values[it->second];
+}
+
+double ExecutionContext::getGradient(unsigned param) const
+{
+	return adjoints[schedule->paramIndex.at(param)];
+}
+
+double ExecutionContext::getInputGradient(unsigned input) const
+{
+	return adjoints[schedule->inputIndex.at(input)];
+}
+
+double ExecutionContext::getGradient(unsigned param, unsigned seed) const
+{
+	if(seed >= seeds)
+		throw new std::exception();
+	return seedAdjoints[schedule->paramIndex.at(param)*seedStride + seed];
+}
+
+double ExecutionContext::getInputGradient(unsigned input, unsigned seed) const
+{
+	if(seed >= seeds)
+		throw new std::exception();
+	return seedAdjoints[schedule->inputIndex.at(input)*seedStride + seed];
+}
+
+void ExecutionContext::accumulateGradients(double* grads, double scale) const
+{
+	auto& index = schedule->paramIndex;
+	unsigned n = index.size();
+
+	for(unsigned k = 0; k < n; ++k)
+		grads[k] += scale * adjoints[index[k]];
+}
+
+size_t ExecutionContext::activationBytes() const
+{
+	return sizeof(double) * (values.size() + partials.size() + adjoints.size() + outputs.size()
+		+ seedAdjoints.size());
+}
+
+// ---------------------- Graph ----------------------
+
+namespace
+{
+	// seeds are pushed through an edge in blocks of this many, which the
+	// compiler turns into vector instructions
+	const unsigned SEED_BLOCK = 4;
+
+	// schedule index of the first node past the inputs and params
+	unsigned firstComputed(const Schedule& s) { return s.levels.size() > 1 ? s.levels[1] : 0; }
+
+	void loadParams(const Schedule& s, const double* w, double* values)
+	{
+		for(unsigned k = 0; k < s.paramIndex.size(); ++k)
+			values[s.paramIndex[k]] = relaxedLoad(w + k);
+	}
+
+	// evaluates everything past level 0, which must already be filled in,
+	// leaving the graph's outputs in outputs
+	void evaluate(const Schedule& s, double* values, double* partials, double* args, double* outputs)
+	{
+		unsigned n = s.nodes.size();
+		for(unsigned i = firstComputed(s); i < n; ++i)
+		{
+			unsigned begin = s.argOffsets[i];
+			unsigned end = s.argOffsets[i+1];
+
+			for(unsigned e = begin; e < end; ++e)
+			{
+				int a = s.argIndices[e];
+				args[e - begin] = a >= 0 ? values[a] : s.constants[-a - 1]->getOutput();
+			}
+
+			values[i] = s.nodes[i]->compute(args, partials + begin);
+		}
+
+		for(unsigned o = 0; o < s.outputSlot.size(); ++o)
+		{
+			int a = s.outputSlot[o];
+			outputs[o] = a >= 0 ? values[a] : s.constants[-a - 1]->getOutput();
+		}
+	}
+}
+
+const std::vector<double>& Graph::forwardPass(ExecutionContext& ctx, const double* inputValues)
+{
+	PROFILE_PHASE("Graph::forwardPass(ctx)");
+
+	auto& s = *ctx.schedule;
+	double* values = ctx.values.data();
+
+	for(unsigned i = 0; i < s.inputIndex.size(); ++i)
+		values[s.inputIndex[i]] = inputValues[i];
+
+	loadParams(s, ctx.params ? ctx.params : parameters.values().data(), values);
+	evaluate(s, values, ctx.partials.data(), ctx.args.data(), ctx.outputs.data());
+
+	return ctx.outputs;
+}
+
+void Graph::forwardBatch(ExecutionContext& ctx, const double* inputValues, unsigned rows, double* outputValues)
+{
+	PROFILE_PHASE("Graph::forwardBatch(ctx)");
+
+	auto& s = *ctx.schedule;
+	double* values = ctx.values.data();
+	unsigned inW = s.inputIndex.size();
+	unsigned outW = s.outputSlot.size();
+
+	// the params are the same for every row
+	loadParams(s, ctx.params ? ctx.params : parameters.values().data(), values);
+
+	for(unsigned r = 0; r < rows; ++r)
+	{
+		for(unsigned i = 0; i < inW; ++i)
+			values[s.inputIndex[i]] = inputValues[r*inW + i];
+
+		evaluate(s, values, ctx.partials.data(), ctx.args.data(), outputValues + r*outW);
+	}
+
+	if(rows)
+		std::copy(outputValues + (rows-1)*outW, outputValues + rows*outW, ctx.outputs.begin());
+}
+
+void Graph::backProp(ExecutionContext& ctx, const double *baseDeriv, unsigned n)
+{
+	PROFILE_PHASE("Graph::backProp(ctx)");
+
+	auto& s = *ctx.schedule;
+	if(n != s.outputSlot.size())
+		throw new std::exception();
+
+	double* adjoints = ctx.adjoints.data();
+	const double* partials = ctx.partials.data();
+	std::fill(ctx.adjoints.begin(), ctx.adjoints.end(), 0);
+
+	for(unsigned o = 0; o < n; ++o)
+	{
+		if(s.outputSlot[o] >= 0)
+			adjoints[s.outputSlot[o]] += baseDeriv[o];
+	}
+
+	// push each node's adjoint to its parents, last node first
+	for(unsigned i = s.nodes.size(); i-- > firstComputed(s); )
+	{
+		double a = adjoints[i];
+		if(a == 0)
+			continue;
+
+		for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+		{
+			int p = s.argIndices[e];
+			if(p >= 0)
+				adjoints[p] += a * partials[e];
+		}
+	}
+}
+
+void Graph::backProp(ExecutionContext& ctx, const std::vector<double>& baseDeriv)
+{
+	backProp(ctx, baseDeriv.data(), baseDeriv.size());
+}
+
+void Graph::backProp(ExecutionContext& ctx, const double *seeds, unsigned n, unsigned k)
+{
+	PROFILE_PHASE("Graph::backProp(ctx, seeds)");
+
+	auto& s = *ctx.schedule;
+	if(n != s.outputSlot.size() || !k)
+		throw new std::exception();
+
+	// a row of adjoints per node, so each edge is one pass over the seeds;
+	// the padding seeds stay 0
+	unsigned stride = (k + SEED_BLOCK - 1) / SEED_BLOCK * SEED_BLOCK;
+	ctx.seeds = k;
+	ctx.seedStride = stride;
+	ctx.seedAdjoints.assign(s.nodes.size() * stride, 0);
+	double* adjoints = ctx.seedAdjoints.data();
+	const double* partials = ctx.partials.data();
+
+	for(unsigned o = 0; o < n; ++o)
+	{
+		if(s.outputSlot[o] < 0)
+			continue;
+
+		double* a = adjoints + s.outputSlot[o]*stride;
+		for(unsigned j = 0; j < k; ++j)
+			a[j] += seeds[j*n + o];
+	}
+
+	for(unsigned i = s.nodes.size(); i-- > firstComputed(s); )
+	{
+		if(!s.reachesOutput[i])
+			continue;
+
+		const double* a = adjoints + i*stride;
+		for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+		{
+			int p = s.argIndices[e];
+			if(p < 0)
+				continue;
+
+			double d = partials[e];
+			double* ap = adjoints + p*stride;
+			for(unsigned j = 0; j < stride; j += SEED_BLOCK)
+			{
+				// all loads before the stores, since a node is never its own parent
+				double v[SEED_BLOCK];
+				for(unsigned l = 0; l < SEED_BLOCK; ++l)
+					v[l] = ap[j + l] + d * a[j + l];
+				for(unsigned l = 0; l < SEED_BLOCK; ++l)
+					ap[j + l] = v[l];
+			}
+		}
+	}
+}
+
+void Graph::jacobian(ExecutionContext& ctx, const double* inputValues, Jacobian& J)
+{
+	PROFILE_PHASE("Graph::jacobian");
+
+	auto& s = *ctx.schedule;
+	unsigned nOut = s.outputSlot.size();
+	unsigned nIn = s.inputIndex.size();
+	unsigned nParams = s.paramIndex.size();
+
+	forwardPass(ctx, inputValues);
+
+	std::vector<double> identity(nOut * nOut, 0);
+	for(unsigned o = 0; o < nOut; ++o)
+		identity[o*nOut + o] = 1;
+	backProp(ctx, identity.data(), nOut, nOut);
+
+	J.numOutputs = nOut;
+	J.numInputs = nIn;
+	J.numParams = nParams;
+	J.dInputs.resize(nOut * nIn);
+	J.dParams.resize(nOut * nParams);
+
+	const double* adjoints = ctx.seedAdjoints.data();
+	unsigned stride = ctx.seedStride;
+	for(unsigned i = 0; i < nIn; ++i)
+	{
+		const double* a = adjoints + s.inputIndex[i]*stride;
+		for(unsigned o = 0; o < nOut; ++o)
+			J.dInputs[o*nIn + i] = a[o];
+	}
+	for(unsigned k = 0; k < nParams; ++k)
+	{
+		const double* a = adjoints + s.paramIndex[k]*stride;
+		for(unsigned o = 0; o < nOut; ++o)
+			J.dParams[o*nParams + k] = a[o];
+	}
+}
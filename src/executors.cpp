@@ -0,0 +1,265 @@
+#include "executors.h"
+#include "profiler.h"
+
+WavefrontExecutor::WavefrontExecutor(ThreadPool& pool, unsigned minParallelLevel, unsigned grain)
+: pool(pool)
+, minParallelLevel(minParallelLevel)
+, grain(grain)
+{}
+
+template<typename VisitT>
+void WavefrontExecutor::runLevel(const Schedule& s, unsigned l, VisitT visit)
+{
+	unsigned begin = s.levels[l];
+	unsigned size = s.levelSize(l);
+
+	if(size < minParallelLevel || pool.size() == 1)
+	{
+		for(unsigned i = 0; i < size; ++i)
+			visit(begin + i);
+	}
+	else
+	{
+		pool.parallelFor(size, [&](unsigned i) { visit(begin + i); }, grain);
+	}
+}
+
+void WavefrontExecutor::forward(Graph& g)
+{
+	auto& s = g.schedule();
+
+	for(unsigned l = 0; l < s.numLevels(); ++l)
+	{
+		runLevel(s, l, [&](unsigned i) {
+			auto n = s.nodes[i];
+			PROFILE_NODE("forward", n);
+			n->forward();
+			n->executed = true;
+		});
+	}
+}
+
+void WavefrontExecutor::backward(Graph& g, const double *baseDeriv, unsigned n)
+{
+	auto& s = g.schedule();
+
+	for(unsigned l = s.numLevels(); l-- > 0; )
+	{
+		runLevel(s, l, [&](unsigned i) {
+			auto node = s.nodes[i];
+
+			if(!s.reachesOutput[i])
+			{
+				node->zeroDerivatives();
+				node->derivated = false;
+				return;
+			}
+
+			PROFILE_NODE("computeDerivatives", node);
+			int o = s.outputIndex[i];
+			if(o >= 0)
+				node->computeDerivatives(baseDeriv[o]);
+			else
+				node->computeDerivatives();
+
+			node->derivated = true;
+		});
+	}
+}
+
+// ---------------------- Work Stealing Deque ----------------------
+
+WorkStealingDeque::WorkStealingDeque(unsigned capacity)
+: top(0)
+, bottom(0)
+, items(capacity)
+, mask(capacity - 1)
+{}
+
+void WorkStealingDeque::push(unsigned x)
+{
+	long b = bottom.load(std::memory_order_relaxed);
+	items[b & mask].store(x, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+bool WorkStealingDeque::pop(unsigned& x)
+{
+	long b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long t = top.load(std::memory_order_relaxed);
+
+	if(t > b)
+	{
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return false;
+	}
+
+	x = items[b & mask].load(std::memory_order_relaxed);
+	if(t == b)
+	{
+		// last item, race the thieves for it
+		bool won = top.compare_exchange_strong(t, t + 1,
+			std::memory_order_seq_cst, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return won;
+	}
+
+	return true;
+}
+
+bool WorkStealingDeque::steal(unsigned& x)
+{
+	long t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long b = bottom.load(std::memory_order_acquire);
+
+	if(t >= b)
+		return false;
+
+	x = items[t & mask].load(std::memory_order_relaxed);
+	return top.compare_exchange_strong(t, t + 1,
+		std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+// ---------------------- Work Stealing Executor ----------------------
+
+WorkStealingExecutor::WorkStealingExecutor(ThreadPool& pool)
+: pool(pool)
+{}
+
+void WorkStealingExecutor::prepare(const Schedule& s)
+{
+	// every node is pushed at most once per sweep, so a deque never
+	// holds more than all of them
+	unsigned needed = 1;
+	while(needed < s.nodes.size())
+		needed *= 2;
+
+	if(needed != capacity || deques.size() != pool.size())
+	{
+		capacity = needed;
+		deques.clear();
+		for(unsigned t = 0; t < pool.size(); ++t)
+			deques.emplace_back(new WorkStealingDeque(capacity));
+
+		pending.reset(new std::atomic<int>[capacity]);
+	}
+}
+
+template<typename VisitT>
+void WorkStealingExecutor::run(const std::vector<unsigned>& ready, unsigned total,
+	const std::vector<unsigned>& offsets, const std::vector<unsigned>& indices,
+	VisitT visit)
+{
+	unsigned nThreads = deques.size();
+
+	for(auto& d : deques)
+		d->clear();
+
+	for(unsigned i = 0; i < ready.size(); ++i)
+		deques[i % nThreads]->push(ready[i]);
+
+	std::atomic<unsigned> remaining(total);
+
+	pool.runOnAll([&](unsigned t) {
+		auto& own = *deques[t];
+		unsigned rng = t * 2654435761u + 1;
+		unsigned x;
+
+		while(remaining.load(std::memory_order_acquire))
+		{
+			if(!own.pop(x))
+			{
+				bool stolen = false;
+				for(unsigned attempt = 0; attempt < nThreads && !stolen; ++attempt)
+				{
+					rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+					unsigned victim = rng % nThreads;
+					stolen = victim != t && deques[victim]->steal(x);
+				}
+
+				if(!stolen)
+				{
+					std::this_thread::yield();
+					continue;
+				}
+			}
+
+			visit(x);
+
+			for(unsigned k = offsets[x]; k < offsets[x+1]; ++k)
+			{
+				unsigned c = indices[k];
+				if(pending[c].fetch_sub(1, std::memory_order_acq_rel) == 1)
+					own.push(c);
+			}
+
+			remaining.fetch_sub(1, std::memory_order_release);
+		}
+	});
+}
+
+void WorkStealingExecutor::forward(Graph& g)
+{
+	auto& s = g.schedule();
+	prepare(s);
+
+	ready.clear();
+	for(unsigned i = 0; i < s.nodes.size(); ++i)
+	{
+		int waiting = s.parentOffsets[i+1] - s.parentOffsets[i];
+		pending[i].store(waiting, std::memory_order_relaxed);
+		if(!waiting)
+			ready.push_back(i);
+	}
+
+	run(ready, s.nodes.size(), s.childOffsets, s.childIndices, [&](unsigned i) {
+		auto n = s.nodes[i];
+		PROFILE_NODE("forward", n);
+		n->forward();
+		n->executed = true;
+	});
+}
+
+void WorkStealingExecutor::backward(Graph& g, const double *baseDeriv, unsigned n)
+{
+	auto& s = g.schedule();
+	prepare(s);
+
+	ready.clear();
+	unsigned total = 0;
+	for(unsigned i = 0; i < s.nodes.size(); ++i)
+	{
+		s.nodes[i]->derivated = false;
+		if(!s.reachesOutput[i])
+		{
+			s.nodes[i]->zeroDerivatives();
+			continue;
+		}
+
+		int waiting = 0;
+		for(unsigned k = s.childOffsets[i]; k < s.childOffsets[i+1]; ++k)
+			waiting += s.reachesOutput[s.childIndices[k]];
+
+		pending[i].store(waiting, std::memory_order_relaxed);
+		if(!waiting)
+			ready.push_back(i);
+		total++;
+	}
+
+	run(ready, total, s.parentOffsets, s.parentIndices, [&](unsigned i) {
+		auto node = s.nodes[i];
+		PROFILE_NODE("computeDerivatives", node);
+
+		int o = s.outputIndex[i];
+		if(o >= 0)
+			node->computeDerivatives(baseDeriv[o]);
+		else
+			node->computeDerivatives();
+
+		node->derivated = true;
+	});
+}
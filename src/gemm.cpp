@@ -0,0 +1,89 @@
+#include "gemm.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+	// a KC x NC panel of B is 256KB
+	const unsigned KC = 128;
+	const unsigned NC = 256;
+
+	void scale(unsigned M, unsigned N, double beta, double* C, unsigned ldc)
+	{
+		for(unsigned i = 0; i < M; ++i)
+		{
+			double* c = C + i*ldc;
+			if(beta == 0)
+				std::fill(c, c + N, 0.0);
+			else if(beta != 1)
+			{
+				for(unsigned j = 0; j < N; ++j)
+					c[j] *= beta;
+			}
+		}
+	}
+}
+
+void gemm(bool transA, bool transB, unsigned M, unsigned N, unsigned K,
+	const double* A, unsigned lda, const double* B, unsigned ldb,
+	double beta, double* C, unsigned ldc)
+{
+	scale(M, N, beta, C, ldc);
+
+	// with transB, each panel of op(B) is copied out of B's columns first,
+	// so the loop below reads it by rows either way
+	std::vector<double> packed;
+	if(transB)
+		packed.resize(std::min(K, KC) * std::min(N, NC));
+
+	// C[i][j0..j1] += A(i,k) * op(B)[k][j0..j1], one panel of op(B) at a time
+	for(unsigned j0 = 0; j0 < N; j0 += NC)
+	{
+		unsigned j1 = std::min(N, j0 + NC);
+		unsigned nc = j1 - j0;
+
+		for(unsigned k0 = 0; k0 < K; k0 += KC)
+		{
+			unsigned k1 = std::min(K, k0 + KC);
+
+			if(transB)
+			{
+				for(unsigned j = j0; j < j1; ++j)
+				{
+					const double* b = B + j*ldb;
+					for(unsigned k = k0; k < k1; ++k)
+						packed[(k - k0)*nc + j - j0] = b[k];
+				}
+			}
+
+			auto row = [&](unsigned k) {
+				return transB ? &packed[(k - k0)*nc] : B + k*ldb + j0;
+			};
+
+			for(unsigned i = 0; i < M; ++i)
+			{
+				double* c = C + i*ldc + j0;
+				auto a = [&](unsigned k) { return transA ? A[k*lda + i] : A[i*lda + k]; };
+
+				// four rows of op(B) per pass over c, so c is loaded and
+				// stored a quarter as often
+				unsigned k = k0;
+				for(; k + 4 <= k1; k += 4)
+				{
+					double a0 = a(k), a1 = a(k + 1), a2 = a(k + 2), a3 = a(k + 3);
+					const double *b0 = row(k), *b1 = row(k + 1), *b2 = row(k + 2), *b3 = row(k + 3);
+					for(unsigned j = 0; j < nc; ++j)
+						c[j] += a0 * b0[j] + a1 * b1[j] + a2 * b2[j] + a3 * b3[j];
+				}
+				for(; k < k1; ++k)
+				{
+					double a0 = a(k);
+					const double* b0 = row(k);
+					for(unsigned j = 0; j < nc; ++j)
+						c[j] += a0 * b0[j];
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
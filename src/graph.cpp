@@ -1,5 +1,6 @@
 #include "graph.h"
 #include "nodetypes.h"
+#include "profiler.h"
 
 #include <algorithm>
 #include <iostream>
@@ -16,6 +17,21 @@ T takeFirst(std::vector<T> &v)
 
 // Node implementations
 
+std::atomic<unsigned long> Node::topologyVersion{0};
+
+void Node::forward()
+{
+	thread_local std::vector<double> in;
+
+	unsigned n = parents.size();
+	in.resize(n);
+	for(unsigned i = 0; i < n; ++i)
+		in[i] = parents[i]->getOutput();
+
+	partialDerivatives.resize(n);
+	output = compute(in.data(), partialDerivatives.data());
+}
+
 double Node::getOutput() { return output; }
 double Node::getDerivative(int index) { return derivatives.at(index); }
 double Node::getDerivative(Node* n)
@@ -50,6 +66,21 @@ void Node::computeDerivatives(double L)
 		derivatives.at(i) = L * partialDerivatives.at(i);
 }
 
+void Node::zeroDerivatives()
+{
+	derivatives.assign(std::max<size_t>(partialDerivatives.size(), 1), 0);
+}
+
+size_t Node::edgeBytes() const
+{
+	return (parents.capacity() + children.capacity()) * sizeof(Node*);
+}
+
+size_t Node::derivativeBytes() const
+{
+	return (derivatives.capacity() + partialDerivatives.capacity()) * sizeof(double);
+}
+
 bool Node::isReadyForward()
 {
 	bool ready = true;
@@ -89,6 +120,7 @@ void Node::setParent(Node* n)
 	n->children.push_back(this);
 
 	partialDerivatives.resize(parents.size());
+	topologyVersion++;
 }
 
 void Node::setParents(const std::vector<Node*> &parentV)
@@ -111,6 +143,16 @@ void Node::setParents(const std::vector<Node*> &parentV)
 	}
 
 	partialDerivatives.resize(parents.size());	
+	topologyVersion++;
+}
+
+void Node::addParent(Node* n)
+{
+	parents.push_back(n);
+	n->children.push_back(this);
+
+	partialDerivatives.resize(parents.size());
+	topologyVersion++;
 }
 
 bool nodeReadyFwd(Node* a, Node* b) { return a->isReadyForward() && !b->isReadyForward(); }
@@ -150,14 +192,12 @@ void Graph::addInputNodes(const std::vector<InputNode*> &inputs)
 
 void Graph::addParamNodes(const std::vector<InputNode*> &params)
 {
-	paramNodes.reserve(paramNodes.size() + params.size());
-	for(auto n : params)
-	{
-		if(!n)
-			throw new std::exception();
+	// paramNodes only changes once the store has taken the nodes
+	auto all = paramNodes;
+	all.insert(all.end(), params.begin(), params.end());
 
-		paramNodes.push_back(n);
-	}
+	parameters.bind(all);
+	paramNodes = std::move(all);
 }
 
 void copyValuesToInputNodes(const std::vector<double> &values, std::vector<InputNode*> &nodes)
@@ -188,20 +228,19 @@ void Graph::setInputs(const double* values, unsigned n)
 	copyValuesToInputNodes(values, n, inputNodes);
 }
 
-void Graph::setParams(const std::vector<double> &values)
+void Graph::bindParameters()
 {
-	copyValuesToInputNodes(values, paramNodes);
+	if(!parameters.isBoundTo(paramNodes))
+		parameters.bind(paramNodes);
 }
 
-
-void Graph::updateParams(std::function<double(double,double)> update )
+void Graph::setParams(const std::vector<double> &values)
 {
-	for(auto node : paramNodes)
-	{
-		double w = node->getInput();
-		double deriv = node->getDerivative(0);
-		node->setInput(update(w, deriv));
-	}
+	bindParameters();
+	auto w = parameters.values();
+	unsigned n = std::min<size_t>(w.size(), values.size());
+
+	std::copy(values.begin(), values.begin() + n, w.begin());
 }
 
 double Graph::getOutput(int i)
@@ -211,6 +250,14 @@ double Graph::getOutput(int i)
 
 void Graph::traverse()
 {
+	PROFILE_PHASE("Graph::traverse");
+
+	if(executor)
+	{
+		executor->forward(*this);
+		return;
+	}
+
 	setGraphUnexecuted();
 
 	std::vector<Node*> q;
@@ -228,6 +275,7 @@ void Graph::traverse()
 		{
 			if(n->isReadyForward())
 			{
+				PROFILE_NODE("forward", n);
 				n->forward();
 				n->executed = true;
 				for(auto c : n->children)
@@ -256,6 +304,13 @@ void Graph::backProp(const double *baseDeriv, unsigned n)
 	if(n != outputNodes.size())
 		throw new std::exception();
 
+	PROFILE_PHASE("Graph::backProp");
+
+	if(executor)
+	{
+		executor->backward(*this, baseDeriv, n);
+		return;
+	}
 
 	setGraphUnderivated();	
 	std::vector<Node*> q;
@@ -264,6 +319,7 @@ void Graph::backProp(const double *baseDeriv, unsigned n)
 	// do the output layer explicitly
 	for(auto oNode : outputNodes)
 	{
+		PROFILE_NODE("computeDerivatives", oNode);
 		oNode->computeDerivatives(baseDeriv[i++]);
 		oNode->derivated = true;
 		for(auto p : oNode->parents)
@@ -276,8 +332,13 @@ void Graph::backProp(const double *baseDeriv, unsigned n)
 	{
 		auto n = takeFirst(q);
 
+		// nodes with several children get queued once per child
+		if(n->derivated)
+			continue;
+
 		if(n->isReadyBackward())
 		{
+			PROFILE_NODE("computeDerivatives", n);
 			n->computeDerivatives();
 			n->derivated = true;
 			for(auto p : n->parents)
@@ -367,21 +428,41 @@ void Graph::traverseNodes( std::function<void(Node*)> visit )
 
 void Graph::setGraphUnexecuted()
 {
-	traverseNodes(
-		[](Node* n) 
-		{
-			n->executed = false;
-		}
-	);
+	PROFILE_PHASE("Graph::setGraphUnexecuted");
+
+	for(auto n : schedule().nodes)
+		n->executed = false;
 }
 
 void Graph::setGraphUnderivated()
 {
-	traverseNodes(
-		[](Node* n) 
-		{
-			n->derivated = false;
-		}
-	);		
+	PROFILE_PHASE("Graph::setGraphUnderivated");
+
+	auto& s = schedule();
+	for(unsigned i = 0; i < s.nodes.size(); ++i)
+	{
+		s.nodes[i]->derivated = false;
+		if(!s.reachesOutput[i])
+			s.nodes[i]->zeroDerivatives();
+	}
+}
+
+const Schedule& Graph::schedule()
+{
+	return *sharedSchedule();
+}
+
+std::shared_ptr<const Schedule> Graph::sharedSchedule()
+{
+	// contexts may still hold on to the old schedule, so build a new one
+	if(!compiled || compiled->isStale(inputNodes, paramNodes, outputNodes))
+	{
+		bindParameters();
+		auto s = std::make_shared<Schedule>();
+		s->build(inputNodes, paramNodes, outputNodes);
+		compiled = s;
+	}
+
+	return compiled;
 }
 
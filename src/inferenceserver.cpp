@@ -0,0 +1,286 @@
+#include "inferenceserver.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ---------------------- Socket IO ----------------------
+
+namespace
+{
+	bool readAll(int fd, void* data, size_t n)
+	{
+		char* p = static_cast<char*>(data);
+		while(n)
+		{
+			ssize_t got = recv(fd, p, n, 0);
+			if(got <= 0)
+				return false;
+			p += got;
+			n -= got;
+		}
+		return true;
+	}
+
+	bool writeAll(int fd, const void* data, size_t n)
+	{
+		const char* p = static_cast<const char*>(data);
+		while(n)
+		{
+			ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+			if(sent <= 0)
+				return false;
+			p += sent;
+			n -= sent;
+		}
+		return true;
+	}
+
+	bool writeMessage(int fd, const double* data, unsigned n)
+	{
+		return writeAll(fd, &n, sizeof(n)) && writeAll(fd, data, n * sizeof(double));
+	}
+
+	sockaddr_un socketAddress(const std::string& path)
+	{
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+
+		if(path.size() >= sizeof(addr.sun_path))
+		{
+			std::cout << "InferenceServer:\t socket path too long: " << path << std::endl;
+			throw new std::exception();
+		}
+
+		std::strcpy(addr.sun_path, path.c_str());
+		return addr;
+	}
+
+	// the largest request a client may send
+	const unsigned MAX_VALUES = 1 << 20;
+}
+
+// ---------------------- Inference Server ----------------------
+
+InferenceServer::InferenceServer(MicroBatcher& batcher, const std::string& path)
+: batcher(batcher)
+, path(path)
+{}
+
+InferenceServer::~InferenceServer()
+{
+	stop();
+}
+
+void InferenceServer::start()
+{
+	auto addr = socketAddress(path);
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(listenFd < 0)
+		throw new std::exception();
+
+	::unlink(path.c_str());
+	if(bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 64) != 0)
+	{
+		std::cout << "InferenceServer:\t couldn't listen on " << path << std::endl;
+		close(listenFd);
+		listenFd = -1;
+		throw new std::exception();
+	}
+
+	stopping = false;
+	acceptor = std::thread([this] { acceptLoop(); });
+}
+
+void InferenceServer::stop()
+{
+	if(listenFd < 0)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+
+		// wakes up accept() and every blocked recv()
+		shutdown(listenFd, SHUT_RDWR);
+		for(int fd : connections)
+			shutdown(fd, SHUT_RDWR);
+	}
+
+	acceptor.join();
+	for(auto& h : handlers)
+		h.join();
+	handlers.clear();
+	finished.clear();
+
+	close(listenFd);
+	listenFd = -1;
+	::unlink(path.c_str());
+}
+
+void InferenceServer::acceptLoop()
+{
+	while(true)
+	{
+		int fd = accept(listenFd, nullptr, nullptr);
+		int error = errno;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if(stopping)
+			{
+				if(fd >= 0)
+					close(fd);
+				return;
+			}
+
+			reapHandlers();
+
+			if(fd >= 0)
+			{
+				connections.push_back(fd);
+				handlers.emplace_back([this, fd] { serve(fd); });
+				continue;
+			}
+		}
+
+		if(error == EINTR || error == ECONNABORTED)
+			continue;
+
+		// e.g. out of fds: wait for connections to close rather than spin
+		std::cout << "InferenceServer:\t accept failed: " << std::strerror(error) << std::endl;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+}
+
+void InferenceServer::reapHandlers()
+{
+	for(auto id : finished)
+	{
+		auto it = std::find_if(handlers.begin(), handlers.end(),
+			[id](const std::thread& t) { return t.get_id() == id; });
+
+		// the handler is past its last use of the lock, so this is quick
+		it->join();
+		handlers.erase(it);
+	}
+	finished.clear();
+}
+
+void InferenceServer::serve(int fd)
+{
+	std::vector<double> values;
+
+	while(true)
+	{
+		unsigned header[2];
+		if(!readAll(fd, header, sizeof(header)) || header[1] > MAX_VALUES)
+			break;
+
+		values.resize(header[1]);
+		if(!readAll(fd, values.data(), values.size() * sizeof(double)))
+			break;
+
+		std::vector<double> reply;
+		if(header[0] == PREDICT && values.size() == batcher.inputWidth())
+		{
+			reply = batcher.submit(values.data()).get();
+		}
+		else if(header[0] == SHAPE)
+		{
+			reply = { (double)batcher.inputWidth(), (double)batcher.outputWidth() };
+		}
+		else if(header[0] == STATS)
+		{
+			auto s = batcher.getStats();
+			reply = { (double)s.requests, (double)s.batches, s.meanBatch, s.p50, s.p99, s.requestsPerSecond };
+		}
+
+		if(!writeMessage(fd, reply.data(), reply.size()))
+			break;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	connections.erase(std::find(connections.begin(), connections.end(), fd));
+	close(fd);
+	finished.push_back(std::this_thread::get_id());
+}
+
+// ---------------------- Inference Client ----------------------
+
+InferenceClient::InferenceClient(const std::string& path)
+{
+	auto addr = socketAddress(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		std::cout << "InferenceClient:\t couldn't connect to " << path << std::endl;
+		if(fd >= 0)
+			close(fd);
+		throw new std::exception();
+	}
+
+	auto shape = call(InferenceServer::SHAPE, nullptr, 0);
+	if(shape.size() != 2)
+		throw new std::exception();
+
+	inW = shape[0];
+	outW = shape[1];
+}
+
+InferenceClient::~InferenceClient()
+{
+	if(fd >= 0)
+		close(fd);
+}
+
+std::vector<double> InferenceClient::predict(const double* inputs)
+{
+	auto out = call(InferenceServer::PREDICT, inputs, inW);
+	if(out.size() != outW)
+		throw new std::exception();
+
+	return out;
+}
+
+ServingStats InferenceClient::stats()
+{
+	auto v = call(InferenceServer::STATS, nullptr, 0);
+	if(v.size() != 6)
+		throw new std::exception();
+
+	ServingStats s;
+	s.requests = v[0];
+	s.batches = v[1];
+	s.meanBatch = v[2];
+	s.p50 = v[3];
+	s.p99 = v[4];
+	s.requestsPerSecond = v[5];
+	return s;
+}
+
+std::vector<double> InferenceClient::call(unsigned kind, const double* data, unsigned n)
+{
+	unsigned header[2] = { kind, n };
+	if(!writeAll(fd, header, sizeof(header)) || !writeAll(fd, data, n * sizeof(double)))
+		throw new std::exception();
+
+	unsigned m;
+	if(!readAll(fd, &m, sizeof(m)) || m > MAX_VALUES)
+		throw new std::exception();
+
+	std::vector<double> reply(m);
+	if(!readAll(fd, reply.data(), m * sizeof(double)))
+		throw new std::exception();
+
+	return reply;
+}
@@ -1,5 +1,8 @@
 
 #include "layers.h"
+#include "gemm.h"
+#include <algorithm>
+#include <cmath>
 #include <exception>
 #include <iostream>
 
@@ -17,15 +20,8 @@ LinearLayer::LinearLayer(const std::vector<Node*>& inputs, size_t nOutputs)
 
 	vectorNodes = std::shared_ptr<VectorMultNode[]>(new VectorMultNode[nOutputs]);
 
-	unsigned cols = numInputs;
-	for(unsigned r = 0; r < numOutputs; ++r)
-	{
-		std::vector<Node*> w;
-		for(unsigned c = 0; c < cols; ++c)
-			w.push_back(weights.ptrAt(r*cols + c));
-
-		vectorNodes[r].setInputs(m_inputs, w);
-	}
+	pruned.assign(numInputs * numOutputs, 0);
+	connectRows();
 
 	// set bias.executed to always be true
 	// then it doesn't need to be part of the graph
@@ -62,7 +58,7 @@ void LinearLayer::setWeights(unsigned row, std::vector<double> w)
 	}
 
 	for(int c = 0; c < cols; c++)
-		weights.at(row*cols + c).setInput(w.at(c));
+		weights.at(row*cols + c).setInput(pruned[row*cols + c] ? 0 : w.at(c));
 }
 
 void LinearLayer::randomizeWeights()
@@ -70,7 +66,7 @@ void LinearLayer::randomizeWeights()
 	for(unsigned i = 0; i < weights.size(); ++i)
 	{
 		double r = static_cast <double> (rand()) / static_cast <double> (RAND_MAX);
-		weights.at(i).setInput(r);
+		weights.at(i).setInput(pruned[i] ? 0 : r);
 	}
 }
 
@@ -80,3 +76,306 @@ void LinearLayer::printWeights()
         std::cout << weights.at(i).getInput() << " ";
     std::cout << std::endl;
 }
+
+void LinearLayer::connectRows()
+{
+	unsigned cols = numInputs;
+
+	rowOffsets.clear();
+	colIndices.clear();
+
+	for(unsigned r = 0; r < numOutputs; ++r)
+	{
+		rowOffsets.push_back(colIndices.size());
+
+		std::vector<Node*> x, w;
+		for(unsigned c = 0; c < cols; ++c)
+		{
+			if(pruned[r*cols + c])
+				continue;
+
+			colIndices.push_back(c);
+			x.push_back(m_inputs[c]);
+			w.push_back(weights.ptrAt(r*cols + c));
+		}
+
+		// only touch rows that changed, since that invalidates schedules
+		if(vectorNodes[r].parents.size() != 2*x.size())
+			vectorNodes[r].setInputs(x, w);
+	}
+	rowOffsets.push_back(colIndices.size());
+}
+
+unsigned LinearLayer::prune(double threshold)
+{
+	unsigned cols = numInputs;
+	unsigned count = 0;
+
+	for(unsigned r = 0; r < numOutputs; ++r)
+	{
+		// the bias column is the last one
+		for(unsigned c = 0; c + 1 < cols; ++c)
+		{
+			unsigned i = r*cols + c;
+			if(!pruned[i] && std::abs(weights.at(i).getInput()) <= threshold)
+			{
+				pruned[i] = 1;
+				weights.at(i).setInput(0);
+			}
+
+			count += pruned[i];
+		}
+	}
+
+	connectRows();
+	return count;
+}
+
+unsigned LinearLayer::pruneFraction(double fraction)
+{
+	unsigned cols = numInputs;
+
+	std::vector<double> magnitudes;
+	for(unsigned r = 0; r < numOutputs; ++r)
+	{
+		for(unsigned c = 0; c + 1 < cols; ++c)
+			magnitudes.push_back(pruned[r*cols + c] ? 0 : std::abs(weights.at(r*cols + c).getInput()));
+	}
+
+	unsigned k = std::min<double>(magnitudes.size(), std::max(0.0, fraction) * magnitudes.size());
+	if(!k)
+		return prune(-1);
+
+	std::nth_element(magnitudes.begin(), magnitudes.begin() + k - 1, magnitudes.end());
+	return prune(magnitudes[k - 1]);
+}
+
+// ---------------------- Convolution ----------------------
+
+Conv2DLayer::Conv2DLayer(const std::vector<Node*>& inputs, unsigned channels, unsigned height, unsigned width,
+	unsigned filters, unsigned kernelH, unsigned kernelW,
+	unsigned strideH, unsigned strideW, unsigned padH, unsigned padW)
+: C(channels), H(height), W(width), F(filters), KH(kernelH), KW(kernelW)
+, SH(strideH), SW(strideW), PH(padH), PW(padW)
+, outH(0), outW(0)
+, weights(filters * channels * kernelH * kernelW + filters)
+, bias(1)
+{
+	if(inputs.size() != C*H*W)
+	{
+		std::cout << "Conv2DLayer:\t inputs don't match the given shape." << std::endl;
+		throw new std::exception();
+	}
+
+	setShape();
+
+	unsigned patch = C*KH*KW;
+	outputs = std::shared_ptr<VectorMultNode[]>(new VectorMultNode[F*outH*outW]);
+
+	for(unsigned f = 0; f < F; ++f)
+	{
+		for(unsigned y = 0; y < outH; ++y)
+		{
+			for(unsigned x = 0; x < outW; ++x)
+			{
+				// the patch under the kernel, leaving out the padding
+				std::vector<Node*> in, w;
+				for(unsigned c = 0; c < C; ++c)
+				{
+					for(unsigned ky = 0; ky < KH; ++ky)
+					{
+						int iy = int(y*SH + ky) - int(PH);
+						for(unsigned kx = 0; kx < KW; ++kx)
+						{
+							int ix = int(x*SW + kx) - int(PW);
+							if(iy < 0 || iy >= int(H) || ix < 0 || ix >= int(W))
+								continue;
+
+							in.push_back(inputs[(c*H + iy)*W + ix]);
+							w.push_back(weights.ptrAt(f*patch + (c*KH + ky)*KW + kx));
+						}
+					}
+				}
+
+				in.push_back(&bias);
+				w.push_back(weights.ptrAt(F*patch + f));
+
+				outputs[(f*outH + y)*outW + x].setInputs(in, w);
+			}
+		}
+	}
+
+	// like LinearLayer's, the bias isn't part of the graph
+	bias.executed = true;
+}
+
+Conv2DLayer::Conv2DLayer(unsigned channels, unsigned height, unsigned width,
+	unsigned filters, unsigned kernelH, unsigned kernelW,
+	unsigned strideH, unsigned strideW, unsigned padH, unsigned padW)
+: C(channels), H(height), W(width), F(filters), KH(kernelH), KW(kernelW)
+, SH(strideH), SW(strideW), PH(padH), PW(padW)
+, outH(0), outW(0)
+, weights(filters * channels * kernelH * kernelW + filters)
+, bias(1)
+{
+	setShape();
+	loweredOutputs = std::shared_ptr<InputNode[]>(new InputNode[F*outH*outW]);
+}
+
+void Conv2DLayer::setShape()
+{
+	if(!C || !F || !KH || !KW || !SH || !SW || H + 2*PH < KH || W + 2*PW < KW)
+	{
+		std::cout << "Conv2DLayer:\t the kernel doesn't fit the given shape." << std::endl;
+		throw new std::exception();
+	}
+
+	outH = (H + 2*PH - KH) / SH + 1;
+	outW = (W + 2*PW - KW) / SW + 1;
+}
+
+std::vector<InputNode*> Conv2DLayer::getWeightNodes()
+{
+	return weights.getInputs();
+}
+
+std::vector<Node*> Conv2DLayer::getOutputNodes()
+{
+	std::vector<Node*> result;
+	for(unsigned i = 0; i < F*outH*outW; ++i)
+		result.push_back(isLowered() ? (Node*)(loweredOutputs.get() + i) : outputs.get() + i);
+
+	return result;
+}
+
+std::vector<InputNode*> Conv2DLayer::getInputNodes()
+{
+	std::vector<InputNode*> result;
+	for(unsigned i = 0; isLowered() && i < F*outH*outW; ++i)
+		result.push_back(loweredOutputs.get() + i);
+
+	return result;
+}
+
+void Conv2DLayer::randomizeWeights()
+{
+	for(unsigned i = 0; i < weights.size(); ++i)
+	{
+		double r = static_cast <double> (rand()) / static_cast <double> (RAND_MAX);
+		weights.at(i).setInput(r);
+	}
+}
+
+void Conv2DLayer::im2col(const double* in, double* cols)
+{
+	unsigned P = outH*outW;
+
+	for(unsigned c = 0; c < C; ++c)
+	{
+		for(unsigned ky = 0; ky < KH; ++ky)
+		{
+			for(unsigned kx = 0; kx < KW; ++kx)
+			{
+				double* row = cols + ((c*KH + ky)*KW + kx) * P;
+
+				for(unsigned y = 0; y < outH; ++y)
+				{
+					int iy = int(y*SH + ky) - int(PH);
+					for(unsigned x = 0; x < outW; ++x)
+					{
+						int ix = int(x*SW + kx) - int(PW);
+						bool inside = iy >= 0 && iy < int(H) && ix >= 0 && ix < int(W);
+						row[y*outW + x] = inside ? in[(c*H + iy)*W + ix] : 0;
+					}
+				}
+			}
+		}
+	}
+}
+
+void Conv2DLayer::col2im(const double* cols, double* in)
+{
+	unsigned P = outH*outW;
+	std::fill(in, in + C*H*W, 0.0);
+
+	for(unsigned c = 0; c < C; ++c)
+	{
+		for(unsigned ky = 0; ky < KH; ++ky)
+		{
+			for(unsigned kx = 0; kx < KW; ++kx)
+			{
+				const double* row = cols + ((c*KH + ky)*KW + kx) * P;
+
+				for(unsigned y = 0; y < outH; ++y)
+				{
+					int iy = int(y*SH + ky) - int(PH);
+					for(unsigned x = 0; x < outW; ++x)
+					{
+						int ix = int(x*SW + kx) - int(PW);
+						if(iy >= 0 && iy < int(H) && ix >= 0 && ix < int(W))
+							in[(c*H + iy)*W + ix] += row[y*outW + x];
+					}
+				}
+			}
+		}
+	}
+}
+
+void Conv2DLayer::forward(const double* in, unsigned batch, double* out)
+{
+	unsigned patch = C*KH*KW;
+	unsigned P = outH*outW;
+
+	kernel.resize(weights.size());
+	for(unsigned i = 0; i < weights.size(); ++i)
+		kernel[i] = weights.at(i).getInput();
+
+	cols.resize(patch * P);
+	for(unsigned b = 0; b < batch; ++b)
+	{
+		double* o = out + b*F*P;
+		for(unsigned f = 0; f < F; ++f)
+			std::fill(o + f*P, o + (f+1)*P, kernel[F*patch + f]);
+
+		// [F x patch] * [patch x P]
+		im2col(in + b*C*H*W, cols.data());
+		gemm(false, false, F, P, patch, kernel.data(), patch, cols.data(), P, 1, o, P);
+	}
+}
+
+void Conv2DLayer::backward(const double* in, const double* dOut, unsigned batch, double* grads, double* dIn)
+{
+	unsigned patch = C*KH*KW;
+	unsigned P = outH*outW;
+
+	kernel.resize(weights.size());
+	for(unsigned i = 0; i < weights.size(); ++i)
+		kernel[i] = weights.at(i).getInput();
+
+	cols.resize(patch * P);
+	std::vector<double> dCols(dIn ? patch * P : 0);
+
+	for(unsigned b = 0; b < batch; ++b)
+	{
+		const double* d = dOut + b*F*P;
+
+		// dKernel += dOut [F x P] * cols^T [P x patch]
+		im2col(in + b*C*H*W, cols.data());
+		gemm(false, true, F, patch, P, d, P, cols.data(), P, 1, grads, patch);
+
+		for(unsigned f = 0; f < F; ++f)
+		{
+			double sum = 0;
+			for(unsigned p = 0; p < P; ++p)
+				sum += d[f*P + p];
+			grads[F*patch + f] += sum;
+		}
+
+		// dCols = kernel^T [patch x F] * dOut [F x P], then back onto the inputs
+		if(dIn)
+		{
+			gemm(true, false, patch, P, F, kernel.data(), patch, d, P, 0, dCols.data(), P);
+			col2im(dCols.data(), dIn + b*C*H*W);
+		}
+	}
+}
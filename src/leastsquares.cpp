@@ -0,0 +1,159 @@
+#include "leastsquares.h"
+#include "cholesky.h"
+#include "executioncontext.h"
+#include "nodetypes.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+bool isLinearInParams(Graph& g)
+{
+	auto& s = g.schedule();
+	unsigned n = s.nodes.size();
+
+	// whether each node's value depends on the params
+	std::vector<char> depends(n, 0);
+	for(auto i : s.paramIndex)
+		depends[i] = 1;
+
+	std::vector<char> dep;
+	for(unsigned i = s.levels.size() > 1 ? s.levels[1] : n; i < n; ++i)
+	{
+		dep.clear();
+		for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+		{
+			int a = s.argIndices[e];
+			dep.push_back(a >= 0 && depends[a]);
+		}
+
+		unsigned count = std::count(dep.begin(), dep.end(), 1);
+		if(!count)
+			continue;
+		depends[i] = 1;
+
+		// a nonlinear node that doesn't reach an output is harmless
+		if(!s.reachesOutput[i])
+			continue;
+
+		Node* node = s.nodes[i];
+		if(dynamic_cast<AdditionNode*>(node))
+			continue;
+		if(dynamic_cast<MultiplicationNode*>(node) && count == 1)
+			continue;
+		if(dynamic_cast<VectorMultNode*>(node))
+		{
+			// sum of in[k] * in[l+k]
+			unsigned l = dep.size() / 2;
+			bool linear = true;
+			for(unsigned k = 0; k < l; ++k)
+				linear = linear && !(dep[k] && dep[l+k]);
+			if(linear)
+				continue;
+		}
+
+		return false;
+	}
+
+	return true;
+}
+
+// ---------------------- Normal Equations ----------------------
+
+NormalEquations::NormalEquations(unsigned nParams)
+: nParams(nParams)
+, AtA(nParams * nParams, 0)
+, Atb(nParams, 0)
+{}
+
+void NormalEquations::accumulate(Graph& g, const double* in, const double* out, unsigned n)
+{
+	PROFILE_PHASE("NormalEquations::accumulate");
+
+	ExecutionContext ctx(g);
+	auto& s = ctx.getSchedule();
+	unsigned inW = s.inputIndex.size();
+	unsigned outW = s.outputSlot.size();
+
+	if(s.paramIndex.size() != nParams)
+		throw new std::exception();
+
+	const double* w = g.parameters.values().data();
+	std::vector<double> identity(outW * outW, 0), row(nParams);
+	std::vector<unsigned> nonZero;
+
+	for(unsigned o = 0; o < outW; ++o)
+		identity[o*outW + o] = 1;
+
+	for(unsigned j = 0; j < n; ++j)
+	{
+		auto& y = g.forwardPass(ctx, in + j*inW);
+
+		// every output's gradient in one traversal
+		g.backProp(ctx, identity.data(), outW, outW);
+
+		for(unsigned o = 0; o < outW; ++o)
+		{
+			// f = row . w + c, so the target for row . w is y - c
+			nonZero.clear();
+			double fitted = 0;
+			for(unsigned k = 0; k < nParams; ++k)
+			{
+				row[k] = ctx.getGradient(k, o);
+				if(row[k] != 0)
+				{
+					nonZero.push_back(k);
+					fitted += row[k] * w[k];
+				}
+			}
+			double b = out[j*outW + o] - (y[o] - fitted);
+
+			// the lower triangle is all cholesky() reads
+			for(unsigned a = 0; a < nonZero.size(); ++a)
+			{
+				unsigned r = nonZero[a];
+				double* dst = &AtA[r*nParams];
+				for(unsigned c = 0; c <= a; ++c)
+					dst[nonZero[c]] += row[r] * row[nonZero[c]];
+
+				Atb[r] += row[r] * b;
+			}
+
+			rows++;
+		}
+	}
+}
+
+bool NormalEquations::solve(double ridge, double* w) const
+{
+	PROFILE_PHASE("NormalEquations::solve");
+
+	unsigned n = nParams;
+	std::vector<double> M(AtA), b(Atb), scale(n);
+
+	for(unsigned i = 0; i < n; ++i)
+	{
+		M[i*n + i] += ridge;
+		scale[i] = M[i*n + i] > 0 ? 1 / std::sqrt(M[i*n + i]) : 1;
+	}
+
+	for(unsigned i = 0; i < n; ++i)
+	{
+		for(unsigned j = 0; j <= i; ++j)
+			M[i*n + j] *= scale[i] * scale[j];
+		b[i] *= scale[i];
+	}
+
+	if(!cholesky(n, M.data(), n))
+	{
+		std::cout << "NormalEquations:\t the system is singular." << std::endl;
+		return false;
+	}
+	choleskySolve(n, M.data(), n, b.data());
+
+	for(unsigned i = 0; i < n; ++i)
+		w[i] = b[i] * scale[i];
+
+	return true;
+}
@@ -0,0 +1,193 @@
+#include "memoryplan.h"
+#include "nodetypes.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+// ---------------------- Memory Report ----------------------
+
+void MemoryReport::write(std::ostream& out) const
+{
+	out << "graph memory: " << total() << " bytes\n";
+	for(auto& t : nodeTypes)
+	{
+		out << "  " << std::left << std::setw(24) << t.first << std::right
+			<< std::setw(8) << t.second.count << " nodes  "
+			<< std::setw(10) << t.second.bytes << " bytes\n";
+	}
+	out << "  nodes:      " << nodeBytes << " bytes, of which derivatives " << derivativeBytes << "\n"
+		<< "  params:     " << paramBytes << " bytes\n"
+		<< "  schedule:   " << scheduleBytes << " bytes\n";
+}
+
+// ---------------------- Buffer Plan ----------------------
+
+void BufferPlan::build(const Schedule& s)
+{
+	unsigned n = s.nodes.size();
+
+	slotOf.assign(n, -1);
+	numSlots = 0;
+
+	std::vector<char> isParam(n, 0);
+	for(auto i : s.paramIndex)
+		isParam[i] = 1;
+
+	// a value is dead after its last child has read it; outputs never are
+	std::vector<unsigned> lastUse(n);
+	std::vector<std::vector<unsigned>> dying(n);
+	for(unsigned i = 0; i < n; ++i)
+	{
+		lastUse[i] = i;
+		for(unsigned e = s.childOffsets[i]; e < s.childOffsets[i+1]; ++e)
+			lastUse[i] = std::max(lastUse[i], s.childIndices[e]);
+
+		if(s.outputIndex[i] >= 0)
+			lastUse[i] = n;
+		else if(lastUse[i] != i && !isParam[i])
+			dying[lastUse[i]].push_back(i);
+	}
+
+	std::vector<unsigned> freeSlots;
+	for(unsigned i = 0; i < n; ++i)
+	{
+		if(isParam[i])
+			continue;
+
+		// a node's arguments are gathered before its value is written,
+		// so it can take over the slot of an argument it reads last
+		for(auto d : dying[i])
+			freeSlots.push_back(slotOf[d]);
+
+		if(freeSlots.empty())
+			slotOf[i] = numSlots++;
+		else
+		{
+			slotOf[i] = freeSlots.back();
+			freeSlots.pop_back();
+		}
+
+		// nothing reads it
+		if(lastUse[i] == i)
+			freeSlots.push_back(slotOf[i]);
+	}
+}
+
+// ---------------------- Inference Context ----------------------
+
+InferenceContext::InferenceContext(Graph& g)
+: schedule(g.sharedSchedule())
+{
+	auto& s = *schedule;
+	plan.build(s);
+
+	int nParams = s.paramIndex.size();
+	std::vector<int> paramOf(s.nodes.size(), -1);
+	for(int k = 0; k < nParams; ++k)
+		paramOf[s.paramIndex[k]] = k;
+
+	auto encode = [&](int a) {
+		if(a < 0)
+			return -nParams + a;
+		if(paramOf[a] >= 0)
+			return -paramOf[a] - 1;
+		return plan.slotOf[a];
+	};
+
+	unsigned maxArgs = 0;
+	for(unsigned i = 0; i < s.nodes.size(); ++i)
+		maxArgs = std::max(maxArgs, s.argOffsets[i+1] - s.argOffsets[i]);
+
+	for(int a : s.argIndices)
+		args.push_back(encode(a));
+	for(int a : s.outputSlot)
+		outputArgs.push_back(encode(a));
+
+	buffers.assign(plan.numSlots, 0);
+	outputs.assign(s.outputSlot.size(), 0);
+	scratch.resize(2 * maxArgs);
+}
+
+size_t InferenceContext::activationBytes() const
+{
+	return sizeof(double) * (buffers.size() + outputs.size() + scratch.size());
+}
+
+size_t InferenceContext::unplannedBytes() const
+{
+	auto& s = *schedule;
+	return sizeof(double) * (s.nodes.size() - s.paramIndex.size() + outputs.size() + scratch.size());
+}
+
+// ---------------------- Graph ----------------------
+
+const std::vector<double>& Graph::forwardPass(InferenceContext& ctx, const double* inputValues)
+{
+	PROFILE_PHASE("Graph::forwardPass(inference)");
+
+	auto& s = *ctx.schedule;
+	auto& slotOf = ctx.plan.slotOf;
+	double* buffers = ctx.buffers.data();
+	const double* w = ctx.params ? ctx.params : parameters.values().data();
+	int nParams = s.paramIndex.size();
+
+	auto fetch = [&](int a) {
+		if(a >= 0)
+			return buffers[a];
+		a = -a - 1;
+		return a < nParams ? relaxedLoad(w + a) : s.constants[a - nParams]->getOutput();
+	};
+
+	for(unsigned i = 0; i < s.inputIndex.size(); ++i)
+		buffers[slotOf[s.inputIndex[i]]] = inputValues[i];
+
+	double* args = ctx.scratch.data();
+	double* partials = args + ctx.scratch.size() / 2;
+	unsigned n = s.nodes.size();
+
+	for(unsigned i = s.levels.size() > 1 ? s.levels[1] : n; i < n; ++i)
+	{
+		unsigned begin = s.argOffsets[i];
+		unsigned end = s.argOffsets[i+1];
+
+		for(unsigned e = begin; e < end; ++e)
+			args[e - begin] = fetch(ctx.args[e]);
+
+		buffers[slotOf[i]] = s.nodes[i]->compute(args, partials);
+	}
+
+	for(unsigned o = 0; o < ctx.outputArgs.size(); ++o)
+		ctx.outputs[o] = fetch(ctx.outputArgs[o]);
+
+	return ctx.outputs;
+}
+
+MemoryReport Graph::memoryReport()
+{
+	MemoryReport r;
+	auto& s = schedule();
+
+	auto count = [&](Node* n) {
+		// no node type adds members, but InputNode
+		size_t bytes = (dynamic_cast<InputNode*>(n) ? sizeof(InputNode) : sizeof(Node))
+			+ n->edgeBytes() + n->derivativeBytes();
+
+		auto& usage = r.nodeTypes[nodeTypeName(n)];
+		usage.count++;
+		usage.bytes += bytes;
+
+		r.nodeBytes += bytes;
+		r.derivativeBytes += n->derivativeBytes();
+	};
+
+	for(auto n : s.nodes)
+		count(n);
+	for(auto n : s.constants)
+		count(n);
+
+	r.paramBytes = 2 * sizeof(double) * parameters.size();
+	r.scheduleBytes = s.bytes();
+
+	return r;
+}
@@ -0,0 +1,155 @@
+#include "microbatcher.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+namespace
+{
+	const unsigned LATENCY_WINDOW = 1 << 16;
+
+	double percentile(std::vector<double> v, double p)
+	{
+		if(v.empty())
+			return 0;
+
+		unsigned k = std::min<unsigned>(v.size() - 1, p * v.size());
+		std::nth_element(v.begin(), v.begin() + k, v.end());
+		return v[k];
+	}
+}
+
+// ---------------------- Micro Batcher ----------------------
+
+MicroBatcher::MicroBatcher(Graph& graph, unsigned maxBatch, double maxDelay)
+: graph(graph)
+, ctx(graph)
+, inW(ctx.getSchedule().inputIndex.size())
+, outW(ctx.getSchedule().outputSlot.size())
+, maxBatch(maxBatch ? maxBatch : 1)
+, maxDelay(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(maxDelay)))
+, statsStart(clock::now())
+{
+	evaluator = std::thread([this] { loop(); });
+}
+
+MicroBatcher::~MicroBatcher()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	arrived.notify_one();
+	evaluator.join();
+}
+
+std::future<std::vector<double>> MicroBatcher::submit(const double* inputs)
+{
+	Request r;
+	r.inputs.assign(inputs, inputs + inW);
+	r.arrival = clock::now();
+	auto result = r.result.get_future();
+
+	bool wake;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(std::move(r));
+		// the evaluator only needs waking for a new batch or a full one
+		wake = queue.size() == 1 || queue.size() == maxBatch;
+	}
+	if(wake)
+		arrived.notify_one();
+
+	return result;
+}
+
+void MicroBatcher::loop()
+{
+	std::vector<Request> batch;
+	std::vector<double> in, out;
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			arrived.wait(guard, [&] { return stopping || !queue.empty(); });
+
+			// on shutdown, drain what's left without waiting
+			if(queue.empty())
+				return;
+
+			auto deadline = queue.front().arrival + maxDelay;
+			arrived.wait_until(guard, deadline, [&] { return stopping || queue.size() >= maxBatch; });
+
+			unsigned n = std::min<unsigned>(queue.size(), maxBatch);
+			for(unsigned i = 0; i < n; ++i)
+			{
+				batch.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+		}
+
+		{
+			PROFILE_PHASE("MicroBatcher::batch");
+
+			in.resize(batch.size() * inW);
+			out.resize(batch.size() * outW);
+			for(unsigned i = 0; i < batch.size(); ++i)
+				std::copy(batch[i].inputs.begin(), batch[i].inputs.end(), in.begin() + i*inW);
+
+			graph.forwardBatch(ctx, in.data(), batch.size(), out.data());
+		}
+
+		// counted before anyone sees the results, so the stats include them
+		record(batch, clock::now());
+
+		for(unsigned i = 0; i < batch.size(); ++i)
+			batch[i].result.set_value(std::vector<double>(out.begin() + i*outW, out.begin() + (i+1)*outW));
+
+		batch.clear();
+	}
+}
+
+void MicroBatcher::record(const std::vector<Request>& batch, clock::time_point done)
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+
+	totals.requests += batch.size();
+	totals.batches += 1;
+
+	for(auto& r : batch)
+	{
+		double seconds = std::chrono::duration<double>(done - r.arrival).count();
+		if(latencies.size() < LATENCY_WINDOW)
+			latencies.push_back(seconds);
+		else
+			latencies[latencyCount % LATENCY_WINDOW] = seconds;
+		++latencyCount;
+	}
+}
+
+ServingStats MicroBatcher::getStats()
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+
+	ServingStats s = totals;
+	if(s.batches)
+		s.meanBatch = (double)s.requests / s.batches;
+
+	s.p50 = percentile(latencies, 0.5);
+	s.p99 = percentile(latencies, 0.99);
+
+	double elapsed = std::chrono::duration<double>(clock::now() - statsStart).count();
+	s.requestsPerSecond = elapsed > 0 ? s.requests / elapsed : 0;
+
+	return s;
+}
+
+void MicroBatcher::resetStats()
+{
+	std::lock_guard<std::mutex> guard(statsLock);
+
+	totals = ServingStats();
+	latencies.clear();
+	latencyCount = 0;
+	statsStart = clock::now();
+}
@@ -6,49 +6,93 @@
 InputNode::InputNode() { output=0; }
 InputNode::InputNode (double i) { output = i; }
 
-void InputNode::setInput(double i) { output = i; }
-double InputNode::getInput() { return output; }
-void InputNode::forward() { partialDerivatives = {1}; }
+InputNode::~InputNode()
+{
+	if(store)
+		store->forget(storeIndex);
+}
+
+void InputNode::setInput(double i)
+{
+	output = i;
+	if(store)
+		store->values()[storeIndex] = i;
+}
+
+double InputNode::getInput() { return store ? store->values()[storeIndex] : output; }
+
+double InputNode::compute(const double* in, double* partials) const
+{
+	return store ? relaxedLoad(&store->values()[storeIndex]) : output;
+}
+
+void InputNode::forward()
+{
+	if(store)
+		output = relaxedLoad(&store->values()[storeIndex]);
+
+	partialDerivatives = {1};
+}
+
+void InputNode::bind(ParameterStore* s, unsigned index)
+{
+	store = s;
+	storeIndex = index;
+}
+
+void InputNode::unbind()
+{
+	if(store)
+		output = store->values()[storeIndex];
+
+	store = nullptr;
+}
 
 // ---------------------- Addition Node ----------------------
 
 AdditionNode::AdditionNode(Node* a, Node* b)
 {
-	parents.push_back(a);
-	parents.push_back(b);
-
-	a->children.push_back(this);
-	b->children.push_back(this);
+	addParent(a);
+	addParent(b);
 
 	output = 0;
 }
 
-void AdditionNode::forward() 
+double AdditionNode::compute(const double* in, double* partials) const
 { 
-	output = parents.at(0)->getOutput() + parents.at(1)->getOutput();
-	partialDerivatives = {1, 1};
+	partials[0] = 1;
+	partials[1] = 1;
+	return in[0] + in[1];
+}
+
+std::string AdditionNode::expression(const std::vector<std::string>& args) const
+{
+	return "(" + args[0] + " + " + args[1] + ")";
 }
 
 // ---------------------- Multiplication Node ----------------------
 
 MultiplicationNode::MultiplicationNode(Node* a, Node* b)
 {
-	parents.push_back(a);
-	parents.push_back(b);
-
-	a->children.push_back(this);
-	b->children.push_back(this);
+	addParent(a);
+	addParent(b);
 
 	output = 0;
 }
 
-void MultiplicationNode::forward() 
+double MultiplicationNode::compute(const double* in, double* partials) const
 {
-	double x = parents.at(0)->getOutput();
-	double y = parents.at(1)->getOutput();
+	double x = in[0];
+	double y = in[1];
 	
-	output = x * y;
-	partialDerivatives = {y, x};
+	partials[0] = y;
+	partials[1] = x;
+	return x * y;
+}
+
+std::string MultiplicationNode::expression(const std::vector<std::string>& args) const
+{
+	return "(" + args[0] + " * " + args[1] + ")";
 }
 
 // ---------------------- Sigmoid Node ----------------------
@@ -56,17 +100,21 @@ SigmoidNode::SigmoidNode(){}
 
 SigmoidNode::SigmoidNode(Node* p)
 {
-	parents.push_back(p);
-	p->children.push_back(this);
+	addParent(p);
 }
 
-void SigmoidNode::forward() 
+double SigmoidNode::compute(const double* in, double* partials) const
 {
-	double x = parents.at(0)->getOutput();
+	double x = in[0];
 	double z = 1.0 / (1.0 + exp(-1.0*x));
 	
-	output = z;
-	partialDerivatives = { z*(1.0-z) };
+	partials[0] = z*(1.0-z);
+	return z;
+}
+
+std::string SigmoidNode::expression(const std::vector<std::string>& args) const
+{
+	return "(1.0 / (1.0 + std::exp(-" + args[0] + ")))";
 }
 
 // ---------------------- Vector Multiplication Node ----------------------
@@ -86,12 +134,7 @@ void VectorMultNode::setInputs(std::vector<Node*> inputs, std::vector<Node*> wei
 
 	// then we add the weights as well
 	for(auto w : weights)
-	{
-		parents.push_back(w);
-		w->children.push_back(this);
-	}
-
-	partialDerivatives.resize(parents.size());
+		addParent(w);
 }
 
 VectorMultNode::VectorMultNode(std::vector<Node*> inputs, std::vector<Node*> weights)
@@ -102,49 +145,55 @@ VectorMultNode::VectorMultNode(std::vector<Node*> inputs, std::vector<Node*> wei
 	}
 
 	for(auto n : inputs)
-	{
-		parents.push_back(n);
-		n->children.push_back(this);
-	}
+		addParent(n);
 
 	for(auto w : weights)
-	{
-		parents.push_back(w);
-		w->children.push_back(this);
-	}
-	partialDerivatives.resize(parents.size());
+		addParent(w);
 }
 
-void VectorMultNode::forward()
+double VectorMultNode::compute(const double* in, double* partials) const
 {
-	output = 0;
+	double result = 0;
 	unsigned l = parents.size() / 2;
 
 	double x,w;
 	for(unsigned i = 0; i < l; ++i)
 	{
-		x = parents.at(i)->getOutput();
-		w = parents.at(l+i)->getOutput();
+		x = in[i];
+		w = in[l+i];
 		
-		output += x*w;
+		result += x*w;
 
-		partialDerivatives.at(i) = w;
-		partialDerivatives.at(l+i) = x;
+		partials[i] = w;
+		partials[l+i] = x;
 	}
+
+	return result;
+}
+
+std::string VectorMultNode::expression(const std::vector<std::string>& args) const
+{
+	// summed in the same order as compute
+	unsigned l = args.size() / 2;
+	std::string result = "0.0";
+	for(unsigned i = 0; i < l; ++i)
+		result = "(" + result + " + " + args[i] + " * " + args[l+i] + ")";
+
+	return result;
 }
 
 MaxNode::MaxNode(const std::vector<Node*>& p) { setParents(p); }
 
-void MaxNode::forward()
+double MaxNode::compute(const double* in, double* partials) const
 {
 	unsigned n = parents.size();
-	double max = parents.at(0)->getOutput();
+	double max = in[0];
 	unsigned index = 0;
 
 
 	for(int i = 1; i < n; ++i)
 	{
-		double o = parents.at(i)->getOutput();
+		double o = in[i];
 		if(o > max)
 		{
 			max = o;
@@ -152,18 +201,33 @@ void MaxNode::forward()
 		}
 	}
 
-	output = max;
-
 	for(int i = 0; i < n; ++i)
 	{
-		partialDerivatives.at(i) = index == i ? 1 : 0;
+		partials[i] = index == i ? 1 : 0;
 	}
+
+	return max;
+}
+
+std::string MaxNode::expression(const std::vector<std::string>& args) const
+{
+	// max_(a, b) keeps a on ties, like compute
+	std::string result = args[0];
+	for(unsigned i = 1; i < args.size(); ++i)
+		result = "max_(" + result + ", " + args[i] + ")";
+
+	return result;
+}
+
+double InverseNode::compute(const double* in, double* partials) const
+{
+	double i = in[0];
+	partials[0] = -1.0 / (i*i);
+	return 1.0 / i;
 }
 
-void InverseNode::forward()
+std::string InverseNode::expression(const std::vector<std::string>& args) const
 {
-	double i = parents.at(0)->getOutput();
-	output = 1.0 / i;
-	partialDerivatives.at(0) = -1.0 / (i*i);
+	return "(1.0 / " + args[0] + ")";
 }
 
@@ -0,0 +1,91 @@
+#include "parameterstore.h"
+#include "nodetypes.h"
+
+#include <cstring>
+#include <iostream>
+
+const size_t CACHE_LINE = 64;
+
+ParameterStore::~ParameterStore()
+{
+	// the nodes may outlive the graph; they keep their last value
+	for(auto n : nodes)
+	{
+		if(n)
+			n->unbind();
+	}
+}
+
+void ParameterStore::forget(unsigned index)
+{
+	nodes[index] = nullptr;
+}
+
+ParameterStore::AlignedArray ParameterStore::allocate(size_t n)
+{
+	// aligned_alloc wants a multiple of the alignment
+	size_t bytes = (n * sizeof(double) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+	if(!bytes)
+		bytes = CACHE_LINE;
+
+	auto p = static_cast<double*>(aligned_alloc(CACHE_LINE, bytes));
+	if(!p)
+		throw new std::exception();
+
+	memset(p, 0, bytes);
+	return AlignedArray(p);
+}
+
+void ParameterStore::bind(const std::vector<InputNode*> &params)
+{
+	for(auto n : params)
+	{
+		if(!n)
+		{
+			std::cout << "ParameterStore:\t a param node is null." << std::endl;
+			throw new std::exception();
+		}
+
+		// the other store's optimizer would go on writing values this
+		// node no longer reads
+		if(n->getStore() && n->getStore() != this)
+		{
+			std::cout << "ParameterStore:\t a param node is already bound to another graph's params." << std::endl;
+			throw new std::exception();
+		}
+	}
+
+	auto newValues = allocate(params.size());
+	auto newGradients = allocate(params.size());
+
+	for(unsigned k = 0; k < params.size(); ++k)
+		newValues[k] = params[k]->getInput();
+
+	for(auto n : nodes)
+	{
+		if(n)
+			n->unbind();
+	}
+
+	nodes = params;
+	valueData = std::move(newValues);
+	gradientData = std::move(newGradients);
+
+	for(unsigned k = 0; k < nodes.size(); ++k)
+		nodes[k]->bind(this, k);
+	++version;
+}
+
+void ParameterStore::zeroGradients()
+{
+	memset(gradientData.get(), 0, sizeof(double)*nodes.size());
+}
+
+void ParameterStore::accumulateGradients(double scale)
+{
+	double* g = gradientData.get();
+	unsigned n = nodes.size();
+
+	for(unsigned k = 0; k < n; ++k)
+		g[k] += scale * nodes[k]->getDerivative(0);
+}
@@ -0,0 +1,278 @@
+#include "profiler.h"
+#include "graph.h"
+
+#include <cxxabi.h>
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+Profiler& Profiler::instance()
+{
+	static Profiler p;
+	return p;
+}
+
+unsigned long long Profiler::now()
+{
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+unsigned long long Profiler::cycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+// the calling thread's buffer, registered with the profiler on first use
+struct ThreadBufferHandle
+{
+	std::shared_ptr<Profiler::ThreadBuffer> buffer;
+
+	~ThreadBufferHandle()
+	{
+		if(buffer)
+			Profiler::instance().retire(buffer);
+	}
+};
+
+Profiler::ThreadBuffer& Profiler::threadBuffer()
+{
+	thread_local ThreadBufferHandle handle;
+
+	if(!handle.buffer)
+	{
+		handle.buffer = std::make_shared<ThreadBuffer>();
+		std::lock_guard<std::mutex> guard(lock);
+		buffers.push_back(handle.buffer);
+	}
+
+	return *handle.buffer;
+}
+
+void addStats(std::map<std::string, ProfileStats>& to, const std::map<std::string, ProfileStats>& from)
+{
+	for(auto& kv : from)
+	{
+		auto& s = to[kv.first];
+		s.calls += kv.second.calls;
+		s.nanoseconds += kv.second.nanoseconds;
+		s.cycles += kv.second.cycles;
+	}
+}
+
+void Profiler::retire(const std::shared_ptr<ThreadBuffer>& b)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::lock_guard<std::mutex> bufferGuard(b->lock);
+
+	addStats(retired.phaseStats, b->phaseStats);
+	addStats(retired.nodeStats, b->nodeStats);
+	retired.events.insert(retired.events.end(), b->events.begin(), b->events.end());
+
+	buffers.erase(std::find(buffers.begin(), buffers.end(), b));
+}
+
+void Profiler::add(ThreadBuffer& b, std::map<std::string, ProfileStats>& stats, const std::string& name,
+	const char* category, unsigned long long start, unsigned long long end,
+	unsigned long long cycleCount)
+{
+	auto& s = stats[name];
+	s.calls++;
+	s.nanoseconds += end - start;
+	s.cycles += cycleCount;
+
+	if(isTracing())
+	{
+		unsigned long tid = std::hash<std::thread::id>()(std::this_thread::get_id());
+		b.events.push_back({name, category, start, end - start, tid});
+	}
+}
+
+void Profiler::record(const char* name, const char* category,
+	unsigned long long start, unsigned long long end, unsigned long long cycleCount)
+{
+	auto& b = threadBuffer();
+	std::lock_guard<std::mutex> guard(b.lock);
+	add(b, b.phaseStats, name, category, start, end, cycleCount);
+}
+
+void Profiler::recordNode(const Node* n, const char* category,
+	unsigned long long start, unsigned long long end, unsigned long long cycleCount)
+{
+	auto& b = threadBuffer();
+	std::lock_guard<std::mutex> guard(b.lock);
+	add(b, b.nodeStats, typeName(b, n) + "::" + category, category, start, end, cycleCount);
+}
+
+const std::string& Profiler::typeName(ThreadBuffer& b, const Node* n)
+{
+	std::type_index t(typeid(*n));
+
+	auto it = b.typeNames.find(t);
+	if(it != b.typeNames.end())
+		return it->second;
+
+	return b.typeNames[t] = nodeTypeName(n);
+}
+
+std::string nodeTypeName(const Node* n)
+{
+	const char* mangled = typeid(*n).name();
+
+	int status = 0;
+	char* demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+	std::string name = status == 0 ? demangled : mangled;
+	free(demangled);
+
+	return name;
+}
+
+void Profiler::startTrace()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	retired.events.clear();
+	for(auto& b : buffers)
+	{
+		std::lock_guard<std::mutex> bufferGuard(b->lock);
+		b->events.clear();
+	}
+
+	tracing = true;
+}
+
+void Profiler::stopTrace()
+{
+	tracing = false;
+}
+
+void Profiler::reset()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	retired.phaseStats.clear();
+	retired.nodeStats.clear();
+	retired.events.clear();
+	for(auto& b : buffers)
+	{
+		std::lock_guard<std::mutex> bufferGuard(b->lock);
+		b->phaseStats.clear();
+		b->nodeStats.clear();
+		b->events.clear();
+	}
+}
+
+std::map<std::string, ProfileStats> Profiler::merged(std::map<std::string, ProfileStats> ThreadBuffer::*stats)
+{
+	auto result = retired.*stats;
+	for(auto& b : buffers)
+	{
+		std::lock_guard<std::mutex> bufferGuard(b->lock);
+		addStats(result, (*b).*stats);
+	}
+	return result;
+}
+
+std::map<std::string, ProfileStats> Profiler::getPhaseStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return merged(&ThreadBuffer::phaseStats);
+}
+
+std::map<std::string, ProfileStats> Profiler::getNodeStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return merged(&ThreadBuffer::nodeStats);
+}
+
+void writeStats(std::ostream& out, const std::map<std::string, ProfileStats>& stats)
+{
+	for(auto& kv : stats)
+	{
+		auto& s = kv.second;
+		out << "  " << kv.first << ": calls=" << s.calls
+			<< " ns=" << s.nanoseconds
+			<< " ns/call=" << (s.calls ? s.nanoseconds / s.calls : 0)
+			<< " cycles=" << s.cycles << "\n";
+	}
+}
+
+void Profiler::writeReport(std::ostream& out)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	out << "phases:\n";
+	writeStats(out, merged(&ThreadBuffer::phaseStats));
+	out << "nodes:\n";
+	writeStats(out, merged(&ThreadBuffer::nodeStats));
+}
+
+// as a JSON string, without the quotes
+void writeEscaped(std::ostream& out, const std::string& s)
+{
+	for(char c : s)
+	{
+		if(c == '"' || c == '\\')
+			out << '\\' << c;
+		else if((unsigned char)c < 0x20)
+		{
+			const char* hex = "0123456789abcdef";
+			out << "\\u00" << hex[c >> 4] << hex[c & 15];
+		}
+		else
+			out << c;
+	}
+}
+
+// See the Trace Event Format: "X" events are complete events with
+// a start timestamp and a duration, both in microseconds.
+void Profiler::writeChromeTrace(std::ostream& out)
+{
+	std::vector<TraceEvent> events;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		events = retired.events;
+		for(auto& b : buffers)
+		{
+			std::lock_guard<std::mutex> bufferGuard(b->lock);
+			events.insert(events.end(), b->events.begin(), b->events.end());
+		}
+	}
+
+	// interleave the threads' events in time
+	std::stable_sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) {
+		return a.start < b.start;
+	});
+
+	auto flags = out.flags();
+	auto precision = out.precision();
+
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[\n";
+	for(unsigned i = 0; i < events.size(); ++i)
+	{
+		auto& e = events[i];
+		out << (i ? ",\n" : "")
+			<< "{\"name\":\"";
+		writeEscaped(out, e.name);
+		out << "\",\"cat\":\"";
+		writeEscaped(out, e.category);
+		out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+			<< ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << e.duration / 1000.0 << "}";
+	}
+	out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,253 @@
+#include "quantize.h"
+#include "executioncontext.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	float scaleFor(double maxAbs) { return maxAbs > 0 ? maxAbs / 127 : 1; }
+
+	int8_t quantize(double x, float scale)
+	{
+		long q = std::lround(x / scale);
+		return std::max(-127l, std::min(127l, q));
+	}
+
+	// the widest layer, for scratch buffers
+	unsigned maxWidth(const std::vector<QuantizedLayer>& layers)
+	{
+		unsigned w = 0;
+		for(auto& l : layers)
+			w = std::max(w, std::max(l.nIn, l.nOut));
+		return w;
+	}
+}
+
+// ---------------------- Quantized Layer ----------------------
+
+void QuantizedLayer::forward(const double* x, int8_t* scratch, double* y) const
+{
+	for(unsigned i = 0; i < nIn; ++i)
+		scratch[i] = quantize(x[i], inputScale);
+
+	const int8_t* w = weights.data();
+	for(unsigned o = 0; o < nOut; ++o, w += nIn)
+	{
+		int32_t acc = 0;
+		for(unsigned i = 0; i < nIn; ++i)
+			acc += int32_t(w[i]) * int32_t(scratch[i]);
+
+		acc += bias[o];
+
+		double v = acc * (double(rowScale[o]) * inputScale);
+		y[o] = activation ? activation(v) : v;
+	}
+}
+
+size_t QuantizedLayer::bytes() const
+{
+	return weights.size() * sizeof(int8_t) + rowScale.size() * sizeof(float) + bias.size() * sizeof(int32_t);
+}
+
+// ---------------------- Quantized Network ----------------------
+
+void QuantizedNetwork::addLayer(LinearLayer& l)
+{
+	if(isCalibrated())
+		throw new std::exception();
+
+	PendingLayer p;
+	p.nOut = l.getOutputNodes().size();
+	p.biasValue = l.getBiasNode()->getOutput();
+
+	for(auto w : l.getWeightNodes())
+		p.weights.push_back(w->getInput());
+	p.nIn = p.weights.size() / p.nOut - 1;
+
+	if(pending.size() && pending.back().nOut != p.nIn)
+	{
+		std::cout << "QuantizedNetwork:\t layer has " << p.nIn << " inputs, expected "
+			<< pending.back().nOut << "." << std::endl;
+		throw new std::exception();
+	}
+
+	pending.push_back(p);
+}
+
+void QuantizedNetwork::calibrate(const double* inputs, unsigned n)
+{
+	if(pending.empty() || !n)
+		throw new std::exception();
+
+	// run the samples through the double weights, tracking each layer's input range
+	std::vector<double> maxAbs(pending.size(), 0);
+	std::vector<double> x, y;
+
+	for(unsigned s = 0; s < n; ++s)
+	{
+		x.assign(inputs + s*pending[0].nIn, inputs + (s+1)*pending[0].nIn);
+
+		for(unsigned l = 0; l < pending.size(); ++l)
+		{
+			auto& p = pending[l];
+			for(double v : x)
+				maxAbs[l] = std::max(maxAbs[l], std::abs(v));
+
+			y.resize(p.nOut);
+			for(unsigned o = 0; o < p.nOut; ++o)
+			{
+				const double* w = &p.weights[o * (p.nIn + 1)];
+				double v = 0;
+				for(unsigned i = 0; i < p.nIn; ++i)
+					v += w[i] * x[i];
+				v += w[p.nIn] * p.biasValue;
+
+				y[o] = p.activation ? p.activation(v) : v;
+			}
+			x.swap(y);
+		}
+	}
+
+	layers.clear();
+	for(unsigned l = 0; l < pending.size(); ++l)
+	{
+		auto& p = pending[l];
+
+		QuantizedLayer q;
+		q.nIn = p.nIn;
+		q.nOut = p.nOut;
+		q.inputScale = scaleFor(maxAbs[l]);
+		q.activation = p.activation;
+
+		for(unsigned o = 0; o < p.nOut; ++o)
+		{
+			const double* w = &p.weights[o * (p.nIn + 1)];
+
+			double rowMax = 0;
+			for(unsigned i = 0; i < p.nIn; ++i)
+				rowMax = std::max(rowMax, std::abs(w[i]));
+
+			float scale = scaleFor(rowMax);
+			q.rowScale.push_back(scale);
+			for(unsigned i = 0; i < p.nIn; ++i)
+				q.weights.push_back(quantize(w[i], scale));
+
+			// in units of the accumulator, so it's added before dequantizing
+			double b = w[p.nIn] * p.biasValue / (double(scale) * q.inputScale);
+			q.bias.push_back(std::max(-2147483647.0, std::min(2147483647.0, std::round(b))));
+		}
+
+		layers.push_back(q);
+	}
+
+	pending.clear();
+}
+
+unsigned QuantizedNetwork::inputWidth() const
+{
+	return layers.size() ? layers.front().nIn : pending.size() ? pending.front().nIn : 0;
+}
+
+unsigned QuantizedNetwork::outputWidth() const
+{
+	return layers.size() ? layers.back().nOut : pending.size() ? pending.back().nOut : 0;
+}
+
+void QuantizedNetwork::predict(const double* in, double* out) const
+{
+	if(!isCalibrated())
+	{
+		std::cout << "QuantizedNetwork:\t call calibrate() first." << std::endl;
+		throw new std::exception();
+	}
+
+	thread_local std::vector<double> a, b;
+	thread_local std::vector<int8_t> scratch;
+
+	unsigned w = maxWidth(layers);
+	a.resize(w);
+	b.resize(w);
+	scratch.resize(w);
+
+	const double* x = in;
+	for(unsigned l = 0; l < layers.size(); ++l)
+	{
+		double* y = l + 1 == layers.size() ? out : (l % 2 ? b.data() : a.data());
+		layers[l].forward(x, scratch.data(), y);
+		x = y;
+	}
+}
+
+size_t QuantizedNetwork::bytes() const
+{
+	size_t total = 0;
+	for(auto& l : layers)
+		total += l.bytes();
+	return total;
+}
+
+size_t QuantizedNetwork::doubleBytes() const
+{
+	size_t total = 0;
+	for(auto& l : layers)
+		total += (l.nIn + 1) * l.nOut * sizeof(double);
+	for(auto& p : pending)
+		total += p.weights.size() * sizeof(double);
+	return total;
+}
+
+// ---------------------- Report ----------------------
+
+QuantizationReport compareQuantized(Graph& graph, const QuantizedNetwork& q, const double* inputs, unsigned n)
+{
+	QuantizationReport r;
+	r.samples = n;
+	r.doubleBytes = q.doubleBytes();
+	r.quantizedBytes = q.bytes();
+
+	ExecutionContext ctx(graph);
+	unsigned inW = q.inputWidth();
+	unsigned outW = q.outputWidth();
+
+	if(ctx.getSchedule().inputIndex.size() != inW || ctx.getSchedule().outputSlot.size() != outW)
+	{
+		std::cout << "compareQuantized:\t the graph and the network differ in shape." << std::endl;
+		throw new std::exception();
+	}
+	std::vector<double> out(outW);
+
+	double sumAbs = 0, sumSquares = 0;
+	for(unsigned s = 0; s < n; ++s)
+	{
+		auto& expected = graph.forwardPass(ctx, inputs + s*inW);
+		q.predict(inputs + s*inW, out.data());
+
+		for(unsigned o = 0; o < outW; ++o)
+		{
+			double e = std::abs(out[o] - expected[o]);
+			r.maxAbsError = std::max(r.maxAbsError, e);
+			r.maxAbsOutput = std::max(r.maxAbsOutput, std::abs(expected[o]));
+			sumAbs += e;
+			sumSquares += e*e;
+		}
+	}
+
+	if(n && outW)
+	{
+		r.meanAbsError = sumAbs / (n * outW);
+		r.rmsError = std::sqrt(sumSquares / (n * outW));
+	}
+
+	return r;
+}
+
+void QuantizationReport::write(std::ostream& out) const
+{
+	out << "quantization drift over " << samples << " samples\n"
+		<< "  max abs error:   " << maxAbsError << " (outputs up to " << maxAbsOutput << ")\n"
+		<< "  mean abs error:  " << meanAbsError << "\n"
+		<< "  rms error:       " << rmsError << "\n"
+		<< "  weights:         " << quantizedBytes << " bytes, down from " << doubleBytes << "\n";
+}
@@ -0,0 +1,109 @@
+#include "recurrent.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+// ---------------------- Recurrence ----------------------
+
+Recurrence::Recurrence(unsigned nInputs, unsigned nHidden, unsigned window)
+: cellInputs(nInputs + nHidden)
+, nIn(nInputs)
+, nHidden(nHidden)
+, window(window)
+{
+	if(!nInputs || !nHidden || !window)
+	{
+		std::cout << "Recurrence:\t inputs, hidden units and window must all be nonzero." << std::endl;
+		throw new std::exception();
+	}
+
+	cell.addInputNodes(cellInputs.getInputs());
+}
+
+void Recurrence::compile()
+{
+	if(cell.outputNodes.size() != nHidden)
+	{
+		std::cout << "Recurrence:\t the cell has " << cell.outputNodes.size() << " outputs, expected "
+			<< nHidden << "." << std::endl;
+		throw new std::exception();
+	}
+
+	contexts.clear();
+	for(unsigned i = 0; i < window; ++i)
+		contexts.emplace_back(new ExecutionContext(cell));
+
+	stepInput.assign(nIn + nHidden, 0);
+	seed.resize(nHidden);
+	carry.resize(nHidden);
+	reset();
+}
+
+void Recurrence::randomizeWeights()
+{
+	auto w = cell.parameters.values();
+	double range = 1 / std::sqrt(double(nIn + nHidden + 1));
+
+	for(auto& x : w)
+		x = range * (2.0 * rand() / RAND_MAX - 1);
+}
+
+void Recurrence::reset()
+{
+	hidden.assign(nHidden, 0);
+	next = 0;
+	pending = 0;
+}
+
+const std::vector<double>& Recurrence::step(const double* x)
+{
+	PROFILE_PHASE("Recurrence::step");
+
+	std::copy(x, x + nIn, stepInput.begin());
+	std::copy(hidden.begin(), hidden.end(), stepInput.begin() + nIn);
+
+	auto& ctx = *contexts[next];
+	hidden = cell.forwardPass(ctx, stepInput.data());
+
+	next = (next + 1) % window;
+	pending = std::min(pending + 1, window);
+
+	return hidden;
+}
+
+void Recurrence::backward(const double* dH)
+{
+	PROFILE_PHASE("Recurrence::backward");
+
+	auto grads = cell.parameters.gradients().data();
+	std::fill(carry.begin(), carry.end(), 0);
+
+	// newest step first; each step's dLoss/dh_{t-1} flows into the step before
+	for(unsigned s = pending; s-- > 0; )
+	{
+		auto& ctx = *contexts[(next + window - pending + s) % window];
+
+		for(unsigned j = 0; j < nHidden; ++j)
+			seed[j] = dH[s*nHidden + j] + carry[j];
+
+		cell.backProp(ctx, seed.data(), nHidden);
+		ctx.accumulateGradients(grads);
+
+		for(unsigned j = 0; j < nHidden; ++j)
+			carry[j] = ctx.getInputGradient(nIn + j);
+	}
+
+	// the gradient into the window's first h_{t-1} is where truncation cuts
+	pending = 0;
+}
+
+size_t Recurrence::activationBytes() const
+{
+	size_t total = 0;
+	for(auto& ctx : contexts)
+		total += ctx->activationBytes();
+	return total;
+}
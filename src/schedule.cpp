@@ -0,0 +1,195 @@
+#include "schedule.h"
+#include "graph.h"
+#include "nodetypes.h"
+
+#include <iostream>
+
+void Schedule::build(const std::vector<InputNode*> &inputs,
+	const std::vector<InputNode*> &params,
+	const std::vector<Node*> &outputs)
+{
+	nodes.clear();
+	levels.clear();
+	reachesOutput.clear();
+	outputIndex.clear();
+	indexOf.clear();
+	childOffsets.clear();
+	childIndices.clear();
+	parentOffsets.clear();
+	parentIndices.clear();
+	argOffsets.clear();
+	argIndices.clear();
+	constants.clear();
+	inputIndex.clear();
+	paramIndex.clear();
+	outputSlot.clear();
+
+	// collect everything reachable from the start nodes
+	std::vector<Node*> stack;
+	std::vector<Node*> reachable;
+	auto visit = [&](Node* n) {
+		if(indexOf.emplace(n, reachable.size()).second)
+		{
+			reachable.push_back(n);
+			stack.push_back(n);
+		}
+	};
+
+	for(auto n : inputs) visit(n);
+	for(auto n : params) visit(n);
+
+	while(stack.size())
+	{
+		auto n = stack.back();
+		stack.pop_back();
+
+		for(auto c : n->children)
+			visit(c);
+	}
+
+	// count the parents each node waits on, ignoring constants
+	std::vector<unsigned> waiting(reachable.size(), 0);
+	for(unsigned i = 0; i < reachable.size(); ++i)
+	{
+		for(auto p : reachable[i]->parents)
+		{
+			if(indexOf.count(p))
+				waiting[i]++;
+		}
+	}
+
+	// peel off one level at a time
+	nodes.reserve(reachable.size());
+	for(unsigned i = 0; i < reachable.size(); ++i)
+	{
+		if(!waiting[i])
+			nodes.push_back(reachable[i]);
+	}
+
+	unsigned begin = 0;
+	while(begin < nodes.size())
+	{
+		levels.push_back(begin);
+		unsigned end = nodes.size();
+
+		for(unsigned i = begin; i < end; ++i)
+		{
+			for(auto c : nodes[i]->children)
+			{
+				if(--waiting[indexOf[c]] == 0)
+					nodes.push_back(c);
+			}
+		}
+
+		begin = end;
+	}
+	levels.push_back(nodes.size());
+
+	if(nodes.size() != reachable.size())
+	{
+		std::cout << "Schedule::build:\t graph contains a cycle." << std::endl;
+		throw new std::exception();
+	}
+
+	for(unsigned i = 0; i < nodes.size(); ++i)
+		indexOf[nodes[i]] = i;
+
+	for(auto n : nodes)
+	{
+		childOffsets.push_back(childIndices.size());
+		for(auto c : n->children)
+			childIndices.push_back(indexOf[c]);
+
+		parentOffsets.push_back(parentIndices.size());
+		for(auto p : n->parents)
+		{
+			auto it = indexOf.find(p);
+			if(it != indexOf.end())
+				parentIndices.push_back(it->second);
+		}
+	}
+	childOffsets.push_back(childIndices.size());
+	parentOffsets.push_back(parentIndices.size());
+
+	std::unordered_map<const Node*, int> constantIndex;
+	auto slot = [&](Node* p) {
+		auto it = indexOf.find(p);
+		if(it != indexOf.end())
+			return (int)it->second;
+
+		auto c = constantIndex.emplace(p, constants.size());
+		if(c.second)
+			constants.push_back(p);
+		return -(c.first->second + 1);
+	};
+
+	for(auto n : nodes)
+	{
+		argOffsets.push_back(argIndices.size());
+		for(auto p : n->parents)
+			argIndices.push_back(slot(p));
+	}
+	argOffsets.push_back(argIndices.size());
+
+	for(auto n : inputs)
+		inputIndex.push_back(indexOf[n]);
+	for(auto n : params)
+		paramIndex.push_back(indexOf[n]);
+	for(auto n : outputs)
+		outputSlot.push_back(slot(n));
+
+	// walk backwards to find the nodes that feed into an output
+	reachesOutput.assign(nodes.size(), 0);
+	outputIndex.assign(nodes.size(), -1);
+	for(unsigned i = 0; i < outputs.size(); ++i)
+	{
+		auto it = indexOf.find(outputs[i]);
+		if(it != indexOf.end())
+		{
+			reachesOutput[it->second] = 1;
+			outputIndex[it->second] = i;
+		}
+	}
+
+	for(unsigned i = nodes.size(); i-- > 0; )
+	{
+		for(auto c : nodes[i]->children)
+		{
+			if(reachesOutput[indexOf[c]])
+				reachesOutput[i] = 1;
+		}
+	}
+
+	built = true;
+	version = Node::topologyVersion;
+	inputNodes = inputs;
+	paramNodes = params;
+	outputNodes = outputs;
+}
+
+size_t Schedule::bytes() const
+{
+	size_t total = (nodes.capacity() + constants.capacity()) * sizeof(Node*)
+		+ reachesOutput.capacity()
+		+ (outputIndex.capacity() + argIndices.capacity() + outputSlot.capacity()) * sizeof(int)
+		+ (levels.capacity() + childOffsets.capacity() + childIndices.capacity()
+			+ parentOffsets.capacity() + parentIndices.capacity() + argOffsets.capacity()
+			+ inputIndex.capacity() + paramIndex.capacity()) * sizeof(unsigned);
+
+	// a heap node per entry, plus the bucket array
+	total += indexOf.size() * (sizeof(std::pair<const Node*, unsigned>) + sizeof(void*))
+		+ indexOf.bucket_count() * sizeof(void*);
+
+	return total;
+}
+
+bool Schedule::isStale(const std::vector<InputNode*> &inputs,
+	const std::vector<InputNode*> &params,
+	const std::vector<Node*> &outputs) const
+{
+	return !built
+		|| version != Node::topologyVersion
+		|| inputs != inputNodes
+		|| params != paramNodes
+		|| outputs != outputNodes;
+}
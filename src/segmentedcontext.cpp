@@ -0,0 +1,267 @@
+#include "segmentedcontext.h"
+#include "nodetypes.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// ---------------------- Segmented Context ----------------------
+
+SegmentedContext::SegmentedContext(Graph& g, unsigned nSegments)
+: schedule(g.sharedSchedule())
+{
+	// levels past level 0 are the ones that get evaluated
+	unsigned depth = schedule->numLevels() > 1 ? schedule->numLevels() - 1 : 0;
+	if(!nSegments)
+		nSegments = std::max(1.0, std::round(std::sqrt(double(depth))));
+	nSegments = std::min(nSegments, std::max(depth, 1u));
+
+	std::vector<unsigned> cuts;
+	for(unsigned j = 1; j < nSegments; ++j)
+		cuts.push_back(1 + (unsigned)std::lround(double(j) * depth / nSegments));
+
+	build(cuts);
+}
+
+SegmentedContext::SegmentedContext(Graph& g, const std::vector<Node*>& boundaries)
+: schedule(g.sharedSchedule())
+{
+	auto& s = *schedule;
+
+	std::vector<unsigned> cuts;
+	for(auto n : boundaries)
+	{
+		auto it = s.indexOf.find(n);
+		if(it == s.indexOf.end())
+		{
+			std::cout << "SegmentedContext:\t boundary node isn't part of the graph." << std::endl;
+			throw new std::exception();
+		}
+
+		// the level after the node's
+		unsigned level = std::upper_bound(s.levels.begin(), s.levels.end(), it->second) - s.levels.begin() - 1;
+		cuts.push_back(level + 1);
+	}
+
+	build(cuts);
+}
+
+void SegmentedContext::build(std::vector<unsigned> cuts)
+{
+	auto& s = *schedule;
+	unsigned n = s.nodes.size();
+	unsigned first = s.levels.size() > 1 ? s.levels[1] : 0;
+
+	std::sort(cuts.begin(), cuts.end());
+	cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+	segments.assign(1, first);
+	for(auto c : cuts)
+	{
+		if(c > 1 && c < s.numLevels())
+			segments.push_back(s.levels[c]);
+	}
+	segments.push_back(n);
+
+	// the params, inputs and constants always have a slot
+	slotOf.assign(n, -1);
+	nParams = s.paramIndex.size();
+	for(unsigned k = 0; k < nParams; ++k)
+		slotOf[s.paramIndex[k]] = k;
+
+	unsigned nSlots = nParams;
+	for(auto i : s.inputIndex)
+		slotOf[i] = nSlots++;
+
+	constantBase = nSlots;
+	nSlots += s.constants.size();
+
+	auto slot = [&](int a) {
+		if(a < 0)
+			return int(constantBase - a - 1);
+		if(slotOf[a] < 0)
+			slotOf[a] = nSlots++;
+		return slotOf[a];
+	};
+
+	// every argument either comes from the same segment, or has to be kept
+	localArgs.assign(s.argIndices.size(), 0);
+	unsigned maxNodes = 0, maxEdges = 0, maxArgs = 0;
+
+	for(unsigned k = 0; k + 1 < segments.size(); ++k)
+	{
+		unsigned begin = segments[k], end = segments[k+1];
+		maxNodes = std::max(maxNodes, end - begin);
+		maxEdges = std::max(maxEdges, s.argOffsets[end] - s.argOffsets[begin]);
+
+		for(unsigned i = begin; i < end; ++i)
+		{
+			maxArgs = std::max(maxArgs, s.argOffsets[i+1] - s.argOffsets[i]);
+
+			for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+			{
+				int a = s.argIndices[e];
+				if(a >= int(begin))
+					localArgs[e] = a - begin;
+				else
+					localArgs[e] = -slot(a) - 1;
+			}
+		}
+	}
+
+	outputSlot.clear();
+	for(int a : s.outputSlot)
+		outputSlot.push_back(slot(a));
+
+	kept.assign(nSlots - nParams, 0);
+	keptAdjoints.assign(nSlots, 0);
+
+	values.assign(maxNodes, 0);
+	adjoints.assign(maxNodes, 0);
+	partials.assign(maxEdges, 0);
+	args.resize(maxArgs);
+	outputs.assign(s.outputSlot.size(), 0);
+}
+
+void SegmentedContext::evaluate(unsigned k)
+{
+	auto& s = *schedule;
+	unsigned begin = segments[k], end = segments[k+1];
+	unsigned edges = s.argOffsets[begin];
+
+	for(unsigned i = begin; i < end; ++i)
+	{
+		unsigned b = s.argOffsets[i];
+		unsigned e = s.argOffsets[i+1];
+
+		for(unsigned j = b; j < e; ++j)
+		{
+			int a = localArgs[j];
+			args[j - b] = a >= 0 ? values[a] : slotValue(-a - 1);
+		}
+
+		double v = s.nodes[i]->compute(args.data(), partials.data() + (b - edges));
+		values[i - begin] = v;
+		if(slotOf[i] >= 0)
+			kept[slotOf[i] - nParams] = v;
+	}
+
+	resident = k;
+}
+
+double SegmentedContext::getGradient(unsigned param) const
+{
+	return keptAdjoints[slotOf[schedule->paramIndex.at(param)]];
+}
+
+double SegmentedContext::getInputGradient(unsigned input) const
+{
+	return keptAdjoints[slotOf[schedule->inputIndex.at(input)]];
+}
+
+void SegmentedContext::accumulateGradients(double* grads, double scale) const
+{
+	auto& index = schedule->paramIndex;
+	unsigned n = index.size();
+
+	for(unsigned k = 0; k < n; ++k)
+		grads[k] += scale * keptAdjoints[slotOf[index[k]]];
+}
+
+size_t SegmentedContext::activationBytes() const
+{
+	return sizeof(double) * (kept.size() + keptAdjoints.size()
+		+ values.size() + partials.size() + adjoints.size() + outputs.size());
+}
+
+size_t SegmentedContext::unsegmentedBytes() const
+{
+	// as ExecutionContext::activationBytes
+	auto& s = *schedule;
+	return sizeof(double) * (2 * s.nodes.size() + s.argIndices.size() + s.outputSlot.size());
+}
+
+// ---------------------- Graph ----------------------
+
+const std::vector<double>& Graph::forwardPass(SegmentedContext& ctx, const double* inputValues)
+{
+	PROFILE_PHASE("Graph::forwardPass(segmented)");
+
+	auto& s = *ctx.schedule;
+	auto& kept = ctx.kept;
+	unsigned base = ctx.nParams;
+
+	ctx.weights = ctx.params ? ctx.params : parameters.values().data();
+
+	for(unsigned i = 0; i < s.inputIndex.size(); ++i)
+		kept[ctx.slotOf[s.inputIndex[i]] - base] = inputValues[i];
+
+	for(unsigned c = 0; c < s.constants.size(); ++c)
+		kept[ctx.constantBase + c - base] = s.constants[c]->getOutput();
+
+	for(unsigned k = 0; k + 1 < ctx.segments.size(); ++k)
+		ctx.evaluate(k);
+
+	for(unsigned o = 0; o < ctx.outputSlot.size(); ++o)
+		ctx.outputs[o] = ctx.slotValue(ctx.outputSlot[o]);
+
+	return ctx.outputs;
+}
+
+void Graph::backProp(SegmentedContext& ctx, const double *baseDeriv, unsigned n)
+{
+	PROFILE_PHASE("Graph::backProp(segmented)");
+
+	auto& s = *ctx.schedule;
+	if(n != s.outputSlot.size() || !ctx.weights)
+		throw new std::exception();
+
+	double* keptAdjoints = ctx.keptAdjoints.data();
+	std::fill(ctx.keptAdjoints.begin(), ctx.keptAdjoints.end(), 0);
+
+	for(unsigned o = 0; o < n; ++o)
+	{
+		if(s.outputSlot[o] >= 0)
+			keptAdjoints[ctx.outputSlot[o]] += baseDeriv[o];
+	}
+
+	double* adjoints = ctx.adjoints.data();
+	const double* partials = ctx.partials.data();
+	unsigned last = ctx.segments.size() - 1;
+
+	for(unsigned k = last; k-- > 0; )
+	{
+		unsigned begin = ctx.segments[k], end = ctx.segments[k+1];
+		unsigned edges = s.argOffsets[begin];
+
+		// right after the forward pass, the last segment is still there
+		if(ctx.resident != int(k))
+			ctx.evaluate(k);
+
+		// kept nodes start from what later segments pushed to them
+		for(unsigned i = begin; i < end; ++i)
+			adjoints[i - begin] = ctx.slotOf[i] >= 0 ? keptAdjoints[ctx.slotOf[i]] : 0;
+
+		for(unsigned i = end; i-- > begin; )
+		{
+			double a = adjoints[i - begin];
+			if(a == 0)
+				continue;
+
+			for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+			{
+				int p = ctx.localArgs[e];
+				if(p >= 0)
+					adjoints[p] += a * partials[e - edges];
+				else
+					keptAdjoints[-p - 1] += a * partials[e - edges];
+			}
+		}
+	}
+}
+
+void Graph::backProp(SegmentedContext& ctx, const std::vector<double>& baseDeriv)
+{
+	backProp(ctx, baseDeriv.data(), baseDeriv.size());
+}
@@ -0,0 +1,303 @@
+#include "sparseinput.h"
+#include "nodetypes.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+// ---------------------- Sparse Rows ----------------------
+
+void SparseRows::addRow(const unsigned* idx, const double* vals, unsigned nnz)
+{
+	for(unsigned i = 0; i < nnz; ++i)
+	{
+		if(idx[i] >= cols)
+			throw new std::exception();
+
+		indices.push_back(idx[i]);
+		values.push_back(vals[i]);
+	}
+	offsets.push_back(indices.size());
+}
+
+void SparseRows::addDenseRow(const double* row)
+{
+	for(unsigned c = 0; c < cols; ++c)
+	{
+		if(row[c] != 0)
+		{
+			indices.push_back(c);
+			values.push_back(row[c]);
+		}
+	}
+	offsets.push_back(indices.size());
+}
+
+// ---------------------- Sparse Context ----------------------
+
+SparseContext::SparseContext(Graph& g)
+: schedule(g.sharedSchedule())
+{
+	auto& s = *schedule;
+	unsigned n = s.nodes.size();
+	unsigned nInputs = s.inputIndex.size();
+
+	paramOf.assign(n, -1);
+	for(unsigned k = 0; k < s.paramIndex.size(); ++k)
+		paramOf[s.paramIndex[k]] = k;
+
+	std::vector<int> inputOf(n, -1);
+	for(unsigned c = 0; c < nInputs; ++c)
+		inputOf[s.inputIndex[c]] = c;
+
+	auto fail = [](const char* msg) {
+		std::cout << "SparseContext:\t " << msg << std::endl;
+		throw new std::exception();
+	};
+
+	// the first layer: VectorMultNodes reading an input
+	isSparse.assign(n, 0);
+	std::vector<std::vector<Consumer>> byInput(nInputs);
+	fixedOffsets.push_back(0);
+
+	for(unsigned i = 0; i < n; ++i)
+	{
+		unsigned begin = s.argOffsets[i];
+		unsigned end = s.argOffsets[i+1];
+
+		bool readsInput = false;
+		for(unsigned e = begin; e < end; ++e)
+			readsInput = readsInput || (s.argIndices[e] >= 0 && inputOf[s.argIndices[e]] >= 0);
+		if(!readsInput)
+			continue;
+
+		if(!dynamic_cast<VectorMultNode*>(s.nodes[i]))
+			fail("an input feeds a node that isn't a VectorMultNode.");
+
+		isSparse[i] = 1;
+		sparseNodes.push_back(i);
+
+		// sum of in[m] * in[l+m]
+		unsigned l = (end - begin) / 2;
+		for(unsigned m = 0; m < l; ++m)
+		{
+			int a = s.argIndices[begin + m];
+			int b = s.argIndices[begin + l + m];
+			bool aIn = a >= 0 && inputOf[a] >= 0;
+			bool bIn = b >= 0 && inputOf[b] >= 0;
+
+			if(aIn || bIn)
+			{
+				int other = aIn ? b : a;
+				if(aIn == bIn || other < 0 || paramOf[other] < 0)
+					fail("an input is multiplied with something other than a param.");
+
+				byInput[inputOf[aIn ? a : b]].push_back({ i, (unsigned)paramOf[other] });
+				continue;
+			}
+
+			// evaluated before the rest of the graph, so only params and constants
+			if((a >= 0 && paramOf[a] < 0) || (b >= 0 && paramOf[b] < 0))
+				fail("a first layer node reads a computed node.");
+
+			fixedEdges.push_back(begin + m);
+			fixedEdges.push_back(begin + l + m);
+		}
+		fixedOffsets.push_back(fixedEdges.size());
+	}
+
+	consumerOffsets.push_back(0);
+	for(auto& c : byInput)
+	{
+		consumers.insert(consumers.end(), c.begin(), c.end());
+		consumerOffsets.push_back(consumers.size());
+	}
+
+	// params read anywhere but against an input
+	std::vector<char> dense(s.paramIndex.size(), 0);
+	for(unsigned i = 0; i < n; ++i)
+	{
+		if(isSparse[i])
+			continue;
+		for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+		{
+			int a = s.argIndices[e];
+			if(a >= 0 && paramOf[a] >= 0)
+				dense[paramOf[a]] = 1;
+		}
+	}
+	for(auto e : fixedEdges)
+	{
+		int a = s.argIndices[e];
+		if(a >= 0)
+			dense[paramOf[a]] = 1;
+	}
+	for(int a : s.outputSlot)
+	{
+		if(a >= 0 && paramOf[a] >= 0)
+			dense[paramOf[a]] = 1;
+	}
+	for(unsigned k = 0; k < dense.size(); ++k)
+	{
+		if(dense[k])
+			denseParams.push_back(k);
+	}
+
+	values.assign(n, 0);
+	adjoints.assign(n, 0);
+	partials.assign(s.argIndices.size(), 0);
+	outputs.assign(s.outputSlot.size(), 0);
+
+	unsigned maxArgs = 0;
+	for(unsigned i = 0; i < n; ++i)
+		maxArgs = std::max(maxArgs, s.argOffsets[i+1] - s.argOffsets[i]);
+	args.resize(maxArgs);
+}
+
+void SparseContext::accumulateGradients(double* grads, double scale) const
+{
+	auto& s = *schedule;
+
+	for(auto k : denseParams)
+		grads[k] += scale * adjoints[s.paramIndex[k]];
+
+	// d/dw of x * w is x, times the adjoint of the node
+	for(unsigned j = 0; j < rowIndices.size(); ++j)
+	{
+		unsigned c = rowIndices[j];
+		double x = scale * rowValues[j];
+
+		for(unsigned u = consumerOffsets[c]; u < consumerOffsets[c+1]; ++u)
+			grads[consumers[u].param] += x * adjoints[consumers[u].node];
+	}
+}
+
+// ---------------------- Graph ----------------------
+
+const std::vector<double>& Graph::forwardPass(SparseContext& ctx, const SparseRow& row)
+{
+	PROFILE_PHASE("Graph::forwardPass(sparse)");
+
+	auto& s = *ctx.schedule;
+	const double* w = ctx.params ? ctx.params : parameters.values().data();
+	double* values = ctx.values.data();
+	double* partials = ctx.partials.data();
+	ctx.weights = w;
+
+	ctx.rowIndices.assign(row.indices, row.indices + row.nnz);
+	ctx.rowValues.assign(row.values, row.values + row.nnz);
+
+	for(auto k : ctx.denseParams)
+		values[s.paramIndex[k]] = relaxedLoad(w + k);
+
+	auto valueOf = [&](int a) {
+		return a >= 0 ? values[a] : s.constants[-a - 1]->getOutput();
+	};
+
+	// the first layer: the pairs without inputs, then the nonzero inputs
+	for(unsigned j = 0; j < ctx.sparseNodes.size(); ++j)
+	{
+		double sum = 0;
+		for(unsigned f = ctx.fixedOffsets[j]; f < ctx.fixedOffsets[j+1]; f += 2)
+		{
+			unsigned e1 = ctx.fixedEdges[f], e2 = ctx.fixedEdges[f+1];
+			double a = valueOf(s.argIndices[e1]);
+			double b = valueOf(s.argIndices[e2]);
+			partials[e1] = b;
+			partials[e2] = a;
+			sum += a * b;
+		}
+		values[ctx.sparseNodes[j]] = sum;
+	}
+
+	for(unsigned j = 0; j < row.nnz; ++j)
+	{
+		unsigned c = row.indices[j];
+		double x = row.values[j];
+		if(c >= s.inputIndex.size())
+			throw new std::exception();
+
+		for(unsigned u = ctx.consumerOffsets[c]; u < ctx.consumerOffsets[c+1]; ++u)
+			values[ctx.consumers[u].node] += x * relaxedLoad(w + ctx.consumers[u].param);
+	}
+
+	// everything past the first layer, as ExecutionContext does
+	double* args = ctx.args.data();
+	unsigned n = s.nodes.size();
+	for(unsigned i = s.levels.size() > 1 ? s.levels[1] : n; i < n; ++i)
+	{
+		if(ctx.isSparse[i])
+			continue;
+
+		unsigned begin = s.argOffsets[i];
+		unsigned end = s.argOffsets[i+1];
+
+		for(unsigned e = begin; e < end; ++e)
+			args[e - begin] = valueOf(s.argIndices[e]);
+
+		values[i] = s.nodes[i]->compute(args, partials + begin);
+	}
+
+	for(unsigned o = 0; o < s.outputSlot.size(); ++o)
+		ctx.outputs[o] = valueOf(s.outputSlot[o]);
+
+	return ctx.outputs;
+}
+
+void Graph::backProp(SparseContext& ctx, const double *baseDeriv, unsigned n)
+{
+	PROFILE_PHASE("Graph::backProp(sparse)");
+
+	auto& s = *ctx.schedule;
+	if(n != s.outputSlot.size())
+		throw new std::exception();
+
+	double* adjoints = ctx.adjoints.data();
+	const double* partials = ctx.partials.data();
+	unsigned first = s.levels.size() > 1 ? s.levels[1] : s.nodes.size();
+
+	// level 0 is mostly first layer weights, which are never pushed to
+	std::fill(ctx.adjoints.begin() + first, ctx.adjoints.end(), 0);
+	for(auto k : ctx.denseParams)
+		adjoints[s.paramIndex[k]] = 0;
+
+	for(unsigned o = 0; o < n; ++o)
+	{
+		if(s.outputSlot[o] >= 0)
+			adjoints[s.outputSlot[o]] += baseDeriv[o];
+	}
+
+	unsigned j = ctx.sparseNodes.size();
+	for(unsigned i = s.nodes.size(); i-- > first; )
+	{
+		double a = adjoints[i];
+
+		if(ctx.isSparse[i])
+		{
+			// the input pairs are left to accumulateGradients
+			--j;
+			for(unsigned f = ctx.fixedOffsets[j]; f < ctx.fixedOffsets[j+1]; ++f)
+			{
+				int p = s.argIndices[ctx.fixedEdges[f]];
+				if(p >= 0)
+					adjoints[p] += a * partials[ctx.fixedEdges[f]];
+			}
+			continue;
+		}
+
+		if(a == 0)
+			continue;
+
+		for(unsigned e = s.argOffsets[i]; e < s.argOffsets[i+1]; ++e)
+		{
+			int p = s.argIndices[e];
+			if(p >= 0)
+				adjoints[p] += a * partials[e];
+		}
+	}
+}
+
+void Graph::backProp(SparseContext& ctx, const std::vector<double>& baseDeriv)
+{
+	backProp(ctx, baseDeriv.data(), baseDeriv.size());
+}
@@ -0,0 +1,9 @@
+#include "sweep.h"
+
+std::vector<TrialConfig> restarts(unsigned n, TrialConfig base, unsigned firstSeed)
+{
+	std::vector<TrialConfig> configs(n, base);
+	for(unsigned i = 0; i < n; ++i)
+		configs[i].seed = firstSeed + i;
+	return configs;
+}
@@ -0,0 +1,107 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+unsigned ThreadPool::defaultWorkers()
+{
+	unsigned n = std::thread::hardware_concurrency();
+	return n > 1 ? n - 1 : 0;
+}
+
+ThreadPool::ThreadPool(unsigned nWorkers)
+{
+	workers.reserve(nWorkers);
+	for(unsigned i = 0; i < nWorkers; ++i)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i + 1);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for(auto& t : workers)
+		t.join();
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+	unsigned long seen = 0;
+
+	while(true)
+	{
+		const std::function<void(unsigned)>* f;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return stopping || generation != seen; });
+
+			if(stopping)
+				return;
+
+			seen = generation;
+			f = job;
+		}
+
+		(*f)(index);
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			finished++;
+		}
+		done.notify_one();
+	}
+}
+
+void ThreadPool::runOnAll(const std::function<void(unsigned)>& f)
+{
+	if(workers.empty())
+	{
+		f(0);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = &f;
+		finished = 0;
+		generation++;
+	}
+	wake.notify_all();
+
+	f(0);
+
+	std::unique_lock<std::mutex> guard(lock);
+	done.wait(guard, [&] { return finished == workers.size(); });
+	job = nullptr;
+}
+
+void ThreadPool::parallelFor(unsigned n, const std::function<void(unsigned)>& f, unsigned grain)
+{
+	if(!grain)
+		grain = 1;
+
+	if(workers.empty() || n <= grain)
+	{
+		for(unsigned i = 0; i < n; ++i)
+			f(i);
+		return;
+	}
+
+	std::atomic<unsigned> next(0);
+
+	runOnAll([&](unsigned) {
+		while(true)
+		{
+			unsigned begin = next.fetch_add(grain);
+			if(begin >= n)
+				break;
+
+			unsigned end = std::min(n, begin + grain);
+			for(unsigned i = begin; i < end; ++i)
+				f(i);
+		}
+	});
+}
@@ -0,0 +1,163 @@
+#include "validator.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+// ---------------------- Validator ----------------------
+
+Validator::Validator(Graph& graph, LossFunction loss)
+: graph(graph)
+, loss(loss)
+, ctx(graph)
+, nParams(ctx.getSchedule().paramIndex.size())
+{
+	evaluator = std::thread([this] { loop(); });
+}
+
+Validator::~Validator()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	evaluator.join();
+}
+
+void Validator::setValidationSet(const double* in, const double* out, unsigned n)
+{
+	wait();
+
+	std::lock_guard<std::mutex> guard(lock);
+	inputs = in;
+	outputs = out;
+	setSize = n;
+}
+
+void Validator::setMinImprovement(double delta)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	minImprovement = delta;
+}
+
+void Validator::submit(unsigned epoch, const double* params)
+{
+	PROFILE_PHASE("Validator::submit");
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if(mailboxFull)
+			++skipped;
+
+		mailbox.assign(params, params + nParams);
+		mailboxEpoch = epoch;
+		mailboxFull = true;
+	}
+	changed.notify_all();
+}
+
+void Validator::wait()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&] { return !mailboxFull && !busy; });
+}
+
+void Validator::loop()
+{
+	std::vector<double> snapshot;
+
+	while(true)
+	{
+		unsigned epoch;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [&] { return stopping || mailboxFull; });
+			if(stopping)
+				return;
+
+			snapshot.swap(mailbox);
+			epoch = mailboxEpoch;
+			mailboxFull = false;
+			busy = true;
+		}
+
+		double l = evaluate(snapshot.data());
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			results.push_back({ epoch, l });
+
+			if(results.size() == 1 || l < bestLoss - minImprovement)
+			{
+				bestLoss = l;
+				bestEpoch = epoch;
+				bestIndex = results.size() - 1;
+				best.swap(snapshot);
+			}
+			busy = false;
+		}
+		changed.notify_all();
+	}
+}
+
+double Validator::evaluate(const double* params)
+{
+	PROFILE_PHASE("Validator::evaluate");
+
+	auto& s = ctx.getSchedule();
+	unsigned inW = s.inputIndex.size();
+	unsigned outW = s.outputSlot.size();
+
+	ctx.setParams(params);
+
+	double total = 0;
+	for(unsigned j = 0; j < setSize; ++j)
+	{
+		auto& out = graph.forwardPass(ctx, inputs + j*inW);
+		total += loss(out.data(), outputs + j*outW, outW);
+	}
+
+	return setSize ? total / setSize : 0;
+}
+
+std::vector<ValidationResult> Validator::getResults()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return results;
+}
+
+double Validator::getLastLoss()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return results.empty() ? 0 : results.back().loss;
+}
+
+unsigned long Validator::getSkipped()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return skipped;
+}
+
+double Validator::getBestLoss()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return bestLoss;
+}
+
+unsigned Validator::getBestEpoch()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return bestEpoch;
+}
+
+std::vector<double> Validator::getBestParams()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return best;
+}
+
+unsigned Validator::sinceBest()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return results.empty() ? 0 : results.size() - 1 - bestIndex;
+}
@@ -1,14 +1,73 @@
 #include "graph.h"
 #include "nodetypes.h"
+#include "profiler.h"
+#include "layers.h"
+#include "executors.h"
+#include "batchoptimizer.h"
+#include "loss.h"
+#include "hogwild.h"
+#include "executioncontext.h"
+#include "microbatcher.h"
+#include "inferenceserver.h"
+#include "codegen.h"
+#include "quantize.h"
+#include "recurrent.h"
+#include "segmentedcontext.h"
+#include "memoryplan.h"
+#include "cholesky.h"
+#include "leastsquares.h"
+#include "lbfgs.h"
+#include "staticnet.h"
+#include "sweep.h"
+#include "sparseinput.h"
+#include "embedding.h"
+#include "gemm.h"
 
 #include <iostream>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+
+#include <csignal>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 void additionTest(double x, double y);
 void multiplicationTest(double x, double y);
 void addMultTest(double x, double y);
 void vectorMultTest();
+void profilerTest();
+void wavefrontTest();
+void workStealingTest();
+void parameterStoreTest();
+void dataParallelTest();
+void dataParallelValidationTest();
+void hogwildTest();
+void executionContextTest();
+void microBatcherTest();
+void codegenTest();
+void quantizeTest();
+void pruneTest();
+void gemmTest();
+void convTest();
+void recurrentTest();
+void earlyStoppingTest();
+void checkpointTest();
+void segmentedContextTest();
+void memoryPlanTest();
+void leastSquaresTest();
+void lbfgsTest();
+void staticNetTest();
+void sweepTest();
+void jacobianTest();
+void sparseInputTest();
+void embeddingTest();
 double randFloatRange(double lower, double higher);
 
 template<typename T>
@@ -33,6 +92,32 @@ int main()
 	multiplicationTest(rand(), rand());
 	addMultTest(rand(), rand());
 	vectorMultTest();
+	profilerTest();
+	wavefrontTest();
+	workStealingTest();
+	parameterStoreTest();
+	dataParallelTest();
+	dataParallelValidationTest();
+	hogwildTest();
+	executionContextTest();
+	microBatcherTest();
+	codegenTest();
+	quantizeTest();
+	pruneTest();
+	gemmTest();
+	convTest();
+	recurrentTest();
+	earlyStoppingTest();
+	checkpointTest();
+	segmentedContextTest();
+	memoryPlanTest();
+	leastSquaresTest();
+	lbfgsTest();
+	staticNetTest();
+	sweepTest();
+	jacobianTest();
+	sparseInputTest();
+	embeddingTest();
 
 	return 0;
 }
@@ -46,6 +131,47 @@ double randFloatRange(double lower, double higher)
 	return rand() * (higher - lower) / RAND_MAX + lower;
 }
 
+// Runs train(rank) for every rank, rank 0 in this process and the others
+// in children. A rank that dies leaves the others blocked in the ring, so
+// every process gets `seconds` before SIGALRM ends it. Returns whether
+// all the children exited cleanly.
+bool runRanks(unsigned ranks, const std::function<void(unsigned)>& train, unsigned seconds = 60)
+{
+	auto onAlarm = [](int) {
+		const char msg[] = "runRanks:\t a rank timed out.\n";
+		if(write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0) {}
+		_exit(1);
+	};
+	auto previous = signal(SIGALRM, onAlarm);
+	alarm(seconds);
+
+	std::vector<pid_t> children;
+	for(unsigned rank = 1; rank < ranks; ++rank)
+	{
+		pid_t pid = fork();
+		if(pid == 0)
+		{
+			train(rank);
+			_exit(0);
+		}
+		children.push_back(pid);
+	}
+
+	train(0);
+
+	bool clean = true;
+	for(auto pid : children)
+	{
+		int status = 0;
+		waitpid(pid, &status, 0);
+		clean = clean && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+
+	alarm(0);
+	signal(SIGALRM, previous);
+	return clean;
+}
+
 void additionTest(double x, double y)
 {
 	Graph graph;
@@ -150,4 +276,1996 @@ void vectorMultTest()
 	double actual = graph.getOutput(0);
 
 	ASSERT_FLOAT_EQUAL(actual, expected, 1e-6);
-}
\ No newline at end of file
+}
+
+void profilerTest()
+{
+	auto& profiler = Profiler::instance();
+	profiler.reset();
+	profiler.startTrace();
+
+	InputNode a, b;
+	AdditionNode o(&a, &b);
+	{
+		ProfileScope phase("phase");
+		ProfileScope node("forward", &o);
+		o.forward();
+	}
+
+	profiler.stopTrace();
+
+	ASSERT_EQUAL(1, profiler.getPhaseStats()["phase"].calls);
+	ASSERT_EQUAL(1, profiler.getNodeStats()["AdditionNode::forward"].calls);
+
+	std::stringstream trace;
+	profiler.writeChromeTrace(trace);
+	ASSERT_EQUAL(true, trace.str().find("\"name\":\"AdditionNode::forward\"") != std::string::npos);
+
+	// the caller's formatting is left as it was
+	trace << 0.5;
+	ASSERT_EQUAL(true, trace.str().substr(trace.str().size() - 3) == "0.5");
+	ASSERT_EQUAL(6, trace.precision());
+
+	// threads record into their own buffers, merged when read, including
+	// those of threads that have already exited
+	const unsigned THREADS = 4, CALLS = 100;
+	std::vector<std::thread> threads;
+	for(unsigned t = 0; t < THREADS; ++t)
+		threads.emplace_back([]() {
+			for(unsigned i = 0; i < CALLS; ++i)
+				ProfileScope phase("threaded");
+		});
+	for(auto& t : threads)
+		t.join();
+
+	ASSERT_EQUAL(THREADS * CALLS, profiler.getPhaseStats()["threaded"].calls);
+	ASSERT_EQUAL(1, profiler.getPhaseStats()["phase"].calls);
+
+	// names are escaped in the trace
+	profiler.startTrace();
+	profiler.record("say \"hi\"\\\n", "phase", 0, 1, 0);
+	profiler.stopTrace();
+	std::stringstream escaped;
+	profiler.writeChromeTrace(escaped);
+	ASSERT_EQUAL(true, escaped.str().find("\"name\":\"say \\\"hi\\\"\\\\\\u000a\"") != std::string::npos);
+
+	profiler.reset();
+	ASSERT_EQUAL(0, profiler.getPhaseStats()["threaded"].calls);
+}
+
+void wavefrontTest()
+{
+	const int W = 8;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	Layer<SigmoidNode> first(inputs.getNodes(), W);
+	Layer<SigmoidNode> second(first.getOutputNodes(), W);
+	LinearLayer third(second.getOutputNodes(), 2);
+
+	for(LinearLayer* l : std::vector<LinearLayer*>{&first, &second, &third})
+	{
+		l->randomizeWeights();
+		graph.addParamNodes(l->getWeightNodes());
+	}
+	graph.outputNodes = third.getOutputNodes();
+
+	std::vector<double> in(W);
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+	std::vector<double> seed = {1, -0.5};
+
+	auto expected = graph.forwardPass(in);
+	graph.backProp(seed);
+
+	std::vector<double> expectedDerivs;
+	for(auto p : graph.paramNodes)
+		expectedDerivs.push_back(p->getDerivative(0));
+
+	// every level goes through the pool
+	ThreadPool pool(3);
+	WavefrontExecutor executor(pool, 1, 1);
+	graph.setExecutor(&executor);
+
+	for(int rep = 0; rep < 3; ++rep)
+	{
+		auto actual = graph.forwardPass(in);
+		graph.backProp(seed);
+
+		for(unsigned i = 0; i < expected.size(); ++i)
+			ASSERT_FLOAT_EQUAL(expected[i], actual[i], 1e-12);
+
+		for(unsigned k = 0; k < graph.paramNodes.size(); ++k)
+			ASSERT_FLOAT_EQUAL(expectedDerivs[k], graph.paramNodes[k]->getDerivative(0), 1e-12);
+	}
+
+	graph.setExecutor(nullptr);
+
+	// graphs built on two threads at once don't lose topology changes
+	const unsigned CHANGES = 10000;
+	unsigned long before = Node::topologyVersion;
+	auto build = []() {
+		InputNode in;
+		SigmoidNode n(&in);
+		for(unsigned i = 1; i < CHANGES; ++i)
+			n.setParent(&in);
+	};
+	std::thread a(build), b(build);
+	a.join();
+	b.join();
+	ASSERT_EQUAL(before + 2 * CHANGES, Node::topologyVersion.load());
+}
+
+void workStealingTest()
+{
+	// a random irregular DAG of additions and multiplications
+	const int N_INPUTS = 8;
+	const int N_NODES = 200;
+
+	Graph graph;
+	std::vector<std::unique_ptr<Node>> nodes;
+	std::vector<Node*> all;
+
+	for(int i = 0; i < N_INPUTS; ++i)
+	{
+		auto in = new InputNode(randFloatRange(0.5, 1.5));
+		nodes.emplace_back(in);
+		all.push_back(in);
+		graph.inputNodes.push_back(in);
+	}
+
+	for(int i = 0; i < N_NODES; ++i)
+	{
+		// mostly pick recent nodes, so the graph gets deep as well as wide
+		Node* a = all.at(all.size() - 1 - rand() % std::min<int>(all.size(), 16));
+		Node* b = all.at(rand() % all.size());
+
+		Node* n;
+		if(rand() % 4)
+			n = new AdditionNode(a, b);
+		else
+			n = new MultiplicationNode(a, b);
+
+		nodes.emplace_back(n);
+		all.push_back(n);
+	}
+
+	for(auto n : all)
+	{
+		if(n->children.empty())
+			graph.outputNodes.push_back(n);
+	}
+
+	std::vector<double> seed(graph.outputNodes.size(), 1);
+
+	auto evaluate = [&](std::vector<double>& outputs, std::vector<double>& derivs) {
+		graph.traverse();
+		graph.backProp(seed);
+
+		outputs.clear();
+		derivs.clear();
+		for(auto n : all)
+			outputs.push_back(n->getOutput());
+		for(auto in : graph.inputNodes)
+			derivs.push_back(in->getDerivative(0));
+	};
+
+	std::vector<double> expectedOutputs, expectedDerivs;
+	evaluate(expectedOutputs, expectedDerivs);
+
+	ThreadPool pool(3);
+	WorkStealingExecutor executor(pool);
+	graph.setExecutor(&executor);
+
+	for(int rep = 0; rep < 5; ++rep)
+	{
+		std::vector<double> outputs, derivs;
+		evaluate(outputs, derivs);
+
+		for(unsigned i = 0; i < outputs.size(); ++i)
+			ASSERT_FLOAT_EQUAL(expectedOutputs[i], outputs[i], 1e-9 * std::max(1.0, ABS(expectedOutputs[i])));
+
+		for(unsigned i = 0; i < derivs.size(); ++i)
+			ASSERT_FLOAT_EQUAL(expectedDerivs[i], derivs[i], 1e-9 * std::max(1.0, ABS(expectedDerivs[i])));
+	}
+
+	graph.setExecutor(nullptr);
+}
+
+void parameterStoreTest()
+{
+	Graph graph;
+
+	InputNode x, w, b;
+	MultiplicationNode m(&x, &w);
+	AdditionNode o(&m, &b);
+
+	// graph computes
+	// o = x * w + b
+
+	w.setInput(3);
+	b.setInput(-1);
+
+	graph.addInputNodes({&x});
+	graph.addParamNodes({&w, &b});
+	graph.outputNodes = {&o};
+
+	auto values = graph.parameters.values();
+	ASSERT_EQUAL(2, values.size());
+	ASSERT_EQUAL(0, reinterpret_cast<size_t>(values.data()) % 64);
+	ASSERT_FLOAT_EQUAL(3, values[0], 1e-12);
+	ASSERT_FLOAT_EQUAL(-1, values[1], 1e-12);
+
+	// writes through either side are seen by the other
+	values[0] = 2;
+	ASSERT_FLOAT_EQUAL(2, w.getInput(), 1e-12);
+	b.setInput(0.5);
+	ASSERT_FLOAT_EQUAL(0.5, values[1], 1e-12);
+
+	ASSERT_FLOAT_EQUAL(4.5, graph.forwardPass(std::vector<double>{2}).at(0), 1e-12);
+
+	graph.backProp({1});
+	graph.updateParams([](double v, double dv) { return v - 0.5 * dv; });
+
+	// do/dw = x = 2, do/db = 1
+	ASSERT_FLOAT_EQUAL(1, w.getInput(), 1e-12);
+	ASSERT_FLOAT_EQUAL(0, b.getInput(), 1e-12);
+	ASSERT_FLOAT_EQUAL(2, graph.parameters.gradients()[0], 1e-12);
+	ASSERT_FLOAT_EQUAL(1, graph.forwardPass(std::vector<double>{1}).at(0), 1e-12);
+
+	// a node can't be a param of two graphs at once...
+	std::cout.setstate(std::ios::failbit);
+	bool threw = false;
+	Graph other;
+	try { other.addParamNodes({&w}); }
+	catch(std::exception* e) { threw = true; delete e; }
+	std::cout.clear();
+	ASSERT_EQUAL(true, threw);
+	ASSERT_EQUAL(0, other.paramNodes.size());
+	ASSERT_EQUAL(0, other.parameters.size());
+
+	// a failed call leaves the graph's params as they were
+	InputNode t(4), s;
+	other.addParamNodes({&t});
+	std::cout.setstate(std::ios::failbit);
+	threw = false;
+	try { other.addParamNodes({&s, nullptr}); }
+	catch(std::exception* e) { threw = true; delete e; }
+	std::cout.clear();
+	ASSERT_EQUAL(true, threw);
+	ASSERT_EQUAL(1, other.paramNodes.size());
+	ASSERT_EQUAL(1, other.parameters.size());
+	ASSERT_FLOAT_EQUAL(4, other.parameters.values()[0], 1e-12);
+	ASSERT_EQUAL(true, s.getStore() == nullptr);
+
+	// ...but it can move on once the first graph is gone, keeping its value
+	InputNode v(2);
+	{
+		Graph first;
+		first.addParamNodes({&v});
+		ASSERT_EQUAL(true, v.getStore() == &first.parameters);
+		first.parameters.values()[0] = 5;
+	}
+	ASSERT_EQUAL(true, v.getStore() == nullptr);
+	ASSERT_FLOAT_EQUAL(5, v.getInput(), 1e-12);
+	Graph second;
+	second.addParamNodes({&v});
+	ASSERT_EQUAL(true, v.getStore() == &second.parameters);
+
+	// layers outlive the graph they were trained in
+	InputNode layerInput;
+	Layer<SigmoidNode> layer(std::vector<Node*>{&layerInput}, 2);
+	{
+		Graph inner;
+		inner.addParamNodes(layer.getWeightNodes());
+		inner.parameters.values()[0] = 0.25;
+	}
+	ASSERT_FLOAT_EQUAL(0.25, layer.getWeightNodes()[0]->getInput(), 1e-12);
+
+	// and a store outlives its nodes
+	{
+		ParameterStore store;
+		{
+			InputNode u(1);
+			store.bind({&u});
+		}
+		store.bind({});
+		ASSERT_EQUAL(0, store.size());
+	}
+
+	// rebinding is counted
+	unsigned long version = graph.parameters.getVersion();
+	graph.parameters.bind(graph.paramNodes);
+	ASSERT_EQUAL(version + 1, graph.parameters.getVersion());
+}
+
+void dataParallelTest()
+{
+	const unsigned RANKS = 3;
+	const unsigned N = 12;
+	const unsigned EPOCHS = 50;
+
+	double inputValues[2*N];
+	double expectedOutputs[N];
+	for(unsigned i = 0; i < N; ++i)
+	{
+		inputValues[2*i] = randFloatRange(-1, 1);
+		inputValues[2*i + 1] = randFloatRange(-1, 1);
+		expectedOutputs[i] = 2*inputValues[2*i] - inputValues[2*i + 1] + 0.5;
+	}
+
+	// what each rank ends up with, plus the initial params of rank 0
+	const unsigned P = 3;
+	auto results = static_cast<double*>(mmap(nullptr, sizeof(double)*P*(RANKS + 1),
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+
+	std::string name = "/toyml_test_" + std::to_string(getpid());
+	SharedMemoryTransport::create(name, RANKS, 16);
+
+	auto train = [&](unsigned rank) {
+		Graph graph;
+		NodeSet<InputNode> inputs(2);
+		LinearLayer layer(inputs.getNodes(), 1);
+		graph.addInputNodes(inputs.getInputs());
+		graph.addParamNodes(layer.getWeightNodes());
+		graph.outputNodes = layer.getOutputNodes();
+
+		// different starting points, the transport syncs them up
+		srand(rank + 1);
+		layer.randomizeWeights();
+		if(rank == 0)
+			std::copy(graph.parameters.values().begin(), graph.parameters.values().end(), results + P*RANKS);
+
+		SharedMemoryTransport transport(name, rank);
+		GradientDescent<SquareLoss> optimizer(&graph);
+		optimizer.setTransport(&transport);
+
+		unsigned shard = N / RANKS;
+		optimizer.setTrainingSet(inputValues + 2*shard*rank, expectedOutputs + shard*rank, shard);
+		optimizer.runEpochs(EPOCHS);
+
+		auto w = graph.parameters.values();
+		std::copy(w.begin(), w.end(), results + P*rank);
+	};
+
+	ASSERT_EQUAL(true, runRanks(RANKS, train));
+	SharedMemoryTransport::unlink(name);
+
+	// the replicas are bit-identical...
+	for(unsigned rank = 1; rank < RANKS; ++rank)
+	{
+		for(unsigned k = 0; k < P; ++k)
+			ASSERT_EQUAL(results[k], results[P*rank + k]);
+	}
+
+	// ...and match training on the whole set in one process
+	Graph graph;
+	NodeSet<InputNode> inputs(2);
+	LinearLayer layer(inputs.getNodes(), 1);
+	graph.addInputNodes(inputs.getInputs());
+	graph.addParamNodes(layer.getWeightNodes());
+	graph.outputNodes = layer.getOutputNodes();
+	graph.setParams(std::vector<double>(results + P*RANKS, results + P*(RANKS + 1)));
+
+	GradientDescent<SquareLoss> optimizer(&graph);
+	optimizer.setTrainingSet(inputValues, expectedOutputs, N);
+	optimizer.runEpochs(EPOCHS);
+
+	for(unsigned k = 0; k < P; ++k)
+		ASSERT_FLOAT_EQUAL(graph.parameters.values()[k], results[k], 1e-9);
+
+	munmap(results, sizeof(double)*P*(RANKS + 1));
+}
+
+void dataParallelValidationTest()
+{
+	const unsigned RANKS = 2;
+	const unsigned N = 8;
+
+	double inputValues[2*N];
+	double expectedOutputs[N];
+	for(unsigned i = 0; i < N; ++i)
+	{
+		inputValues[2*i] = randFloatRange(-1, 1);
+		inputValues[2*i + 1] = randFloatRange(-1, 1);
+		expectedOutputs[i] = inputValues[2*i] + inputValues[2*i + 1];
+	}
+
+	// per rank: whether it threw, and the epochs it ran
+	auto results = static_cast<double*>(mmap(nullptr, sizeof(double)*2*RANKS,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+
+	auto run = [&](bool everyRankValidates) {
+		std::string name = "/toyml_test_" + std::to_string(getpid());
+		SharedMemoryTransport::create(name, RANKS, 16);
+
+		auto train = [&](unsigned rank) {
+			Graph graph;
+			NodeSet<InputNode> inputs(2);
+			LinearLayer layer(inputs.getNodes(), 1);
+			graph.addInputNodes(inputs.getInputs());
+			graph.addParamNodes(layer.getWeightNodes());
+			graph.outputNodes = layer.getOutputNodes();
+
+			SharedMemoryTransport transport(name, rank);
+			GradientDescent<SquareLoss> optimizer(&graph);
+			optimizer.setTransport(&transport);
+			optimizer.setTrainingSet(inputValues + N*rank, expectedOutputs + N/2*rank, N/2);
+
+			// nothing counts as an improvement, so the second snapshot's loss
+			// stops training; the ranks vote on it at the third validation
+			if(everyRankValidates || rank == 0)
+			{
+				optimizer.setValidationSet(inputValues, expectedOutputs, N, 5);
+				optimizer.setEarlyStopping(1, 1e9);
+			}
+
+			std::cout.setstate(std::ios::failbit);
+			results[2*rank] = 0;
+			try { optimizer.runEpochs(50); }
+			catch(std::exception* e) { results[2*rank] = 1; delete e; }
+			std::cout.clear();
+			results[2*rank + 1] = optimizer.getEpochs();
+		};
+
+		ASSERT_EQUAL(true, runRanks(RANKS, train));
+		SharedMemoryTransport::unlink(name);
+	};
+
+	// every rank stops on the same epoch
+	run(true);
+	for(unsigned rank = 0; rank < RANKS; ++rank)
+	{
+		ASSERT_EQUAL(0, results[2*rank]);
+		ASSERT_EQUAL(15, results[2*rank + 1]);
+	}
+
+	// and they all throw, rather than hang, if only some validate: in the
+	// all-reduce of the epoch that would end with the first validation
+	run(false);
+	for(unsigned rank = 0; rank < RANKS; ++rank)
+	{
+		ASSERT_EQUAL(1, results[2*rank]);
+		ASSERT_EQUAL(4, results[2*rank + 1]);
+	}
+
+	munmap(results, sizeof(double)*2*RANKS);
+}
+
+void hogwildTest()
+{
+	const unsigned N = 32;
+
+	double inputValues[3*N];
+	double expectedOutputs[N];
+	for(unsigned i = 0; i < N; ++i)
+	{
+		for(unsigned j = 0; j < 3; ++j)
+			inputValues[3*i + j] = randFloatRange(-1, 1);
+		expectedOutputs[i] = inputValues[3*i] - 2*inputValues[3*i + 1] + 0.5*inputValues[3*i + 2] + 1;
+	}
+
+	Graph graph;
+	NodeSet<InputNode> inputs(3);
+	LinearLayer layer(inputs.getNodes(), 1);
+	graph.addInputNodes(inputs.getInputs());
+	graph.addParamNodes(layer.getWeightNodes());
+	graph.outputNodes = layer.getOutputNodes();
+
+	HogwildTrainer<SquareLoss> trainer(&graph, 3);
+	trainer.setTrainingSet(inputValues, expectedOutputs, N);
+	trainer.setLearningRate(0.05);
+	trainer.run(300);
+
+	auto probes = trainer.getProbes();
+	ASSERT_EQUAL(true, probes.size() > 0);
+	ASSERT_EQUAL(300*N, probes.back().updates);
+	ASSERT_FLOAT_EQUAL(0, probes.back().loss, 1e-6);
+
+	// the shared params are the main graph's
+	auto w = graph.parameters.values();
+	ASSERT_FLOAT_EQUAL(1, w[0], 1e-3);
+	ASSERT_FLOAT_EQUAL(-2, w[1], 1e-3);
+	ASSERT_FLOAT_EQUAL(1, w[3], 1e-3);
+}
+
+void executionContextTest()
+{
+	const int W = 6;
+	const int N = 16;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	Layer<SigmoidNode> first(inputs.getNodes(), W);
+	LinearLayer second(first.getOutputNodes(), 2);
+
+	for(LinearLayer* l : std::vector<LinearLayer*>{&first, &second})
+	{
+		l->randomizeWeights();
+		graph.addParamNodes(l->getWeightNodes());
+	}
+	graph.outputNodes = second.getOutputNodes();
+
+	std::vector<double> in(W*N);
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+	std::vector<double> seed = {1, -0.5};
+
+	// serial results, through the nodes
+	unsigned nParams = graph.paramNodes.size();
+	std::vector<double> expected, expectedDerivs;
+	for(int j = 0; j < N; ++j)
+	{
+		auto out = graph.forwardPass(&in[W*j]);
+		expected.insert(expected.end(), out.begin(), out.end());
+
+		graph.backProp(seed);
+		for(auto p : graph.paramNodes)
+			expectedDerivs.push_back(p->getDerivative(0));
+	}
+
+	// every thread evaluates every sample with its own context
+	const int T = 4;
+	std::vector<double> actual(T*N*2), actualDerivs(T*N*nParams);
+	std::vector<std::thread> threads;
+	for(int t = 0; t < T; ++t)
+	{
+		threads.emplace_back([&, t] {
+			ExecutionContext ctx(graph);
+			for(int rep = 0; rep < 20; ++rep)
+			{
+				for(int j = 0; j < N; ++j)
+				{
+					auto& out = graph.forwardPass(ctx, &in[W*j]);
+					graph.backProp(ctx, seed);
+
+					std::copy(out.begin(), out.end(), &actual[(t*N + j)*2]);
+					for(unsigned k = 0; k < nParams; ++k)
+						actualDerivs[(t*N + j)*nParams + k] = ctx.getGradient(k);
+				}
+			}
+		});
+	}
+	for(auto& th : threads)
+		th.join();
+
+	for(int t = 0; t < T; ++t)
+	{
+		for(int i = 0; i < N*2; ++i)
+			ASSERT_FLOAT_EQUAL(expected[i], actual[t*N*2 + i], 1e-12);
+		for(unsigned i = 0; i < N*nParams; ++i)
+			ASSERT_FLOAT_EQUAL(expectedDerivs[i], actualDerivs[t*N*nParams + i], 1e-12);
+	}
+
+	// a context can run on a snapshot of the params instead
+	std::vector<double> zeros(nParams, 0);
+	ExecutionContext ctx(graph);
+	ctx.setParams(zeros.data());
+	auto& out = graph.forwardPass(ctx, in.data());
+	ASSERT_FLOAT_EQUAL(0, out[0], 1e-12);
+
+	// and none of this touched the nodes
+	ASSERT_FLOAT_EQUAL(expected[(N-1)*2], graph.getOutput(0), 1e-12);
+}
+
+void microBatcherTest()
+{
+	const int W = 4;
+	const int N = 8;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	Layer<SigmoidNode> first(inputs.getNodes(), W);
+	LinearLayer second(first.getOutputNodes(), 2);
+
+	for(LinearLayer* l : std::vector<LinearLayer*>{&first, &second})
+	{
+		l->randomizeWeights();
+		graph.addParamNodes(l->getWeightNodes());
+	}
+	graph.outputNodes = second.getOutputNodes();
+
+	std::vector<double> in(W*N);
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+
+	std::vector<std::vector<double>> expected;
+	for(int j = 0; j < N; ++j)
+		expected.push_back(graph.forwardPass(&in[W*j]));
+
+	// a burst that fills a batch is evaluated at once, long before the deadline
+	MicroBatcher batcher(graph, N, 10);
+
+	std::vector<std::future<std::vector<double>>> results;
+	for(int j = 0; j < N; ++j)
+		results.push_back(batcher.submit(&in[W*j]));
+
+	for(int j = 0; j < N; ++j)
+	{
+		auto out = results[j].get();
+		ASSERT_EQUAL(2, out.size());
+		for(unsigned o = 0; o < out.size(); ++o)
+			ASSERT_FLOAT_EQUAL(expected[j][o], out[o], 1e-12);
+	}
+
+	auto stats = batcher.getStats();
+	ASSERT_EQUAL(N, stats.requests);
+	ASSERT_EQUAL(1, stats.batches);
+	ASSERT_EQUAL(true, stats.p50 < 1);
+
+	// the same over a socket, from several connections at once
+	MicroBatcher served(graph, N, 0.001);
+	std::string path = "/tmp/toyml_test_" + std::to_string(getpid()) + ".sock";
+	InferenceServer server(served, path);
+	server.start();
+
+	std::vector<std::thread> clients;
+	for(int c = 0; c < 4; ++c)
+	{
+		clients.emplace_back([&] {
+			InferenceClient client(path);
+			ASSERT_EQUAL(W, client.inputWidth());
+			ASSERT_EQUAL(2, client.outputWidth());
+
+			for(int j = 0; j < N; ++j)
+			{
+				auto out = client.predict(&in[W*j]);
+				for(unsigned o = 0; o < out.size(); ++o)
+					ASSERT_FLOAT_EQUAL(expected[j][o], out[o], 1e-12);
+			}
+		});
+	}
+	for(auto& c : clients)
+		c.join();
+
+	InferenceClient client(path);
+	ASSERT_EQUAL(4*N, client.stats().requests);
+
+	server.stop();
+}
+
+void codegenTest()
+{
+	const int W = 5;
+	const int N = 4;
+
+	// two layers that become loops, and a softmax that stays straight-line
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	Layer<SigmoidNode> first(inputs.getNodes(), 8);
+	LinearLayer second(first.getOutputNodes(), 3);
+	SoftMaxLayer softmax(second.getOutputNodes());
+
+	for(LinearLayer* l : std::vector<LinearLayer*>{&first, &second})
+	{
+		l->randomizeWeights();
+		graph.addParamNodes(l->getWeightNodes());
+	}
+	graph.outputNodes = softmax.getOutputNodes();
+
+	std::vector<double> in(W*N);
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+
+	std::string base = "/tmp/toyml_codegen_" + std::to_string(getpid());
+	{
+		std::ofstream gen(base + ".cpp");
+		exportCpp(graph, gen);
+
+		// a driver that prints predict() for every row
+		gen << "#include <cstdio>\n"
+		    << "int main()\n{\n\tconst double in[] = {";
+		for(unsigned i = 0; i < in.size(); ++i)
+			gen << (i ? ", " : "") << std::hexfloat << in[i] << std::defaultfloat;
+		gen << "};\n\tdouble out[3];\n"
+		    << "\tfor(int j = 0; j < " << N << "; ++j)\n\t{\n"
+		    << "\t\tpredict(in + j*" << W << ", out);\n"
+		    << "\t\tstd::printf(\"%a %a %a\\n\", out[0], out[1], out[2]);\n"
+		    << "\t}\n}\n";
+	}
+
+	std::string command = "g++ -O2 -std=c++17 -o " + base + " " + base + ".cpp";
+	ASSERT_EQUAL(0, std::system(command.c_str()));
+
+	FILE* p = popen(base.c_str(), "r");
+	for(int j = 0; j < N; ++j)
+	{
+		auto expected = graph.forwardPass(&in[W*j]);
+		for(int o = 0; o < 3; ++o)
+		{
+			double actual = 0;
+			ASSERT_EQUAL(1, std::fscanf(p, "%la", &actual));
+			ASSERT_FLOAT_EQUAL(expected[o], actual, 1e-12);
+		}
+	}
+	pclose(p);
+
+	std::remove((base + ".cpp").c_str());
+	std::remove(base.c_str());
+}
+
+void quantizeTest()
+{
+	const int W = 16;
+	const int N = 64;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	Layer<SigmoidNode> first(inputs.getNodes(), W);
+	LinearLayer second(first.getOutputNodes(), 2);
+
+	for(LinearLayer* l : std::vector<LinearLayer*>{&first, &second})
+	{
+		l->randomizeWeights();
+		graph.addParamNodes(l->getWeightNodes());
+	}
+	graph.outputNodes = second.getOutputNodes();
+
+	std::vector<double> in(W*N);
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+
+	QuantizedNetwork q;
+	q.addLayer(first);
+	q.addLayer(second);
+	q.calibrate(in.data(), N/2);
+
+	ASSERT_EQUAL(W, q.inputWidth());
+	ASSERT_EQUAL(2, q.outputWidth());
+	ASSERT_EQUAL(true, q.bytes() * 5 < q.doubleBytes());
+
+	// the drift on held out inputs stays within a percent of the outputs
+	auto report = compareQuantized(graph, q, &in[W*N/2], N/2);
+	ASSERT_EQUAL(N/2, report.samples);
+	ASSERT_EQUAL(true, report.maxAbsOutput > 0);
+	ASSERT_EQUAL(true, report.maxAbsError < 0.01 * report.maxAbsOutput);
+	ASSERT_EQUAL(true, report.rmsError <= report.maxAbsError);
+}
+
+void pruneTest()
+{
+	const int W = 8;
+	const int N = 16;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	LinearLayer layer(inputs.getNodes(), 3);
+	layer.randomizeWeights();
+	graph.addParamNodes(layer.getWeightNodes());
+	graph.outputNodes = layer.getOutputNodes();
+
+	// the dense product with the small weights zeroed
+	unsigned cols = W + 1;
+	std::vector<double> w;
+	for(auto p : graph.paramNodes)
+		w.push_back(p->getInput() <= 0.5 && w.size() % cols != W ? 0 : p->getInput());
+
+	unsigned count = layer.prune(0.5);
+	ASSERT_EQUAL(3*W - layer.nonZeros() + 3, count);
+	ASSERT_EQUAL(4, layer.getRowOffsets().size());
+
+	for(unsigned r = 0; r < 3; ++r)
+	{
+		unsigned kept = layer.getRowOffsets()[r+1] - layer.getRowOffsets()[r];
+		ASSERT_EQUAL(2*kept, graph.outputNodes[r]->parents.size());
+		ASSERT_EQUAL(W, layer.getColumnIndices()[layer.getRowOffsets()[r+1] - 1]);
+	}
+
+	std::vector<double> in(W);
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+
+	auto out = graph.forwardPass(in);
+	for(unsigned r = 0; r < 3; ++r)
+	{
+		double expected = w[r*cols + W];
+		for(int c = 0; c < W; ++c)
+			expected += w[r*cols + c] * in[c];
+		ASSERT_FLOAT_EQUAL(expected, out[r], 1e-12);
+	}
+
+	// fine-tuning keeps the pruned weights at zero
+	std::vector<double> inputValues(W*N), expectedOutputs(3*N);
+	for(auto& x : inputValues)
+		x = randFloatRange(-1, 1);
+	for(auto& y : expectedOutputs)
+		y = randFloatRange(-1, 1);
+
+	GradientDescent<SquareLoss> optimizer(&graph);
+	optimizer.setTrainingSet(inputValues.data(), expectedOutputs.data(), N);
+	optimizer.setLearningRate(0.01);
+	optimizer.runEpochs(20);
+
+	for(unsigned r = 0; r < 3; ++r)
+	{
+		for(unsigned c = 0; c < cols; ++c)
+		{
+			if(layer.isPruned(r, c))
+				ASSERT_EQUAL(0, graph.paramNodes[r*cols + c]->getInput());
+		}
+	}
+
+	// and pruning a fraction keeps the bias
+	layer.pruneFraction(1);
+	ASSERT_EQUAL(3, layer.nonZeros());
+}
+
+void gemmTest()
+{
+	// larger than a panel in K and N, with row strides wider than the rows
+	const unsigned M = 5, N = 300, K = 200, PAD = 3;
+
+	for(int t = 0; t < 4; ++t)
+	{
+		bool transA = t & 1, transB = t & 2;
+		unsigned lda = (transA ? M : K) + PAD, ldb = (transB ? K : N) + PAD, ldc = N + PAD;
+
+		std::vector<double> A((transA ? K : M) * lda), B((transB ? N : K) * ldb), C(M * ldc);
+		for(auto& x : A) x = randFloatRange(-1, 1);
+		for(auto& x : B) x = randFloatRange(-1, 1);
+		for(auto& x : C) x = randFloatRange(-1, 1);
+
+		auto expected = C;
+		for(unsigned i = 0; i < M; ++i)
+			for(unsigned j = 0; j < N; ++j)
+			{
+				double sum = 0;
+				for(unsigned k = 0; k < K; ++k)
+					sum += (transA ? A[k*lda + i] : A[i*lda + k]) * (transB ? B[j*ldb + k] : B[k*ldb + j]);
+				expected[i*ldc + j] = 0.5 * expected[i*ldc + j] + sum;
+			}
+
+		gemm(transA, transB, M, N, K, A.data(), lda, B.data(), ldb, 0.5, C.data(), ldc);
+		for(unsigned i = 0; i < M; ++i)
+			for(unsigned j = 0; j < N; ++j)
+				ASSERT_FLOAT_EQUAL(expected[i*ldc + j], C[i*ldc + j], 1e-10);
+	}
+}
+
+void convTest()
+{
+	const unsigned C = 2, H = 5, W = 6, F = 3;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(C*H*W);
+	graph.addInputNodes(inputs.getInputs());
+
+	// 3x2 kernels, stride 2 down and 1 across, padded by one all round
+	Conv2DLayer conv(inputs.getNodes(), C, H, W, F, 3, 2, 2, 1, 1, 1);
+	conv.randomizeWeights();
+	graph.addParamNodes(conv.getWeightNodes());
+	graph.outputNodes = conv.getOutputNodes();
+
+	ASSERT_EQUAL(3, conv.outputHeight());
+	ASSERT_EQUAL(7, conv.outputWidth());
+	ASSERT_EQUAL(F*C*3*2 + F, graph.paramNodes.size());
+
+	// the lowered layer matches the nodes, forward and backward
+	const unsigned B = 2;
+	std::vector<double> in(B*C*H*W), dOut(B*conv.outputSize());
+	for(auto& x : in)
+		x = randFloatRange(-1, 1);
+	for(auto& d : dOut)
+		d = randFloatRange(-1, 1);
+
+	std::vector<double> out(B*conv.outputSize());
+	std::vector<double> grads(graph.paramNodes.size(), 0), dIn(B*C*H*W);
+	conv.forward(in.data(), B, out.data());
+	conv.backward(in.data(), dOut.data(), B, grads.data(), dIn.data());
+
+	std::vector<double> expectedGrads(graph.paramNodes.size(), 0);
+	for(unsigned b = 0; b < B; ++b)
+	{
+		auto expected = graph.forwardPass(&in[b*C*H*W]);
+		for(unsigned i = 0; i < expected.size(); ++i)
+			ASSERT_FLOAT_EQUAL(expected[i], out[b*conv.outputSize() + i], 1e-12);
+
+		graph.backProp(&dOut[b*conv.outputSize()], conv.outputSize());
+		for(unsigned k = 0; k < graph.paramNodes.size(); ++k)
+			expectedGrads[k] += graph.paramNodes[k]->getDerivative(0);
+		for(unsigned i = 0; i < C*H*W; ++i)
+			ASSERT_FLOAT_EQUAL(graph.inputNodes[i]->getDerivative(0), dIn[b*C*H*W + i], 1e-12);
+	}
+
+	for(unsigned k = 0; k < graph.paramNodes.size(); ++k)
+		ASSERT_FLOAT_EQUAL(expectedGrads[k], grads[k], 1e-12);
+
+	// a 1D layer learns a smoothing kernel through the usual optimizer
+	const unsigned L = 12, N = 16;
+
+	Graph signal;
+	NodeSet<InputNode> samples(L);
+	signal.addInputNodes(samples.getInputs());
+
+	Conv1DLayer smooth(samples.getNodes(), 1, L, 1, 3, 1, 1);
+	smooth.randomizeWeights();
+	signal.addParamNodes(smooth.getWeightNodes());
+	signal.outputNodes = smooth.getOutputNodes();
+
+	ASSERT_EQUAL(L, smooth.outputLength());
+	ASSERT_EQUAL(4, signal.paramNodes.size());
+
+	std::vector<double> x(L*N), y(L*N);
+	for(auto& v : x)
+		v = randFloatRange(-1, 1);
+	for(unsigned n = 0; n < N; ++n)
+	{
+		for(unsigned i = 0; i < L; ++i)
+		{
+			double left = i ? x[n*L + i - 1] : 0;
+			double right = i + 1 < L ? x[n*L + i + 1] : 0;
+			y[n*L + i] = 0.25*left + 0.5*x[n*L + i] + 0.25*right;
+		}
+	}
+
+	GradientDescent<SquareLoss> optimizer(&signal);
+	optimizer.setTrainingSet(x.data(), y.data(), N);
+	optimizer.setLearningRate(0.02);
+	optimizer.runEpochs(500);
+
+	auto kernel = signal.parameters.values();
+	ASSERT_FLOAT_EQUAL(0.25, kernel[0], 1e-3);
+	ASSERT_FLOAT_EQUAL(0.5, kernel[1], 1e-3);
+	ASSERT_FLOAT_EQUAL(0.25, kernel[2], 1e-3);
+	ASSERT_FLOAT_EQUAL(0, kernel[3], 1e-3);
+
+	// a lowered layer in front of a graph trains like the nodes: the same
+	// conv and head, one with the conv's nodes and one lowered, take the
+	// same steps; the head also sees a plain input
+	Graph nodes;
+	NodeSet<InputNode> nodeInputs(C*H*W + 1);
+	auto nodeIn = nodeInputs.getNodes();
+	nodes.addInputNodes(nodeInputs.getInputs());
+	Conv2DLayer nodeConv(std::vector<Node*>(nodeIn.begin(), nodeIn.end() - 1), C, H, W, F, 3, 2, 2, 1, 1, 1);
+	auto nodeHeadIn = nodeConv.getOutputNodes();
+	nodeHeadIn.push_back(nodeIn.back());
+	Layer<SigmoidNode> nodeHead(nodeHeadIn, 2);
+	nodes.addParamNodes(nodeConv.getWeightNodes());
+	nodes.addParamNodes(nodeHead.getWeightNodes());
+	nodes.outputNodes = nodeHead.getOutputNodes();
+
+	Graph lowered;
+	Conv2DLayer loweredConv(C, H, W, F, 3, 2, 2, 1, 1, 1);
+	InputNode plain;
+	auto loweredHeadIn = loweredConv.getOutputNodes();
+	loweredHeadIn.push_back(&plain);
+	Layer<SigmoidNode> loweredHead(loweredHeadIn, 2);
+	lowered.addInputNodes({&plain});
+	lowered.addInputNodes(loweredConv.getInputNodes());
+	lowered.addParamNodes(loweredConv.getWeightNodes());
+	lowered.addParamNodes(loweredHead.getWeightNodes());
+	lowered.outputNodes = loweredHead.getOutputNodes();
+
+	ASSERT_EQUAL(true, loweredConv.isLowered());
+	ASSERT_EQUAL(nodes.paramNodes.size(), lowered.paramNodes.size());
+	for(unsigned k = 0; k < nodes.paramNodes.size(); ++k)
+		lowered.parameters.values()[k] = nodes.parameters.values()[k] = randFloatRange(-0.5, 0.5);
+
+	const unsigned S = 6;
+	std::vector<double> signals(S*C*H*W), plainIn(S), rows(S*(C*H*W + 1)), targets(2*S);
+	for(auto& v : signals)
+		v = randFloatRange(-1, 1);
+	for(auto& v : plainIn)
+		v = randFloatRange(-1, 1);
+	for(auto& v : targets)
+		v = randFloatRange(0, 1);
+	for(unsigned s = 0; s < S; ++s)
+	{
+		std::copy(&signals[s*C*H*W], &signals[(s + 1)*C*H*W], &rows[s*(C*H*W + 1)]);
+		rows[s*(C*H*W + 1) + C*H*W] = plainIn[s];
+	}
+
+	GradientDescent<SquareLoss> nodeOptimizer(&nodes);
+	nodeOptimizer.setTrainingSet(rows.data(), targets.data(), S);
+	nodeOptimizer.runEpochs(5);
+
+	GradientDescent<SquareLoss> loweredOptimizer(&lowered);
+	loweredOptimizer.setTrainingSet(plainIn.data(), targets.data(), S);
+	loweredOptimizer.addConvolution(&loweredConv, signals.data());
+	loweredOptimizer.runEpochs(5);
+
+	for(unsigned k = 0; k < nodes.paramNodes.size(); ++k)
+		ASSERT_FLOAT_EQUAL(nodes.parameters.values()[k], lowered.parameters.values()[k], 1e-10);
+	ASSERT_FLOAT_EQUAL(nodeOptimizer.getLastError(), loweredOptimizer.getLastError(), 1e-12);
+
+	// only lowered layers, and nothing validation would miss
+	std::cout.setstate(std::ios::failbit);
+	bool threw = false;
+	try { nodeOptimizer.addConvolution(&nodeConv, signals.data()); }
+	catch(std::exception* e) { threw = true; delete e; }
+	ASSERT_EQUAL(true, threw);
+
+	threw = false;
+	try { loweredOptimizer.setValidationSet(plainIn.data(), targets.data(), S); }
+	catch(std::exception* e) { threw = true; delete e; }
+	std::cout.clear();
+	ASSERT_EQUAL(true, threw);
+}
+
+void recurrentTest()
+{
+	// full BPTT over a short sequence matches finite differences of the loss
+	const unsigned T = 6;
+	RecurrentLayer<SigmoidNode> rnn(2, 3, 8);
+	auto& cell = rnn.getCell();
+
+	std::vector<double> xs(T*2), targets(T*3);
+	for(auto& x : xs)
+		x = randFloatRange(-1, 1);
+	for(auto& y : targets)
+		y = randFloatRange(0, 1);
+
+	cell.parameters.zeroGradients();
+	rnn.accumulateSequence<SquareLoss>(xs.data(), targets.data(), T);
+	ASSERT_EQUAL(0, rnn.pendingSteps());
+
+	auto w = cell.parameters.values();
+	auto grads = cell.parameters.gradients();
+	std::vector<double> dw(grads.begin(), grads.end());
+	for(unsigned k = 0; k < w.size(); ++k)
+	{
+		const double eps = 1e-6;
+		double w0 = w[k];
+
+		w[k] = w0 + eps;
+		double up = rnn.accumulateSequence<SquareLoss>(xs.data(), targets.data(), T);
+		w[k] = w0 - eps;
+		double down = rnn.accumulateSequence<SquareLoss>(xs.data(), targets.data(), T);
+		w[k] = w0;
+
+		ASSERT_FLOAT_EQUAL((up - down) / (2*eps), dw[k], 1e-6);
+	}
+
+	// past the window, the gradient is that of the loss of each window of
+	// steps with the hidden state coming into the window held constant
+	const unsigned LONG = 20, WINDOW = 4;
+	RecurrentLayer<SigmoidNode> truncated(2, 3, WINDOW);
+	auto& tcell = truncated.getCell();
+
+	std::vector<double> longXs(LONG*2), longTargets(LONG*3);
+	for(auto& x : longXs)
+		x = randFloatRange(-1, 1);
+	for(auto& y : longTargets)
+		y = randFloatRange(0, 1);
+
+	tcell.parameters.zeroGradients();
+	truncated.accumulateSequence<SquareLoss>(longXs.data(), longTargets.data(), LONG);
+	auto tgrads = tcell.parameters.gradients();
+	std::vector<double> tdw(tgrads.begin(), tgrads.end());
+
+	// the hidden states the windows start from, at the unperturbed params
+	std::vector<std::vector<double>> starts;
+	truncated.reset();
+	for(unsigned t = 0; t < LONG; ++t)
+	{
+		if(t % WINDOW == 0)
+			starts.push_back(truncated.getHidden());
+		truncated.step(&longXs[t*2]);
+	}
+
+	// the same steps unrolled by hand, cut at every window
+	ExecutionContext ctx(tcell);
+	auto windowedLoss = [&]() {
+		double loss = 0;
+		std::vector<double> in(5);
+		for(unsigned c = 0; c < starts.size(); ++c)
+		{
+			std::vector<double> h = starts[c];
+			for(unsigned t = c*WINDOW; t < (c + 1)*WINDOW; ++t)
+			{
+				std::copy(&longXs[t*2], &longXs[t*2] + 2, in.begin());
+				std::copy(h.begin(), h.end(), in.begin() + 2);
+				h = tcell.forwardPass(ctx, in.data());
+				loss += SquareLoss::loss(h.data(), &longTargets[t*3], 3);
+			}
+		}
+		return loss;
+	};
+
+	auto tw = tcell.parameters.values();
+	double maxFromFull = 0;
+	for(unsigned k = 0; k < tw.size(); ++k)
+	{
+		const double eps = 1e-6;
+		double w0 = tw[k];
+
+		tw[k] = w0 + eps;
+		double up = windowedLoss();
+		double fullUp = truncated.accumulateSequence<SquareLoss>(longXs.data(), longTargets.data(), LONG);
+		tw[k] = w0 - eps;
+		double down = windowedLoss();
+		double fullDown = truncated.accumulateSequence<SquareLoss>(longXs.data(), longTargets.data(), LONG);
+		tw[k] = w0;
+
+		ASSERT_FLOAT_EQUAL((up - down) / (2*eps), tdw[k], 1e-6);
+		maxFromFull = std::max(maxFromFull, std::abs((fullUp - fullDown) / (2*eps) - tdw[k]));
+	}
+	// and truncation did cut something off
+	ASSERT_EQUAL(true, maxFromFull > 1e-6);
+
+	// memory is bounded by the window, however long the sequence
+	size_t bytes = rnn.activationBytes();
+	rnn.reset();
+	for(unsigned t = 0; t < 100; ++t)
+		rnn.step(&xs[(t % T) * 2]);
+	ASSERT_EQUAL(8, rnn.pendingSteps());
+	ASSERT_EQUAL(bytes, rnn.activationBytes());
+
+	// learns to output the previous step's input, which has to be carried
+	// in the hidden state: unit 0 follows x_{t-1} and unit 1 follows x_t
+	const unsigned L = 20, N = 8;
+	RecurrentLayer<SigmoidNode> delay(1, 2, 4);
+	auto& delayCell = delay.getCell();
+
+	std::vector<double> bits(N*L), expected(N*L*2);
+	for(unsigned n = 0; n < N; ++n)
+	{
+		for(unsigned t = 0; t < L; ++t)
+		{
+			bits[n*L + t] = rand() % 2;
+			expected[(n*L + t)*2] = t ? 0.2 + 0.6*bits[n*L + t - 1] : 0.2;
+			expected[(n*L + t)*2 + 1] = 0.2 + 0.6*bits[n*L + t];
+		}
+	}
+
+	double loss = 0;
+	for(unsigned epoch = 0; epoch < 1500; ++epoch)
+	{
+		delayCell.parameters.zeroGradients();
+
+		loss = 0;
+		for(unsigned n = 0; n < N; ++n)
+			loss += delay.accumulateSequence<SquareLoss>(&bits[n*L], &expected[n*L*2], L);
+		loss /= N*L;
+
+		auto p = delayCell.parameters.values();
+		auto dp = delayCell.parameters.gradients();
+		for(unsigned k = 0; k < p.size(); ++k)
+			p[k] -= 2.0 * dp[k] / (N*L);
+	}
+
+	ASSERT_FLOAT_EQUAL(0, loss, 5e-3);
+}
+
+void earlyStoppingTest()
+{
+	// trained towards y = 2x but validated against y = x, so the validation
+	// loss bottoms out on the way, around w = 1
+	Graph graph;
+	NodeSet<InputNode> inputs(1);
+	graph.addInputNodes(inputs.getInputs());
+
+	LinearLayer layer(inputs.getNodes(), 1);
+	layer.setWeights(0, {0, 0});
+	graph.addParamNodes(layer.getWeightNodes());
+	graph.outputNodes = layer.getOutputNodes();
+
+	const unsigned N = 16;
+	std::vector<double> x(N), train(N), valid(N);
+	for(unsigned i = 0; i < N; ++i)
+	{
+		x[i] = -1 + 2.0 * i / (N - 1);
+		train[i] = 2 * x[i];
+		valid[i] = x[i];
+	}
+
+	GradientDescent<SquareLoss> optimizer(&graph);
+	optimizer.setTrainingSet(x.data(), train.data(), N);
+	optimizer.setLearningRate(0.1);
+	optimizer.setValidationSet(x.data(), valid.data(), N, 1);
+	optimizer.setEarlyStopping(5);
+
+	// one epoch at a time, waiting for each validation so none is skipped
+	auto v = optimizer.getValidator();
+	unsigned epochs = 0;
+	while(epochs < 1000 && !optimizer.stoppedEarly())
+	{
+		optimizer.runEpochs(1);
+		v->wait();
+		++epochs;
+	}
+
+	ASSERT_EQUAL(true, optimizer.stoppedEarly());
+	ASSERT_EQUAL(0, v->getSkipped());
+	ASSERT_EQUAL(epochs, v->getResults().size());
+	// the stop is decided on the results in by then, which may lag a snapshot
+	ASSERT_EQUAL(true, epochs == v->getBestEpoch() + 5 || epochs == v->getBestEpoch() + 6);
+
+	// the params went back to the best snapshot
+	auto w = graph.parameters.values();
+	ASSERT_FLOAT_EQUAL(1, w[0], 0.2);
+
+	double loss = 0;
+	for(unsigned i = 0; i < N; ++i)
+	{
+		double y = graph.forwardPass(&x[i]).at(0);
+		loss += (y - valid[i]) * (y - valid[i]);
+	}
+	ASSERT_FLOAT_EQUAL(v->getBestLoss(), loss / N, 1e-12);
+}
+
+void checkpointTest()
+{
+	auto build = [](Graph& g) {
+		auto& inputs = g.make<NodeSet<InputNode>>(2);
+		g.addInputNodes(inputs.getInputs());
+
+		auto& hidden = g.make<Layer<SigmoidNode>>(inputs.getNodes(), 3);
+		auto& output = g.make<Layer<SigmoidNode>>(hidden.getOutputNodes(), 1);
+		hidden.randomizeWeights();
+		output.randomizeWeights();
+
+		g.addParamNodes(hidden.getWeightNodes());
+		g.addParamNodes(output.getWeightNodes());
+		g.outputNodes = output.getOutputNodes();
+	};
+
+	double in[] = { 0,0, 1,0, 0,1, 1,1 };
+	double out[] = { 0, 1, 1, 0 };
+	std::string path = "/tmp/toyml_checkpoint_" + std::to_string(getpid());
+
+	Graph first;
+	build(first);
+
+	GradientDescent<SquareLoss> trainer(&first);
+	trainer.setTrainingSet(in, out, 4);
+	trainer.setLearningRate(1);
+	trainer.setDecayFrequency(7);
+	trainer.setLearningRateDecay(0.9);
+	trainer.setCheckpoint(path, 10);
+
+	trainer.runEpochs(25);
+	trainer.getCheckpointWriter()->flush();
+	ASSERT_EQUAL(true, trainer.getCheckpointWriter()->getWritten() >= 1);
+
+	TrainingState saved;
+	ASSERT_EQUAL(true, loadTrainingState(saved, path));
+	ASSERT_EQUAL(20, saved.epochs);
+
+	// carry on from epoch 20 in a fresh model; both end up in exactly the same place
+	trainer.checkpoint();
+	trainer.getCheckpointWriter()->flush();
+
+	Graph second;
+	build(second);
+
+	GradientDescent<SquareLoss> resumed(&second);
+	resumed.setTrainingSet(in, out, 4);
+	ASSERT_EQUAL(true, resumed.resume(path));
+	ASSERT_EQUAL(25, resumed.getEpochs());
+	ASSERT_EQUAL(trainer.getLearningRate(), resumed.getLearningRate());
+
+	trainer.runEpochs(20);
+	resumed.runEpochs(20);
+
+	auto a = first.parameters.values();
+	auto b = second.parameters.values();
+	for(unsigned k = 0; k < a.size(); ++k)
+		ASSERT_EQUAL(a[k], b[k]);
+
+	ASSERT_EQUAL(false, resumed.resume(path + ".missing"));
+
+	trainer.getCheckpointWriter()->flush();
+	std::remove(path.c_str());
+}
+
+void segmentedContextTest()
+{
+	const unsigned W = 6, DEPTH = 9;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	std::vector<std::unique_ptr<Layer<SigmoidNode>>> layers;
+	std::vector<Node*> x = inputs.getNodes();
+	for(unsigned d = 0; d < DEPTH; ++d)
+	{
+		layers.emplace_back(new Layer<SigmoidNode>(x, d + 1 < DEPTH ? W : 2));
+		layers.back()->randomizeWeights();
+		graph.addParamNodes(layers.back()->getWeightNodes());
+		x = layers.back()->getOutputNodes();
+	}
+	graph.outputNodes = x;
+
+	std::vector<double> in(W), seed = { 0.5, -2 };
+	for(auto& v : in)
+		v = randFloatRange(-1, 1);
+
+	ExecutionContext full(graph);
+	graph.forwardPass(full, in.data());
+	graph.backProp(full, seed);
+
+	// every 3rd layer's outputs, and automatic sqrt(depth) spacing
+	std::vector<Node*> marked;
+	for(unsigned d = 2; d + 1 < DEPTH; d += 3)
+		marked.push_back(layers[d]->getOutputNodes()[0]);
+
+	SegmentedContext byLayer(graph, marked);
+	SegmentedContext automatic(graph);
+	ASSERT_EQUAL(3, byLayer.numSegments());
+	ASSERT_EQUAL(4, automatic.numSegments());
+
+	for(auto ctx : { &byLayer, &automatic })
+	{
+		auto& out = graph.forwardPass(*ctx, in.data());
+		for(unsigned o = 0; o < 2; ++o)
+			ASSERT_FLOAT_EQUAL(full.getOutput(o), out[o], 1e-15);
+
+		// twice, so the second one recomputes every segment
+		for(int pass = 0; pass < 2; ++pass)
+		{
+			graph.backProp(*ctx, seed);
+			for(unsigned k = 0; k < graph.paramNodes.size(); ++k)
+				ASSERT_FLOAT_EQUAL(full.getGradient(k), ctx->getGradient(k), 1e-15);
+			for(unsigned i = 0; i < W; ++i)
+				ASSERT_FLOAT_EQUAL(full.getInputGradient(i), ctx->getInputGradient(i), 1e-15);
+		}
+
+		ASSERT_EQUAL(full.activationBytes(), ctx->unsegmentedBytes());
+		ASSERT_EQUAL(true, ctx->activationBytes() * 2 < ctx->unsegmentedBytes());
+	}
+}
+
+void memoryPlanTest()
+{
+	const unsigned W = 8, DEPTH = 12;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	graph.addInputNodes(inputs.getInputs());
+
+	std::vector<std::unique_ptr<Layer<SigmoidNode>>> layers;
+	std::vector<Node*> x = inputs.getNodes();
+	for(unsigned d = 0; d < DEPTH; ++d)
+	{
+		layers.emplace_back(new Layer<SigmoidNode>(x, W));
+		layers.back()->randomizeWeights();
+		graph.addParamNodes(layers.back()->getWeightNodes());
+		x = layers.back()->getOutputNodes();
+	}
+	SoftMaxLayer softmax(x);
+	graph.outputNodes = softmax.getOutputNodes();
+
+	std::vector<double> in(W);
+	for(auto& v : in)
+		v = randFloatRange(-1, 1);
+
+	ExecutionContext full(graph);
+	InferenceContext planned(graph);
+
+	auto& expected = graph.forwardPass(full, in.data());
+	auto& out = graph.forwardPass(planned, in.data());
+	for(unsigned o = 0; o < W; ++o)
+		ASSERT_EQUAL(expected[o], out[o]);
+
+	// about two layers' worth of buffers, however deep the stack is
+	ASSERT_EQUAL(true, planned.getPlan().numSlots <= 3*W);
+	ASSERT_EQUAL(true, planned.activationBytes() * 4 < planned.unplannedBytes());
+
+	// the report accounts for every node and param
+	graph.forwardPass(in);
+	graph.backProp(std::vector<double>(W, 1));
+	auto report = graph.memoryReport();
+
+	ASSERT_EQUAL(W*DEPTH, report.nodeTypes["VectorMultNode"].count);
+	ASSERT_EQUAL(W*DEPTH, report.nodeTypes["SigmoidNode"].count);
+	ASSERT_EQUAL(W + graph.paramNodes.size() + DEPTH, report.nodeTypes["InputNode"].count);
+	ASSERT_EQUAL(2 * sizeof(double) * graph.paramNodes.size(), report.paramBytes);
+	ASSERT_EQUAL(true, report.derivativeBytes > 0 && report.derivativeBytes < report.nodeBytes);
+
+	size_t byType = 0;
+	for(auto& t : report.nodeTypes)
+		byType += t.second.bytes;
+	ASSERT_EQUAL(report.nodeBytes, byType);
+
+	std::ostringstream text;
+	report.write(text);
+	ASSERT_EQUAL(true, text.str().find("MultiplicationNode") != std::string::npos);
+}
+
+void leastSquaresTest()
+{
+	// blocked cholesky, across more than one block: A = B B^T + n I
+	const unsigned N = 150;
+	std::vector<double> B(N*N), A(N*N, 0), x(N), b(N, 0);
+	for(auto& v : B)
+		v = randFloatRange(-1, 1);
+	for(auto& v : x)
+		v = randFloatRange(-1, 1);
+
+	for(unsigned i = 0; i < N; ++i)
+	{
+		for(unsigned j = 0; j < N; ++j)
+		{
+			for(unsigned k = 0; k < N; ++k)
+				A[i*N + j] += B[i*N + k] * B[j*N + k];
+			if(i == j)
+				A[i*N + j] += N;
+		}
+	}
+	for(unsigned i = 0; i < N; ++i)
+		for(unsigned j = 0; j < N; ++j)
+			b[i] += A[i*N + j] * x[j];
+
+	ASSERT_EQUAL(true, cholesky(N, A.data(), N));
+	choleskySolve(N, A.data(), N, b.data());
+	for(unsigned i = 0; i < N; ++i)
+		ASSERT_FLOAT_EQUAL(x[i], b[i], 1e-9);
+
+	std::vector<double> notPD = { 1, 0, 2, 1 };
+	ASSERT_EQUAL(false, cholesky(2, notPD.data(), 2));
+
+	// a cubic, fit on the features x, x^2, x^3 in one pass
+	const unsigned POINTS = 200;
+	const double coeffs[4] = { 3, -2, 0.5, 0.25 };
+
+	Graph graph;
+	NodeSet<InputNode> inputs(3);
+	LinearLayer layer(inputs.getNodes(), 1);
+	layer.randomizeWeights();
+	graph.addInputNodes(inputs.getInputs());
+	graph.addParamNodes(layer.getWeightNodes());
+	graph.outputNodes = layer.getOutputNodes();
+
+	std::vector<double> in(3*POINTS), out(POINTS);
+	for(unsigned j = 0; j < POINTS; ++j)
+	{
+		double t = randFloatRange(-10, 10);
+		in[3*j] = t;
+		in[3*j + 1] = t*t;
+		in[3*j + 2] = t*t*t;
+		out[j] = coeffs[0] + coeffs[1]*t + coeffs[2]*t*t + coeffs[3]*t*t*t;
+	}
+
+	ASSERT_EQUAL(true, isLinearInParams(graph));
+
+	GradientDescent<SquareLoss> optimizer(&graph);
+	optimizer.setTrainingSet(in.data(), out.data(), POINTS);
+	ASSERT_EQUAL(true, optimizer.fitLeastSquares());
+	ASSERT_EQUAL(1, optimizer.getEpochs());
+
+	for(unsigned j = 0; j < POINTS; ++j)
+		ASSERT_FLOAT_EQUAL(out[j], graph.forwardPass(&in[3*j])[0], 1e-6);
+
+	// a ridge pulls the weights towards 0
+	NormalEquations eq(graph.parameters.size());
+	eq.accumulate(graph, in.data(), out.data(), POINTS);
+	ASSERT_EQUAL(POINTS, eq.rows);
+
+	std::vector<double> exact(eq.nParams), ridged(eq.nParams);
+	ASSERT_EQUAL(true, eq.solve(0, exact.data()));
+	ASSERT_EQUAL(true, eq.solve(1e6, ridged.data()));
+	double exactNorm = 0, ridgedNorm = 0;
+	for(unsigned k = 0; k < eq.nParams; ++k)
+	{
+		exactNorm += exact[k]*exact[k];
+		ridgedNorm += ridged[k]*ridged[k];
+	}
+	ASSERT_EQUAL(true, ridgedNorm < exactNorm);
+
+	// a hidden sigmoid layer makes the model nonlinear
+	Graph deep;
+	NodeSet<InputNode> deepInputs(3);
+	Layer<SigmoidNode> hidden(deepInputs.getNodes(), 4);
+	LinearLayer top(hidden.getOutputNodes(), 1);
+	deep.addInputNodes(deepInputs.getInputs());
+	deep.addParamNodes(hidden.getWeightNodes());
+	deep.addParamNodes(top.getWeightNodes());
+	deep.outputNodes = top.getOutputNodes();
+
+	ASSERT_EQUAL(false, isLinearInParams(deep));
+
+	GradientDescent<SquareLoss> deepOptimizer(&deep);
+	deepOptimizer.setTrainingSet(in.data(), out.data(), POINTS);
+	ASSERT_EQUAL(false, deepOptimizer.fitLeastSquares());
+	ASSERT_EQUAL(0, deepOptimizer.getEpochs());
+}
+
+void lbfgsTest()
+{
+	// the cubic of leastSquaresTest: badly conditioned, since the features
+	// range over 10, 100 and 1000
+	const unsigned POINTS = 200;
+	const double coeffs[4] = { 3, -2, 0.5, 0.25 };
+
+	Graph graph;
+	NodeSet<InputNode> inputs(3);
+	LinearLayer layer(inputs.getNodes(), 1);
+	layer.randomizeWeights();
+	graph.addInputNodes(inputs.getInputs());
+	graph.addParamNodes(layer.getWeightNodes());
+	graph.outputNodes = layer.getOutputNodes();
+
+	std::vector<double> in(3*POINTS), out(POINTS);
+	for(unsigned j = 0; j < POINTS; ++j)
+	{
+		double t = randFloatRange(-10, 10);
+		in[3*j] = t;
+		in[3*j + 1] = t*t;
+		in[3*j + 2] = t*t*t;
+		out[j] = coeffs[0] + coeffs[1]*t + coeffs[2]*t*t + coeffs[3]*t*t*t;
+	}
+
+	LBFGS<SquareLoss> optimizer(&graph);
+	optimizer.setTrainingSet(in.data(), out.data(), POINTS);
+	optimizer.setTolerance(1e-9);
+	optimizer.runEpochs(500);
+
+	// as the README has it
+	ASSERT_EQUAL(true, optimizer.converged());
+	ASSERT_EQUAL(true, optimizer.getEpochs() < 100);
+	for(unsigned j = 0; j < POINTS; ++j)
+		ASSERT_FLOAT_EQUAL(out[j], graph.forwardPass(&in[3*j])[0], 1e-4);
+
+	// a nonlinear model: every step decreases the loss
+	Graph net;
+	NodeSet<InputNode> netInputs(2);
+	Layer<SigmoidNode> hidden(netInputs.getNodes(), 4);
+	LinearLayer top(hidden.getOutputNodes(), 1);
+	hidden.randomizeWeights();
+	top.randomizeWeights();
+	net.addInputNodes(netInputs.getInputs());
+	net.addParamNodes(hidden.getWeightNodes());
+	net.addParamNodes(top.getWeightNodes());
+	net.outputNodes = top.getOutputNodes();
+
+	double xorIn[8] = { 0, 0, 0, 1, 1, 0, 1, 1 };
+	double xorOut[4] = { 0, 1, 1, 0 };
+
+	auto meanLoss = [&]() {
+		double sum = 0;
+		for(unsigned j = 0; j < 4; ++j)
+			sum += SquareLoss::loss(net.forwardPass(&xorIn[2*j]).data(), &xorOut[j], 1);
+		return sum / 4;
+	};
+
+	LBFGS<SquareLoss> netOptimizer(&net, 5);
+	netOptimizer.setTrainingSet(xorIn, xorOut, 4);
+
+	double first = meanLoss(), last = first;
+	for(unsigned i = 0; i < 200 && !netOptimizer.converged(); ++i)
+	{
+		netOptimizer.runEpoch();
+		double loss = meanLoss();
+		ASSERT_EQUAL(true, loss <= last);
+		last = loss;
+	}
+	ASSERT_EQUAL(true, last < 0.1 * first);
+}
+
+void staticNetTest()
+{
+	// the XOR net of main.cpp, as a graph and as a StaticNet
+	Graph graph;
+	NodeSet<InputNode> inputs(2);
+	Layer<SigmoidNode> first(inputs.getNodes(), 2);
+	Layer<SigmoidNode> second(first.getOutputNodes(), 1);
+	first.randomizeWeights();
+	second.randomizeWeights();
+	graph.addInputNodes(inputs.getInputs());
+	graph.addParamNodes(first.getWeightNodes());
+	graph.addParamNodes(second.getWeightNodes());
+	graph.outputNodes = second.getOutputNodes();
+	graph.bindParameters();
+
+	typedef StaticNet<StaticLayer<2, 2, SigmoidActivation>, StaticLayer<2, 1, SigmoidActivation>> XorNet;
+	ASSERT_EQUAL(2, XorNet::numInputs);
+	ASSERT_EQUAL(1, XorNet::numOutputs);
+	ASSERT_EQUAL(9, XorNet::numParams);
+
+	XorNet net;
+	auto w = graph.parameters.values();
+	std::copy(w.begin(), w.end(), net.params.begin());
+
+	double in[8] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+	double out[4] = { 0, 1, 1, 0 };
+
+	// same outputs and gradients as the graph
+	for(unsigned j = 0; j < 4; ++j)
+	{
+		auto expected = graph.forwardPass(&in[2*j]);
+		graph.backProp(std::vector<double>(1, 1));
+
+		const double* y = net.forward(&in[2*j]);
+		ASSERT_FLOAT_EQUAL(expected[0], y[0], 1e-12);
+
+		double seed = 1;
+		net.gradients.fill(0);
+		net.backward(&in[2*j], &seed);
+		for(unsigned k = 0; k < XorNet::numParams; ++k)
+			ASSERT_FLOAT_EQUAL(graph.paramNodes[k]->getDerivative(0), net.gradients[k], 1e-12);
+	}
+
+	// and the same training run through BatchOptimizer
+	GradientDescent<SquareLoss> graphOptimizer(&graph);
+	graphOptimizer.setTrainingSet(in, out, 4);
+	graphOptimizer.setLearningRate(1);
+	graphOptimizer.runEpochs(200);
+
+	GradientDescent<SquareLoss> netOptimizer(&net);
+	netOptimizer.setTrainingSet(in, out, 4);
+	netOptimizer.setLearningRate(1);
+	netOptimizer.runEpochs(200);
+
+	ASSERT_EQUAL(200, netOptimizer.getEpochs());
+	for(unsigned k = 0; k < XorNet::numParams; ++k)
+		ASSERT_FLOAT_EQUAL(w[k], net.params[k], 1e-9);
+}
+
+void sweepTest()
+{
+	// restarts of the XOR net of main.cpp
+	struct XorNet
+	{
+		XorNet(Graph& g)
+		: inputs(2)
+		, first(inputs.getNodes(), 2)
+		, second(first.getOutputNodes(), 1)
+		{
+			first.randomizeWeights();
+			second.randomizeWeights();
+			g.addInputNodes(inputs.getInputs());
+			g.addParamNodes(first.getWeightNodes());
+			g.addParamNodes(second.getWeightNodes());
+			g.outputNodes = second.getOutputNodes();
+		}
+
+		NodeSet<InputNode> inputs;
+		Layer<SigmoidNode> first, second;
+	};
+
+	auto build = [](Graph& g) { return std::make_shared<XorNet>(g); };
+
+	double in[8] = { 0, 0, 1, 0, 0, 1, 1, 1 };
+	double out[4] = { 0, 1, 1, 0 };
+
+	TrialConfig base;
+	base.learningRate = 1;
+	base.learningRateDecay = 0.9;
+	base.decayFrequency = 5000;
+	auto configs = restarts(8, base);
+	configs[7].learningRate = 100;
+
+	Sweep<GradientDescent, SquareLoss> sweep(build, configs, in, out, 4);
+	sweep.setRoundEpochs(500);
+
+	// a trial starts from the same weights as a graph built with its seed
+	Graph same;
+	srand(configs[3].seed);
+	auto owner = build(same);
+	same.bindParameters();
+	sweep.getGraph(3).bindParameters();
+	auto w = same.parameters.values();
+	auto w3 = sweep.getGraph(3).parameters.values();
+	for(unsigned k = 0; k < w.size(); ++k)
+		ASSERT_EQUAL(w[k], w3[k]);
+
+	ThreadPool pool(2);
+	unsigned best = sweep.run(pool, 20000);
+
+	ASSERT_EQUAL(true, sweep.getResult(best).survived);
+	ASSERT_EQUAL(20000, sweep.getResult(best).epochs);
+	ASSERT_EQUAL(true, sweep.getResult(best).loss < 0.01);
+
+	// halving: 8, 4, 2, then 1 trial left after three rounds
+	unsigned dropped = 0;
+	for(unsigned i = 0; i < sweep.numTrials(); ++i)
+	{
+		if(i == best)
+			continue;
+		ASSERT_EQUAL(false, sweep.getResult(i).survived);
+		ASSERT_EQUAL(true, sweep.getResult(i).epochs <= 1500);
+		dropped++;
+	}
+	ASSERT_EQUAL(7, dropped);
+
+	Graph& g = sweep.getGraph(best);
+	for(unsigned j = 0; j < 4; ++j)
+		ASSERT_FLOAT_EQUAL(out[j], g.forwardPass(&in[2*j])[0], 0.2);
+
+	// stops as soon as a trial is good enough
+	Sweep<GradientDescent, SquareLoss> quick(build, restarts(4, base), in, out, 4);
+	quick.setRoundEpochs(100);
+	quick.setTargetLoss(0.25);
+	best = quick.run(pool, 20000);
+	ASSERT_EQUAL(true, quick.getResult(best).epochs < 20000);
+	ASSERT_EQUAL(true, quick.getResult(best).loss <= 0.25);
+}
+
+void jacobianTest()
+{
+	const unsigned W = 5, H = 6, OUT = 3;
+
+	Graph graph;
+	NodeSet<InputNode> inputs(W);
+	Layer<SigmoidNode> hidden(inputs.getNodes(), H);
+	LinearLayer top(hidden.getOutputNodes(), OUT);
+	hidden.randomizeWeights();
+	top.randomizeWeights();
+	graph.addInputNodes(inputs.getInputs());
+	graph.addParamNodes(hidden.getWeightNodes());
+	graph.addParamNodes(top.getWeightNodes());
+	graph.outputNodes = top.getOutputNodes();
+
+	std::vector<double> in(W);
+	for(auto& v : in)
+		v = randFloatRange(-1, 1);
+
+	ExecutionContext ctx(graph), single(graph);
+	Jacobian J;
+	graph.jacobian(ctx, in.data(), J);
+
+	ASSERT_EQUAL(OUT, J.numOutputs);
+	ASSERT_EQUAL(W, J.numInputs);
+	ASSERT_EQUAL(graph.parameters.size(), J.numParams);
+
+	// each row matches a backProp seeded with that output alone
+	graph.forwardPass(single, in.data());
+	for(unsigned o = 0; o < OUT; ++o)
+	{
+		std::vector<double> seed(OUT, 0);
+		seed[o] = 1;
+		graph.backProp(single, seed);
+
+		for(unsigned i = 0; i < W; ++i)
+			ASSERT_FLOAT_EQUAL(single.getInputGradient(i), J.input(o, i), 1e-12);
+		for(unsigned k = 0; k < J.numParams; ++k)
+			ASSERT_FLOAT_EQUAL(single.getGradient(k), J.param(o, k), 1e-12);
+	}
+
+	// arbitrary seeds, as rows one after the other
+	const unsigned K = 4;
+	std::vector<double> seeds(K * OUT);
+	for(auto& v : seeds)
+		v = randFloatRange(-1, 1);
+	graph.backProp(ctx, seeds.data(), OUT, K);
+	ASSERT_EQUAL(K, ctx.numSeeds());
+
+	for(unsigned j = 0; j < K; ++j)
+	{
+		graph.backProp(single, &seeds[j*OUT], OUT);
+		for(unsigned k = 0; k < J.numParams; ++k)
+			ASSERT_FLOAT_EQUAL(single.getGradient(k), ctx.getGradient(k, j), 1e-12);
+		for(unsigned i = 0; i < W; ++i)
+			ASSERT_FLOAT_EQUAL(single.getInputGradient(i), ctx.getInputGradient(i, j), 1e-12);
+	}
+
+	// finite differences on an input
+	double h = 1e-6;
+	auto plus = in, minus = in;
+	plus[2] += h;
+	minus[2] -= h;
+	auto yPlus = graph.forwardPass(plus.data());
+	auto yMinus = graph.forwardPass(minus.data());
+	for(unsigned o = 0; o < OUT; ++o)
+		ASSERT_FLOAT_EQUAL((yPlus[o] - yMinus[o]) / (2*h), J.input(o, 2), 1e-6);
+}
+
+void sparseInputTest()
+{
+	// bag of features over a vocabulary of V inputs
+	const unsigned V = 200, H = 4, OUT = 2, ROWS = 30, NNZ = 5;
+
+	auto build = [&](Graph& g, NodeSet<InputNode>& inputs, Layer<SigmoidNode>& hidden, LinearLayer& top) {
+		g.addInputNodes(inputs.getInputs());
+		g.addParamNodes(hidden.getWeightNodes());
+		g.addParamNodes(top.getWeightNodes());
+		g.outputNodes = top.getOutputNodes();
+		g.bindParameters();
+	};
+
+	Graph dense, sparse;
+	NodeSet<InputNode> denseInputs(V), sparseInputs(V);
+	Layer<SigmoidNode> denseHidden(denseInputs.getNodes(), H), sparseHidden(sparseInputs.getNodes(), H);
+	LinearLayer denseTop(denseHidden.getOutputNodes(), OUT), sparseTop(sparseHidden.getOutputNodes(), OUT);
+	build(dense, denseInputs, denseHidden, denseTop);
+	build(sparse, sparseInputs, sparseHidden, sparseTop);
+
+	auto w = dense.parameters.values();
+	for(auto& v : w)
+		v = randFloatRange(-1, 1);
+	std::copy(w.begin(), w.end(), sparse.parameters.values().begin());
+
+	SparseRows rows(V);
+	std::vector<double> denseRows(ROWS * V, 0), targets(ROWS * OUT);
+	for(unsigned r = 0; r < ROWS; ++r)
+	{
+		for(unsigned j = 0; j < NNZ; ++j)
+			denseRows[r*V + rand() % V] = randFloatRange(0.5, 2);
+		rows.addDenseRow(&denseRows[r*V]);
+		for(unsigned o = 0; o < OUT; ++o)
+			targets[r*OUT + o] = randFloatRange(-1, 1);
+	}
+	ASSERT_EQUAL(ROWS, rows.rows());
+
+	// same outputs and gradients as a dense ExecutionContext
+	ExecutionContext full(dense);
+	SparseContext ctx(sparse);
+	ASSERT_EQUAL(H + OUT*(H + 1), ctx.numDenseParams());
+
+	std::vector<double> seed = { 0.5, -1.5 };
+	for(unsigned r = 0; r < ROWS; ++r)
+	{
+		auto& expected = dense.forwardPass(full, &denseRows[r*V]);
+		auto& y = sparse.forwardPass(ctx, rows.row(r));
+		for(unsigned o = 0; o < OUT; ++o)
+			ASSERT_FLOAT_EQUAL(expected[o], y[o], 1e-12);
+
+		dense.backProp(full, seed);
+		sparse.backProp(ctx, seed);
+
+		std::vector<double> g1(w.size(), 0), g2(w.size(), 0);
+		full.accumulateGradients(g1.data());
+		ctx.accumulateGradients(g2.data());
+		for(unsigned k = 0; k < w.size(); ++k)
+			ASSERT_FLOAT_EQUAL(g1[k], g2[k], 1e-12);
+	}
+
+	// and the same training run
+	GradientDescent<SquareLoss> denseOptimizer(&dense);
+	denseOptimizer.setTrainingSet(denseRows.data(), targets.data(), ROWS);
+	denseOptimizer.runEpochs(20);
+
+	GradientDescent<SquareLoss> sparseOptimizer(&sparse);
+	sparseOptimizer.setTrainingSet(&rows, targets.data());
+	sparseOptimizer.runEpochs(20);
+
+	auto w2 = sparse.parameters.values();
+	for(unsigned k = 0; k < w.size(); ++k)
+		ASSERT_FLOAT_EQUAL(w[k], w2[k], 1e-9);
+	ASSERT_FLOAT_EQUAL(denseOptimizer.getLastError(), sparseOptimizer.getLastError(), 1e-9);
+
+	// inputs have to feed VectorMultNodes
+	Graph direct;
+	NodeSet<InputNode> directInputs(2);
+	SigmoidNode sig(directInputs.getNodes()[0]);
+	direct.addInputNodes(directInputs.getInputs());
+	direct.outputNodes = { &sig };
+
+	std::cout.setstate(std::ios::failbit);
+	bool threw = false;
+	try { SparseContext bad(direct); }
+	catch(std::exception* e) { threw = true; delete e; }
+	std::cout.clear();
+	ASSERT_EQUAL(true, threw);
+}
+
+void embeddingTest()
+{
+	// a category out of a million and one dense feature
+	const unsigned ROWS = 1000000, DIM = 3, N = 6;
+
+	EmbeddingLayer embedding(ROWS, DIM);
+	embedding.randomizeWeights();
+
+	NodeSet<InputNode> dense(1);
+	std::vector<Node*> features = embedding.getOutputNodes();
+	features.push_back(dense.getNodes()[0]);
+	Layer<SigmoidNode> hidden(features, 2);
+	LinearLayer top(hidden.getOutputNodes(), 1);
+	hidden.randomizeWeights();
+	top.randomizeWeights();
+
+	Graph g;
+	g.addInputNodes(embedding.getInputNodes());
+	g.addInputNodes(dense.getInputs());
+	g.addParamNodes(hidden.getWeightNodes());
+	g.addParamNodes(top.getWeightNodes());
+	g.outputNodes = top.getOutputNodes();
+
+	unsigned categories[N] = { 7, 999999, 7, 123456, 42, 999999 };
+	double in[N] = { 0.5, -1, 0.25, 1, 0, -0.5 };
+	double out[N] = { 1, 0, 1, 0.5, 0, 0 };
+
+	auto meanLoss = [&]() {
+		double sum = 0;
+		for(unsigned j = 0; j < N; ++j)
+		{
+			const double* w = embedding.lookup(categories[j]);
+			std::vector<double> row(w, w + DIM);
+			row.push_back(in[j]);
+			auto y = g.forwardPass(row);
+			sum += SquareLoss::loss(y.data(), &out[j], 1);
+		}
+		return sum / N;
+	};
+
+	// central differences for the rows in the set
+	std::vector<unsigned> used = { 7, 999999, 123456, 42 };
+	std::vector<double> expected;
+	const double h = 1e-6;
+	for(auto r : used)
+	{
+		for(unsigned d = 0; d < DIM; ++d)
+		{
+			double& w = embedding.row(r)[d];
+			double w0 = w;
+			w = w0 + h;
+			double up = meanLoss();
+			w = w0 - h;
+			double down = meanLoss();
+			w = w0;
+			expected.push_back((up - down) / (2*h));
+		}
+	}
+
+	std::vector<double> before(embedding.row(0), embedding.row(0) + DIM);
+	std::vector<double> usedBefore;
+	for(auto r : used)
+		usedBefore.insert(usedBefore.end(), embedding.row(r), embedding.row(r) + DIM);
+
+	GradientDescent<SquareLoss> optimizer(&g);
+	optimizer.setTrainingSet(in, out, N);
+	optimizer.addEmbedding(&embedding, categories);
+	optimizer.setLearningRate(0.5);
+	optimizer.runEpochs(1);
+
+	// one step of -rate * gradient, on the touched rows only
+	ASSERT_EQUAL(used.size(), embedding.touchedRows().size());
+	for(unsigned i = 0; i < used.size(); ++i)
+	{
+		ASSERT_EQUAL(used[i], embedding.touchedRows()[i]);
+		for(unsigned d = 0; d < DIM; ++d)
+		{
+			ASSERT_FLOAT_EQUAL(expected[i*DIM + d], embedding.rowGradient(i)[d], 1e-6);
+			double step = usedBefore[i*DIM + d] - embedding.row(used[i])[d];
+			ASSERT_FLOAT_EQUAL(0.5 * expected[i*DIM + d], step, 1e-6);
+		}
+	}
+	for(unsigned d = 0; d < DIM; ++d)
+		ASSERT_EQUAL(before[d], embedding.row(0)[d]);
+
+	// and it learns
+	double first = meanLoss();
+	optimizer.runEpochs(200);
+	ASSERT_EQUAL(true, meanLoss() < first);
+
+	// the nodes have to be graph inputs
+	EmbeddingLayer stray(10, DIM);
+	GradientDescent<SquareLoss> wrong(&g);
+	wrong.setTrainingSet(in, out, N);
+	wrong.addEmbedding(&stray, categories);
+
+	std::cout.setstate(std::ios::failbit);
+	bool threw = false;
+	try { wrong.runEpochs(1); }
+	catch(std::exception* e) { threw = true; delete e; }
+	std::cout.clear();
+	ASSERT_EQUAL(true, threw);
+
+	// nor anything that would leave the tables out of a snapshot
+	auto throws = [](const std::function<void()>& f) {
+		std::cout.setstate(std::ios::failbit);
+		bool threw = false;
+		try { f(); }
+		catch(std::exception* e) { threw = true; delete e; }
+		std::cout.clear();
+		return threw;
+	};
+
+	ASSERT_EQUAL(true, throws([&] { optimizer.setValidationSet(in, out, N); }));
+	ASSERT_EQUAL(true, throws([&] { optimizer.setCheckpoint("/tmp/toyml_embedding.ck"); }));
+	ASSERT_EQUAL(true, throws([&] { optimizer.resume("/tmp/toyml_embedding.ck"); }));
+
+	GradientDescent<SquareLoss> validated(&g);
+	validated.setTrainingSet(in, out, N);
+	validated.setValidationSet(in, out, N);
+	ASSERT_EQUAL(true, throws([&] { validated.addEmbedding(&embedding, categories); }));
+
+	LBFGS<SquareLoss> lbfgs(&g);
+	lbfgs.setTrainingSet(in, out, N);
+	ASSERT_EQUAL(true, throws([&] { lbfgs.addEmbedding(&embedding, categories); }));
+}